@@ -14,9 +14,9 @@
 namespace OCT {
 
 AcquisitionControllerObj::AcquisitionControllerObj(
-    const std::shared_ptr<RingBuffer<OCTData<Float>>> &buffer,
+    const std::shared_ptr<BroadcastRing<OCTData<Float>>> &frames,
     MotorDriver *motorDriver)
-    : m_daq(buffer), m_motorDriver(motorDriver) {}
+    : m_daq(frames), m_motorDriver(motorDriver) {}
 
 void AcquisitionControllerObj::startAcquisition(AcquisitionParams params,
                                                 AcquisitionMode mode) {
@@ -93,16 +93,17 @@ void AcquisitionControllerObj::startAcquisition(AcquisitionParams params,
 }
 
 AcquisitionController::AcquisitionController(
-    const std::shared_ptr<RingBuffer<OCTData<Float>>> &buffer,
+    const std::shared_ptr<BroadcastRing<OCTData<Float>>> &frames,
     MotorDriver *motorDriver)
-    : m_controller(buffer, motorDriver),
+    : m_controller(frames, motorDriver),
 
       m_gbMode(new QGroupBox("Acquisition mode")),
 
       m_btnAcquireBackgound(new QPushButton("Acquire background")),
       m_btnStartStopAcquisition(new QPushButton("Start")),
       m_btnSaveOrDisplay(new QPushButton("Saving")),
-      m_sbMaxFrames(new QSpinBox), m_sbAscansPerBscan(new QSpinBox)
+      m_sbMaxFrames(new QSpinBox), m_cbSweptSource(new QComboBox),
+      m_sbAscansPerBscan(new QSpinBox), m_sbBufferMB(new QSpinBox)
 
 {
 
@@ -157,6 +158,27 @@ AcquisitionController::AcquisitionController(
             [this](int val) { m_acqParams.maxFrames = val; });
   }
 
+  // Combobox to select the swept source, which sets the A-line size
+  row++;
+  {
+    auto *lbl = new QLabel("Swept source");
+    grid->addWidget(lbl, row, 0);
+    grid->addWidget(m_cbSweptSource, row, 1);
+    lbl->setToolTip("Sets the samples per A-line. The A-line size is saved "
+                    "in the bin file name for sources other than 6144.");
+
+    for (const auto &source : SweptSources) {
+      m_cbSweptSource->addItem(source.name,
+                               static_cast<uint>(source.ALineSize));
+    }
+    m_cbSweptSource->setCurrentIndex(
+        m_cbSweptSource->findData(m_controller.getALineSize()));
+
+    connect(m_cbSweptSource, &QComboBox::currentIndexChanged, [this]() {
+      m_controller.setALineSize(m_cbSweptSource->currentData().toUInt());
+    });
+  }
+
   // Spinbox to set Alines per bscan
   row++;
   {
@@ -182,6 +204,28 @@ AcquisitionController::AcquisitionController(
     });
   }
 
+  // Spinbox to set the frame buffer memory budget
+  row++;
+  {
+    auto *lbl = new QLabel("Buffer (MB)");
+    grid->addWidget(lbl, row, 0);
+    grid->addWidget(m_sbBufferMB, row, 1);
+    lbl->setToolTip("Memory for buffering acquired frames between the DAQ, "
+                    "display and disk writer.\n"
+                    "The number of frames buffered is this divided by the "
+                    "frame size,\nso longer Bscans get fewer frames.");
+
+    // NOLINTBEGIN(*-numbers)
+    m_sbBufferMB->setMinimum(64);
+    m_sbBufferMB->setMaximum(8192);
+    m_sbBufferMB->setSingleStep(64);
+    // NOLINTEND(*-numbers)
+    m_sbBufferMB->setValue(m_controller.getBufferBudgetMB());
+
+    connect(m_sbBufferMB, &QSpinBox::valueChanged,
+            [this](int val) { m_controller.setBufferBudgetMB(val); });
+  }
+
   // Acquire background
   row++;
   {
@@ -195,7 +239,7 @@ AcquisitionController::AcquisitionController(
 
       m_acquiringBackground = true;
 
-      // Only acquire 2 frames for background
+      // Only acquire a few frames for background
       AcquisitionParams acqBackgroundParams;
       acqBackgroundParams.maxFrames = m_framesToAcquireForBackground;
 
@@ -239,6 +283,7 @@ AcquisitionController::AcquisitionController(
               } else {
                 this->setEnabled(true);
                 m_sbMaxFrames->setEnabled(false);
+                m_cbSweptSource->setEnabled(false);
                 m_sbAscansPerBscan->setEnabled(false);
                 m_btnSaveOrDisplay->setEnabled(false);
 
@@ -261,12 +306,14 @@ AcquisitionController::AcquisitionController(
                 // Convert acquired background from bin to calib directory
                 // Update background
                 m_calib->updateBackgroundFromBinfile(
-                    toPath(filepath), m_framesToAcquireForBackground);
+                    toPath(filepath), m_framesToAcquireForBackground,
+                    m_backgroundParams);
 
                 Q_EMIT sigUpdatedBackground();
 
               } else {
                 m_sbMaxFrames->setEnabled(true);
+                m_cbSweptSource->setEnabled(true);
                 m_sbAscansPerBscan->setEnabled(true);
                 m_btnSaveOrDisplay->setEnabled(true);
 
@@ -1,12 +1,13 @@
 #pragma once
 
+#include "BroadcastRing.hpp"
 #include "Calibration.hpp"
 #include "Common.hpp"
 #include "DAQ.hpp"
 #include "MotorDriver.hpp"
 #include "OCTData.hpp"
-#include "RingBuffer.hpp"
 #include <QButtonGroup>
+#include <QComboBox>
 #include <QGridLayout>
 #include <QGroupBox>
 #include <QLabeL>
@@ -47,17 +48,29 @@ public:
   Q_ENUM(AcquisitionMode);
 
   explicit AcquisitionControllerObj(
-      const std::shared_ptr<RingBuffer<OCTData<Float>>> &buffer,
+      const std::shared_ptr<BroadcastRing<OCTData<Float>>> &frames,
       MotorDriver *motorDriver);
 
   auto &daq() { return m_daq; }
   bool isAcquiring() const { return m_acquiring; }
   void startAcquisition(AcquisitionParams params, AcquisitionMode mode);
 
-  // Get and set A line size
+  // Get and set A lines per B scan
   uint32_t getRecordsPerBuffer() const { return m_daq.getRecordsPerBuffer(); }
   void setRecordsPerBuffer(uint32_t val) { m_daq.setRecordsPerBuffer(val); }
 
+  // Get and set A line size
+  uint32_t getALineSize() const { return m_daq.getRecordSize(); }
+  void setALineSize(uint32_t val) { m_daq.setRecordSize(val); }
+
+  // Get and set the frame ring memory budget in MB
+  int getBufferBudgetMB() const {
+    return static_cast<int>(m_daq.getBufferBudget() >> 20);
+  }
+  void setBufferBudgetMB(int val) {
+    m_daq.setBufferBudget(static_cast<size_t>(val) << 20);
+  }
+
   void stopAcquisition() {
     m_acquiring = false;
     m_daq.setShouldStopAcquiring();
@@ -80,7 +93,7 @@ class AcquisitionController : public QWidget {
   Q_OBJECT
 public:
   explicit AcquisitionController(
-      const std::shared_ptr<RingBuffer<OCTData<Float>>> &buffer,
+      const std::shared_ptr<BroadcastRing<OCTData<Float>>> &frames,
       MotorDriver *motorDriver);
 
   AcquisitionController(const AcquisitionController &) = delete;
@@ -117,7 +130,10 @@ private:
   // If true, we are in "acquire background" mode. Otherwise, we're in regulard
   // "start/stop" acquisition mode, regardless of saving or not
   bool m_acquiringBackground{false};
-  int m_framesToAcquireForBackground{2};
+  // >10,000 A-lines, like background.py. The median of 256 A-line blocks
+  // rejects transients during the acquisition.
+  int m_framesToAcquireForBackground{5};
+  BackgroundParams m_backgroundParams{BackgroundEstimator::MedianOfBlocks};
 
   QPushButton *m_btnStartStopAcquisition;
   QPushButton *m_btnSaveOrDisplay;
@@ -125,7 +141,9 @@ private:
   // Acquisition params
   AcquisitionParams m_acqParams;
   QSpinBox *m_sbMaxFrames;
+  QComboBox *m_cbSweptSource;
   QSpinBox *m_sbAscansPerBscan;
+  QSpinBox *m_sbBufferMB;
 
   AcquisitionControllerObj::AcquisitionMode selectedMode() const {
     return static_cast<AcquisitionControllerObj::AcquisitionMode>(
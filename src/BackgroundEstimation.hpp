@@ -0,0 +1,215 @@
+#pragma once
+
+#include "Common.hpp"
+#include "FileIO.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <fftconv/aligned_vector.hpp>
+#include <fmt/format.h>
+#include <functional>
+#include <future>
+#include <oneapi/tbb/blocked_range.h>
+#include <oneapi/tbb/blocked_range2d.h>
+#include <oneapi/tbb/parallel_for.h>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+/*
+Streaming background estimation from bin files.
+
+Frames are read in bounded chunks (the next chunk is read while the current
+one is reduced) and reduced in parallel into per-block column sums, where a
+block is a run of consecutive A-lines. The number of blocks is capped, so
+memory stays bounded however many frames are used.
+
+The estimate is then per sample:
+  Mean            mean over all A-lines (exact)
+  TrimmedMean     mean of the block means after dropping the lowest and
+                  highest `trimFraction` of them
+  MedianOfBlocks  median of the block means
+
+The robust estimates reject transients (e.g. a reflection while the
+catheter moves) that would otherwise bias the mean.
+*/
+namespace OCT {
+
+enum class BackgroundEstimator { Mean, TrimmedMean, MedianOfBlocks };
+
+struct BackgroundParams {
+  BackgroundEstimator estimator{BackgroundEstimator::Mean};
+  double trimFraction{0.1}; // Per side, for TrimmedMean
+
+  // A-lines per block. Grown if needed so there are at most `maxBlocks`.
+  size_t blockLines{256};
+  size_t maxBlocks{64};
+
+  // Upper bound on the fringe read per chunk. Two chunks are in flight.
+  size_t chunkBytes{size_t{64} << 20};
+};
+
+namespace detail {
+
+// sums[b * ALineSize + i] += fringe line l, sample i, for the lines of
+// block b in [lineBegin, lineEnd). `fringe` holds lines from `lineBegin`.
+inline void accumulateBlocks(std::span<const uint16_t> fringe,
+                             size_t ALineSize, size_t lineBegin,
+                             size_t lineEnd, size_t blockLines,
+                             std::span<uint64_t> sums) {
+  constexpr size_t colGrain = 512;
+  const size_t firstBlock = lineBegin / blockLines;
+  const size_t lastBlock = (lineEnd - 1) / blockLines + 1;
+
+  tbb::parallel_for(
+      tbb::blocked_range2d<size_t>(firstBlock, lastBlock, 1, 0, ALineSize,
+                                   colGrain),
+      [&](const tbb::blocked_range2d<size_t> &r) {
+        for (size_t b = r.rows().begin(); b < r.rows().end(); ++b) {
+          const auto l0 = std::max(b * blockLines, lineBegin);
+          const auto l1 = std::min((b + 1) * blockLines, lineEnd);
+          uint64_t *acc = sums.data() + b * ALineSize;
+          const auto c0 = r.cols().begin();
+          const auto c1 = r.cols().end();
+          for (size_t l = l0; l < l1; ++l) {
+            const uint16_t *line = fringe.data() + (l - lineBegin) * ALineSize;
+            // Vectorizes (widening add)
+            for (size_t i = c0; i < c1; ++i) {
+              acc[i] += line[i];
+            }
+          }
+        }
+      });
+}
+
+} // namespace detail
+
+/**
+Estimate the background of the first `nFrames` frames of `reader` into
+`out` (size `reader.ALineSize()`). Returns an error message on failure, in
+which case `out` is untouched.
+ */
+template <Floating T>
+[[nodiscard]] std::optional<std::string>
+estimateBackground(const DatFileReader &reader, size_t nFrames,
+                   std::span<T> out, const BackgroundParams &params = {}) {
+  const auto ALineSize = reader.ALineSize();
+  const auto linesPerFrame = reader.linesPerFrame();
+  nFrames = std::min(nFrames, reader.size());
+  if (nFrames == 0 || ALineSize == 0) {
+    return "No frames to estimate the background from.";
+  }
+  if (out.size() != ALineSize) {
+    return fmt::format("Background has {} samples, the bin has {}.",
+                       out.size(), ALineSize);
+  }
+
+  const size_t totalLines = nFrames * linesPerFrame;
+  const size_t maxBlocks = std::max<size_t>(params.maxBlocks, 1);
+  const size_t minBlockLines = (totalLines + maxBlocks - 1) / maxBlocks;
+  const size_t blockLines = std::max({params.blockLines, minBlockLines,
+                                      size_t{1}});
+  const size_t nBlocks = (totalLines + blockLines - 1) / blockLines;
+  std::vector<uint64_t> sums(nBlocks * ALineSize, 0);
+
+  // Chunks never cross a file, since a read is from one file
+  const size_t chunkFrames =
+      std::clamp<size_t>(params.chunkBytes / reader.frameSizeBytes(), 1,
+                         reader.framesPerFile());
+  const auto framesInChunk = [&](size_t frame) {
+    const auto toFileEnd =
+        reader.framesPerFile() - (frame % reader.framesPerFile());
+    return std::min({chunkFrames, toFileEnd, nFrames - frame});
+  };
+
+  using Chunk = fftconv::AlignedVector<uint16_t>;
+  const auto readChunk = [&reader](size_t frame, size_t n, Chunk &dst) {
+    dst.resize(n * reader.samplesPerFrame());
+    return reader.read(frame, n, dst);
+  };
+
+  // Double buffered: read chunk k+1 while reducing chunk k
+  Chunk current;
+  Chunk next;
+  size_t frame = 0;
+  size_t n = framesInChunk(frame);
+  if (auto err = readChunk(frame, n, current)) {
+    return err;
+  }
+  while (frame < nFrames) {
+    const size_t nextFrame = frame + n;
+    const size_t nNext = nextFrame < nFrames ? framesInChunk(nextFrame) : 0;
+    std::future<std::optional<std::string>> pending;
+    if (nNext > 0) {
+      pending = std::async(std::launch::async, readChunk, nextFrame, nNext,
+                           std::ref(next));
+    }
+
+    const size_t lineBegin = frame * linesPerFrame;
+    detail::accumulateBlocks(current, ALineSize, lineBegin,
+                             lineBegin + n * linesPerFrame, blockLines, sums);
+
+    if (pending.valid()) {
+      if (auto err = pending.get()) {
+        return err;
+      }
+    }
+    std::swap(current, next);
+    frame = nextFrame;
+    n = nNext;
+  }
+
+  // Per sample estimate from the block sums
+  const auto linesInBlock = [&](size_t b) {
+    return std::min((b + 1) * blockLines, totalLines) - b * blockLines;
+  };
+  const size_t trim =
+      params.estimator == BackgroundEstimator::TrimmedMean
+          ? std::min(static_cast<size_t>(params.trimFraction *
+                                         static_cast<double>(nBlocks)),
+                     (nBlocks - 1) / 2)
+          : 0;
+
+  tbb::parallel_for(
+      tbb::blocked_range<size_t>(0, ALineSize),
+      [&](const tbb::blocked_range<size_t> &r) {
+        std::vector<double> means(nBlocks);
+        for (size_t i = r.begin(); i < r.end(); ++i) {
+          if (params.estimator == BackgroundEstimator::Mean) {
+            uint64_t total = 0;
+            for (size_t b = 0; b < nBlocks; ++b) {
+              total += sums[b * ALineSize + i];
+            }
+            out[i] = static_cast<T>(static_cast<double>(total) /
+                                    static_cast<double>(totalLines));
+            continue;
+          }
+
+          for (size_t b = 0; b < nBlocks; ++b) {
+            means[b] = static_cast<double>(sums[b * ALineSize + i]) /
+                       static_cast<double>(linesInBlock(b));
+          }
+          std::ranges::sort(means);
+
+          double val{};
+          if (params.estimator == BackgroundEstimator::MedianOfBlocks) {
+            const auto mid = nBlocks / 2;
+            val = (nBlocks % 2) == 1 ? means[mid]
+                                     : (means[mid - 1] + means[mid]) / 2;
+          } else {
+            double acc = 0;
+            for (size_t b = trim; b < nBlocks - trim; ++b) {
+              acc += means[b];
+            }
+            val = acc / static_cast<double>(nBlocks - 2 * trim);
+          }
+          out[i] = static_cast<T>(val);
+        }
+      });
+
+  return std::nullopt;
+}
+
+} // namespace OCT
@@ -0,0 +1,101 @@
+#pragma once
+
+#include "Common.hpp"
+#include "Instrumentation.hpp"
+#include "OCTData.hpp"
+#include "OCTRecon.hpp"
+#include "ReconWorker.hpp"
+#include "SIMDKernels.hpp"
+#include "SyntheticFringe.hpp"
+#include "timeit.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <fmt/format.h>
+#include <string>
+#include <vector>
+
+namespace OCT {
+
+struct ReconBenchmarkResult {
+  size_t frames{};
+  size_t ALineSize{};
+  double msPerFrame{};
+  double ALinesPerSec{};
+
+  // cv::Mat allocations per frame during warm-up (first pass through the
+  // slots) and in steady state. Steady state should be 0.
+  double warmupMatAllocsPerFrame{};
+  double steadyMatAllocsPerFrame{};
+
+  simd::ISA isa{};
+
+  [[nodiscard]] std::string summary() const {
+    return fmt::format("Recon benchmark ({} kernels, {} samples): {} frames, "
+                       "{:.2f} ms/frame, {:.0f} A-lines/s, Mat allocs/frame "
+                       "{:.2f} warm-up, {:.2f} steady",
+                       simd::toString(isa), ALineSize, frames, msPerFrame,
+                       ALinesPerSec, warmupMatAllocsPerFrame,
+                       steadyMatAllocsPerFrame);
+  }
+};
+
+/**
+Reconstruct synthetic frames through the same per-frame path as ReconWorker
+(recon, radial and combined image), cycling through `nSlots` frames like the
+ring buffer slots. The first pass through the slots is warm-up (FFTW plans,
+radial map, image buffers); the rest is timed.
+
+Requires `perf::MatAllocCounter::install()` for the allocation counts.
+ */
+inline ReconBenchmarkResult
+benchmarkRecon(const SyntheticFringeParams &fringeParams,
+               const OCTReconParams<Float> &params, size_t nFrames = 50,
+               size_t nSlots = 4) {
+  const SyntheticFringeGenerator<Float> generator(fringeParams);
+  const auto calib = generator.calibration();
+
+  std::vector<OCTData<Float>> slots(nSlots);
+  for (size_t i = 0; i < nSlots; ++i) {
+    slots[i].i = i;
+    slots[i].fringe = generator.generate(i);
+  }
+
+  ReconBuffers<Float> buf;
+  const auto reconFrame = [&](OCTData<Float> &dat) {
+    reconBscan_splitSpectrum<Float>(*calib, dat.fringe, fringeParams.ALineSize,
+                                    params, buf, dat.imgRect);
+    makeRadialImage(dat.imgRect, dat.imgRadial, params.padTop, buf.radial);
+    ReconWorker::makeCombinedImage(dat);
+  };
+
+  const auto &allocs = perf::MatAllocCounter::get();
+  const auto allocsStart = allocs.count();
+  for (auto &dat : slots) {
+    reconFrame(dat);
+  }
+  const auto allocsWarm = allocs.count();
+
+  TimeIt timeit;
+  for (size_t i = 0; i < nFrames; ++i) {
+    reconFrame(slots[i % nSlots]);
+  }
+  const auto elapsed = timeit.get_ms();
+  const auto allocsEnd = allocs.count();
+
+  ReconBenchmarkResult result;
+  result.frames = nFrames;
+  result.ALineSize = fringeParams.ALineSize;
+  result.isa = simd::kernels().isa;
+  result.msPerFrame = elapsed / static_cast<double>(nFrames);
+  result.ALinesPerSec = static_cast<double>(fringeParams.linesPerFrame) *
+                        1000.0 / result.msPerFrame;
+  result.warmupMatAllocsPerFrame =
+      static_cast<double>(allocsWarm - allocsStart) /
+      static_cast<double>(nSlots);
+  result.steadyMatAllocsPerFrame =
+      static_cast<double>(allocsEnd - allocsWarm) /
+      static_cast<double>(nFrames);
+  return result;
+}
+
+} // namespace OCT
@@ -0,0 +1,366 @@
+#pragma once
+
+#include "RingBuffer.hpp"
+#include "Trace.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+/*
+Single producer, multi consumer broadcast ring.
+
+Every consumer sees the same stream of frames through its own cursor and
+policy:
+
+  Lossless    sees every frame. The producer blocks when this consumer is a
+              full ring behind (e.g. the disk writer).
+  LatestOnly  skips to the newest frame every time (e.g. live display).
+  EveryNth    sees frames whose sequence number is a multiple of N, skipping
+              to the newest one when it falls behind (e.g. analysis).
+
+A consumer holds the frame it is reading, so `consumeFunc` runs without the
+lock. Only lossless consumers hold back the producer; when the producer wraps
+around to a slot still held by a non-lossless consumer, the slot is swapped
+with a preallocated spare instead of being overwritten.
+*/
+
+enum class ConsumerPolicy : uint8_t { Lossless = 0, LatestOnly, EveryNth };
+
+struct BroadcastConsumerStats {
+  std::string name;
+  ConsumerPolicy policy{};
+  uint64_t consumed{};
+  // Frames this consumer wanted but never saw
+  uint64_t skipped{};
+  // Produced but not yet consumed, at the last consume and the worst seen
+  uint64_t lag{};
+  uint64_t maxLag{};
+};
+
+struct BroadcastRingStats {
+  size_t capacity{};
+  uint64_t produced{};
+  // Times the producer waited on a lossless consumer, and for how long
+  uint64_t producerBlocked{};
+  double producerBlockedMs{};
+  std::vector<BroadcastConsumerStats> consumers;
+};
+
+template <typename T> class BroadcastRing {
+public:
+  using ValueType = std::shared_ptr<T>;
+  using ConsumerId = size_t;
+
+  // A ring of `capacity` slots keeps `capacity - 1` frames readable while the
+  // producer fills the next one.
+  explicit BroadcastRing(size_t capacity)
+      : m_slots(std::max<size_t>(capacity, 2)) {
+    for (auto &val : m_slots) {
+      val = std::make_shared<T>();
+    }
+  }
+
+  [[nodiscard]] size_t capacity() const {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    return m_slots.size();
+  }
+
+  /*
+  Change the number of slots between acquisitions (see
+  `ringCapacityForBudget`). Pending frames are discarded. Returns false if a
+  consumer is still reading a frame. Must not be called while producing.
+  */
+  bool resize(size_t capacity) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    const bool held = std::any_of(m_consumers.begin(), m_consumers.end(),
+                                  [](const auto &c) { return c->held; });
+    if (held) {
+      return false;
+    }
+
+    m_slots.resize(std::max<size_t>(capacity, 2));
+    for (auto &val : m_slots) {
+      if (val == nullptr) {
+        val = std::make_shared<T>();
+      }
+    }
+    // Slot indices changed, so nothing produced so far is readable
+    for (auto &c : m_consumers) {
+      c->cursor = m_seq;
+    }
+    return true;
+  }
+
+  // Apply `func` to every slot and spare. Only call while no producer or
+  // consumer is active.
+  template <typename Func> void forEach(const Func &func) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for (auto &val : m_slots) {
+      func(val);
+    }
+    for (auto &val : m_spares) {
+      func(val);
+    }
+  }
+
+  // Register a consumer. It starts at the next produced frame.
+  ConsumerId addConsumer(std::string name, ConsumerPolicy policy,
+                         uint64_t nth = 1) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    auto consumer = std::make_unique<Consumer>();
+    consumer->name = std::move(name);
+    consumer->policy = policy;
+    consumer->nth = std::max<uint64_t>(nth, 1);
+    consumer->cursor = m_seq;
+    if (policy != ConsumerPolicy::Lossless) {
+      m_spares.push_back(std::make_shared<T>());
+    }
+
+    // Reuse a removed consumer's id
+    for (size_t id = 0; id < m_consumers.size(); ++id) {
+      if (!m_consumers[id]->active) {
+        m_consumers[id] = std::move(consumer);
+        return id;
+      }
+    }
+    m_consumers.push_back(std::move(consumer));
+    return m_consumers.size() - 1;
+  }
+
+  // Must not be called while the consumer is inside `consume`
+  void removeConsumer(ConsumerId id) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_consumers[id]->active = false;
+    m_consumers[id]->held = nullptr;
+    m_notFull.notify_all();
+  }
+
+  /*
+  Fill the next slot. The `produceFunc` should take `std::shared_ptr<T>&` and
+  write to it. Blocks while a lossless consumer is a full ring behind.
+  Returns false if the ring was quit.
+  */
+  template <typename Func> bool produce(const Func &produceFunc) {
+    OCT::trace::Scope trace("Broadcast produce");
+    ValueType *slot{};
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      if (losslessFull()) {
+        const auto start = std::chrono::steady_clock::now();
+        m_notFull.wait(lock, [this]() { return m_quit || !losslessFull(); });
+        m_producerBlocked++;
+        m_producerBlockedNs +=
+            std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - start)
+                .count();
+      }
+      if (m_quit) {
+        return false;
+      }
+
+      slot = &m_slots[m_seq % m_slots.size()];
+      const bool held =
+          std::any_of(m_consumers.begin(), m_consumers.end(),
+                      [&](const auto &c) { return c->held == *slot; });
+      if (held) {
+        // A non-lossless consumer is still reading the oldest frame
+        if (m_spares.empty()) {
+          m_spares.push_back(std::make_shared<T>());
+        }
+        std::swap(*slot, m_spares.back());
+        m_spares.pop_back();
+      }
+    }
+
+    // Consumers never read the slot being filled, see `oldestReadable`
+    produceFunc(*slot);
+
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_seq++;
+    }
+    m_newData.notify_all();
+    return true;
+  }
+
+  /*
+  Wait for the next frame according to the consumer's policy and pass it to
+  `consumeFunc`, which should take `std::shared_ptr<T>&` and read it. Other
+  consumers may be reading the same frame concurrently.
+
+  Returns false without consuming if the ring was quit, or if `interrupt`
+  was called and no frame is pending.
+  */
+  template <typename Func>
+  bool consume(ConsumerId id, const Func &consumeFunc) {
+    uint64_t seq{};
+    ValueType held;
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      auto &c = *m_consumers[id];
+      m_newData.wait(lock, [&]() {
+        return m_quit || c.interrupted || hasNext(c);
+      });
+      if (m_quit || !hasNext(c)) {
+        c.interrupted = false;
+        return false;
+      }
+
+      seq = pick(c);
+      c.lag = m_seq - c.cursor;
+      c.maxLag = std::max(c.maxLag, c.lag);
+      c.held = m_slots[seq % m_slots.size()];
+      held = c.held;
+    }
+
+    {
+      OCT::trace::Scope trace("Broadcast consume");
+      consumeFunc(held);
+    }
+
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      auto &c = *m_consumers[id];
+      c.cursor = seq + 1;
+      c.consumed++;
+      c.held = nullptr;
+      // Swapped out by the producer while we read it. The last reader
+      // returns it to the spares.
+      const bool stillHeld =
+          std::any_of(m_consumers.begin(), m_consumers.end(),
+                      [&](const auto &other) { return other->held == held; });
+      if (m_slots[seq % m_slots.size()] != held && !stillHeld) {
+        m_spares.push_back(std::move(held));
+      }
+    }
+    m_notFull.notify_all();
+    return true;
+  }
+
+  // Make the consumer's current or next `consume` return false once it has
+  // no pending frame. Lossless consumers drain first.
+  void interrupt(ConsumerId id) {
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_consumers[id]->interrupted = true;
+    }
+    m_newData.notify_all();
+  }
+
+  void quit() {
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_quit = true;
+    }
+    m_newData.notify_all();
+    m_notFull.notify_all();
+  }
+
+  BroadcastRingStats stats() const {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    BroadcastRingStats stats;
+    stats.capacity = m_slots.size();
+    stats.produced = m_seq;
+    stats.producerBlocked = m_producerBlocked;
+    // NOLINTNEXTLINE(*-magic-numbers)
+    stats.producerBlockedMs = static_cast<double>(m_producerBlockedNs) * 1e-6;
+    for (const auto &c : m_consumers) {
+      if (c->active) {
+        stats.consumers.push_back(
+            {c->name, c->policy, c->consumed, c->skipped, c->lag, c->maxLag});
+      }
+    }
+    return stats;
+  }
+
+private:
+  struct Consumer {
+    std::string name;
+    ConsumerPolicy policy{};
+    uint64_t nth{1};
+    uint64_t cursor{}; // Next sequence number this consumer wants
+    ValueType held;    // Frame being read in `consume`
+    bool interrupted{false};
+    bool active{true};
+
+    uint64_t consumed{};
+    uint64_t skipped{};
+    uint64_t lag{};
+    uint64_t maxLag{};
+  };
+
+  std::vector<ValueType> m_slots;
+  std::vector<ValueType> m_spares;
+  std::vector<std::unique_ptr<Consumer>> m_consumers;
+
+  uint64_t m_seq{}; // Number of frames produced
+  bool m_quit{false};
+  uint64_t m_producerBlocked{};
+  int64_t m_producerBlockedNs{};
+
+  mutable std::mutex m_mutex;
+  std::condition_variable m_newData;
+  std::condition_variable m_notFull;
+
+  // Oldest readable sequence number. The slot of `m_seq - capacity` is the one
+  // the producer fills next.
+  [[nodiscard]] uint64_t oldestReadable() const {
+    const auto readable = m_slots.size() - 1;
+    return m_seq > readable ? m_seq - readable : 0;
+  }
+
+  [[nodiscard]] bool losslessFull() const {
+    return std::any_of(m_consumers.begin(), m_consumers.end(),
+                       [this](const auto &c) {
+                         return c->active &&
+                                c->policy == ConsumerPolicy::Lossless &&
+                                m_seq - c->cursor >= m_slots.size() - 1;
+                       });
+  }
+
+  // Smallest multiple of `nth` >= `seq`
+  static uint64_t roundUp(uint64_t seq, uint64_t nth) {
+    return (seq + nth - 1) / nth * nth;
+  }
+
+  [[nodiscard]] bool hasNext(const Consumer &c) const {
+    if (c.policy == ConsumerPolicy::EveryNth) {
+      return roundUp(std::max(c.cursor, oldestReadable()), c.nth) < m_seq;
+    }
+    return c.cursor < m_seq;
+  }
+
+  // Choose the sequence number to read and count what is skipped.
+  // Requires `hasNext(c)`.
+  uint64_t pick(Consumer &c) const {
+    switch (c.policy) {
+    case ConsumerPolicy::Lossless:
+      return c.cursor;
+
+    case ConsumerPolicy::LatestOnly: {
+      const auto seq = m_seq - 1;
+      c.skipped += seq - c.cursor;
+      return seq;
+    }
+
+    case ConsumerPolicy::EveryNth: {
+      const auto wanted = roundUp(c.cursor, c.nth);
+      if (wanted >= oldestReadable()) {
+        return wanted;
+      }
+      // Fell behind, skip to the newest eligible frame
+      const auto latest = (m_seq - 1) / c.nth * c.nth;
+      c.skipped += (latest - wanted) / c.nth;
+      return latest;
+    }
+    }
+    return m_seq - 1;
+  }
+};
@@ -1,39 +1,165 @@
 #pragma once
 
+#include "BackgroundEstimation.hpp"
 #include "Common.hpp"
 #include "FileIO.hpp"
+#include "MappedFile.hpp"
+#include "strOps.hpp"
 #include <QDebug>
 #include <algorithm>
+#include <array>
+#include <cctype>
+#include <cerrno>
+#include <charconv>
+#include <concepts>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
 #include <fftconv/aligned_vector.hpp>
 #include <filesystem>
+#include <fmt/format.h>
 #include <fstream>
 #include <iostream>
+#include <iterator>
 #include <memory>
+#include <optional>
 #include <span>
+#include <string>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Floating point std::from_chars is missing from libc++ before LLVM 20
+// (e.g. Apple Clang), which doesn't define __cpp_lib_to_chars
+#ifndef __cpp_lib_to_chars
+#include <clocale>
+#ifdef __APPLE__
+#include <xlocale.h>
+#endif
+#endif
 
 namespace OCT {
 
 namespace fs = std::filesystem;
 
+namespace detail {
+#ifndef __cpp_lib_to_chars
+// strtof/strtod in the "C" locale, so a decimal comma locale doesn't change
+// the parse. The token is copied, [first, last) needn't be null terminated.
+template <std::floating_point V>
+std::from_chars_result fromCharsFallback(const char *first, const char *last,
+                                         V &val) {
+  static const locale_t cLocale = newlocale(LC_ALL_MASK, "C", nullptr);
+  constexpr size_t MaxToken = 64;
+  std::array<char, MaxToken> token{};
+  size_t n = 0;
+  while (first + n != last && n + 1 < MaxToken &&
+         std::isspace(static_cast<unsigned char>(first[n])) == 0) {
+    token[n] = first[n];
+    ++n;
+  }
+  char *end = nullptr;
+  errno = 0;
+  if constexpr (std::is_same_v<V, float>) {
+    val = strtof_l(token.data(), &end, cLocale);
+  } else {
+    val = static_cast<V>(strtod_l(token.data(), &end, cLocale));
+  }
+  const auto parsed = static_cast<size_t>(end - token.data());
+  if (parsed == 0) {
+    return {first, std::errc::invalid_argument};
+  }
+  if (errno == ERANGE) {
+    return {first + parsed, std::errc::result_out_of_range};
+  }
+  return {first + parsed, std::errc{}};
+}
+#endif
+
+template <typename V>
+std::from_chars_result fromChars(const char *first, const char *last, V &val) {
+#ifndef __cpp_lib_to_chars
+  if constexpr (std::is_floating_point_v<V>) {
+    return fromCharsFallback(first, last, val);
+  } else {
+    return std::from_chars(first, last, val);
+  }
+#else
+  return std::from_chars(first, last, val);
+#endif
+}
+} // namespace detail
+
+/*
+Parse one whitespace separated value at `first` with std::from_chars, which
+is locale independent and much faster than `std::istream >>`. Advances
+`first` past the value. Returns false at the end of input or on a parse
+error (then `first` points at the offending character).
+ */
+template <typename V>
+  requires std::is_arithmetic_v<V>
+bool parseValue(const char *&first, const char *last, V &val) {
+  while (first != last && std::isspace(static_cast<unsigned char>(*first))) {
+    ++first;
+  }
+  if (first == last) {
+    return false;
+  }
+  const auto [ptr, ec] = detail::fromChars(first, last, val);
+  if (ec != std::errc{}) {
+    return false;
+  }
+  first = ptr;
+  return true;
+}
+
+/*
+Read exactly `dst.size()` whitespace separated values from `filename` into
+`dst`. Returns an error message if the file can't be read, a value fails to
+parse, or the file has more or fewer values (e.g. a calibration for another
+A-line size).
+ */
 template <typename T>
-void readTextFileToArray(const fs::path &filename, std::span<T> dst) {
-  std::ifstream ifs(filename);
-  if (ifs.is_open()) {
-    T val{};
-    size_t i{};
+[[nodiscard]] std::optional<std::string>
+readTextFileToArray(const fs::path &filename, std::span<T> dst) {
+  std::ifstream ifs(filename, std::ios::binary);
+  if (!ifs.is_open()) {
+    return fmt::format("Failed to open {}", filename.string());
+  }
+  const std::string text{std::istreambuf_iterator<char>(ifs),
+                         std::istreambuf_iterator<char>()};
+  if (ifs.bad()) {
+    return fmt::format("Critical I/O error occured in file {}",
+                       filename.string());
+  }
 
-    while ((ifs >> val) && i < dst.size()) {
-      dst[i++] = val;
-    }
+  const char *first = text.data();
+  const char *last = text.data() + text.size();
+  size_t i{};
+  while (i < dst.size() && parseValue(first, last, dst[i])) {
+    ++i;
+  }
+  // Count what's left, so the message says how big the file really is
+  T extra{};
+  size_t count = i;
+  while (count >= dst.size() && parseValue(first, last, extra)) {
+    ++count;
+  }
 
-    if (ifs.eof()) {
-      // std::cout << "Reached end of file " << filename << '\n';
-    } else if (ifs.fail()) {
-      std::cerr << "Failed to read value in file " << filename << '\n';
-    } else if (ifs.bad()) {
-      std::cerr << "Critical I/O error occured in file " << filename << '\n';
-    }
+  // Stopped on something other than trailing whitespace
+  while (first != last && std::isspace(static_cast<unsigned char>(*first))) {
+    ++first;
+  }
+  if (first != last) {
+    return fmt::format("Failed to read value {} in file {}", count + 1,
+                       filename.string());
+  }
+  if (count != dst.size()) {
+    return fmt::format("{} has {} values, expected {}", filename.string(),
+                       count, dst.size());
   }
+  return std::nullopt;
 }
 
 template <typename T>
@@ -65,78 +191,361 @@ template <Floating T> struct phaseCalibUnit {
     return is >> x.idx >> x.l_coeff >> x.r_coeff;
   }
 
+  friend bool parseValue(const char *&first, const char *last,
+                         phaseCalibUnit<T> &x) {
+    return parseValue(first, last, x.idx) &&
+           parseValue(first, last, x.l_coeff) &&
+           parseValue(first, last, x.r_coeff);
+  }
+
   friend std::ostream &operator<<(std::ostream &os,
                                   const phaseCalibUnit<T> &x) {
     return os << x.idx << ' ' << x.l_coeff << ' ' << x.r_coeff << '\n';
   }
 };
 
+/**
+Phase calibration as a structure of arrays for the SIMD interpolation kernel
+(`simd::interpolate`):
+
+  out[i] = in[idx[i]] * lCoeff[i] + in[idx[i] + 1] * rCoeff[i]
+
+where the coefficients are those of the unit at `idx[i]`. The last sample
+isn't interpolated.
+ */
+template <Floating T> struct InterpTable {
+  fftconv::AlignedVector<int32_t> idx;
+  fftconv::AlignedVector<T> lCoeff;
+  fftconv::AlignedVector<T> rCoeff;
+
+  /*
+  Every interpolated unit must read samples `idx` and `idx + 1` inside the
+  A-line, or the kernel reads past the fringe. Returns an error message
+  for the first that doesn't.
+  */
+  [[nodiscard]] static std::optional<std::string>
+  check(const fftconv::AlignedVector<phaseCalibUnit<T>> &phaseCalib) {
+    const auto nSamples = phaseCalib.size();
+    for (size_t i = 0; i + 1 < nSamples; ++i) {
+      if (phaseCalib[i].idx + 1 >= nSamples) {
+        return fmt::format("Phase calibration unit {} has index {}, out of "
+                           "range for {} samples",
+                           i, phaseCalib[i].idx, nSamples);
+      }
+    }
+    return std::nullopt;
+  }
+
+  // Returns false (and leaves the table empty) if `check` fails
+  bool build(const fftconv::AlignedVector<phaseCalibUnit<T>> &phaseCalib) {
+    if (check(phaseCalib)) {
+      idx.clear();
+      lCoeff.clear();
+      rCoeff.clear();
+      return false;
+    }
+    const auto n = phaseCalib.empty() ? 0 : phaseCalib.size() - 1;
+    idx.resize(n);
+    lCoeff.resize(n);
+    rCoeff.resize(n);
+    for (size_t i = 0; i < n; ++i) {
+      const auto j = phaseCalib[i].idx;
+      idx[i] = static_cast<int32_t>(j);
+      lCoeff[i] = phaseCalib[j].l_coeff;
+      rCoeff[i] = phaseCalib[j].r_coeff;
+    }
+    return true;
+  }
+};
+
+/**
+Binary calibration file (calib.bin), native (little) endian:
+
+  CalibFileHeader      64 bytes
+  background           float32[ALineSize]
+  phase calib idx      uint32[ALineSize]
+  phase calib l_coeff  float32[ALineSize]
+  phase calib r_coeff  float32[ALineSize]
+
+Each array starts on a 64 byte boundary (zero padded). `hash` is the FNV-1a
+of everything after the header and is the calibration's fingerprint
+(`Calibration::hash`), whichever format it was loaded from.
+ */
+struct CalibFileHeader {
+  static constexpr std::array<char, 8> Magic{'O', 'C', 'T', 'C',
+                                             'A', 'L', 'I', 'B'};
+  static constexpr uint32_t Version = 1;
+  static constexpr size_t Alignment = 64;
+
+  std::array<char, 8> magic{Magic};
+  uint32_t version{Version};
+  uint32_t ALineSize{};
+  uint64_t hash{};
+  std::array<uint8_t, 40> reserved{};
+
+  // Bytes per array, padded to the alignment
+  static size_t arrayStride(size_t ALineSize) {
+    const auto bytes = ALineSize * sizeof(float);
+    return (bytes + Alignment - 1) / Alignment * Alignment;
+  }
+  static size_t payloadSize(size_t ALineSize) {
+    return 4 * arrayStride(ALineSize);
+  }
+};
+static_assert(sizeof(CalibFileHeader) == CalibFileHeader::Alignment);
+
 template <Floating T> struct Calibration {
+  static constexpr auto BackgroundFilename = "SSOCTBackground.txt";
+  static constexpr auto PhaseFilename = "SSOCTCalibration180MHZ.txt";
+  static constexpr auto BinaryFilename = "calib.bin";
+
   fftconv::AlignedVector<T> background;
   fftconv::AlignedVector<phaseCalibUnit<T>> phaseCalib;
+  // Derived from phaseCalib
+  InterpTable<T> interp;
 
-  Calibration(int n_samples, const fs::path &backgroundFile,
-              const fs::path &phaseFile)
-      : background(n_samples), phaseCalib(n_samples) {
-    readTextFileToArray<T>(backgroundFile, background);
-    readTextFileToArray<phaseCalibUnit<T>>(phaseFile, phaseCalib);
+  // Samples per A-line this calibration is for
+  [[nodiscard]] size_t ALineSize() const { return background.size(); }
+
+  // Content fingerprint, usable as a cache key for anything derived from
+  // this calibration. Call `rehash()` after modifying the arrays.
+  [[nodiscard]] uint64_t hash() const { return m_hash; }
+  void rehash() { m_hash = fnv1a(serializePayload()); }
+
+  Calibration(fftconv::AlignedVector<T> background,
+              fftconv::AlignedVector<phaseCalibUnit<T>> phaseCalib)
+      : background(std::move(background)), phaseCalib(std::move(phaseCalib)) {
+    interp.build(this->phaseCalib);
+    rehash();
   }
 
+  /*
+  Load from `calibDir`. Prefers calib.bin unless the text files are newer,
+  and converts the text files to calib.bin after parsing them so the next
+  load is fast.
+  */
   static std::shared_ptr<Calibration<T>>
   fromCalibDir(int n_samples, const fs::path &calibDir) {
-    const auto backgroundFile = calibDir / "SSOCTBackground.txt";
-    const auto phaseFile = calibDir / "SSOCTCalibration180MHZ.txt";
-    if (fs::exists(backgroundFile) && fs::exists(phaseFile)) {
-      return std::make_shared<Calibration>(n_samples, backgroundFile,
-                                           phaseFile);
+    const auto backgroundFile = calibDir / BackgroundFilename;
+    const auto phaseFile = calibDir / PhaseFilename;
+    const auto binaryFile = calibDir / BinaryFilename;
+    const bool hasText = fs::exists(backgroundFile) && fs::exists(phaseFile);
+
+    if (fs::exists(binaryFile) &&
+        (!hasText || (!isNewer(backgroundFile, binaryFile) &&
+                      !isNewer(phaseFile, binaryFile)))) {
+      if (auto calib = fromBinaryFile(n_samples, binaryFile)) {
+        return calib;
+      }
+    }
+
+    if (hasText) {
+      auto calib = fromTextFiles(n_samples, backgroundFile, phaseFile);
+      if (calib == nullptr) {
+        return nullptr;
+      }
+      // Best effort, the calib dir may be read only. A calib.bin for another
+      // A-line size is another valid calibration, keep it.
+      const auto binarySize = binaryALineSize(binaryFile);
+      if (binarySize && *binarySize != calib->ALineSize()) {
+        qDebug() << "Not converting calibration to binary,"
+                 << toQString(binaryFile) << "is for" << *binarySize
+                 << "samples";
+      } else if (const auto err = calib->saveBinaryFile(binaryFile)) {
+        qDebug() << "Failed to convert calibration to binary:"
+                 << toQString(*err);
+      }
+      return calib;
     }
     return nullptr;
   }
 
+  // Parse the text files, which must have exactly `n_samples` entries.
+  // Returns nullptr on error.
+  static std::shared_ptr<Calibration<T>>
+  fromTextFiles(int n_samples, const fs::path &backgroundFile,
+                const fs::path &phaseFile) {
+    const auto n = static_cast<size_t>(n_samples);
+    fftconv::AlignedVector<T> background(n);
+    fftconv::AlignedVector<phaseCalibUnit<T>> phaseCalib(n);
+    auto err = readTextFileToArray<T>(backgroundFile, background);
+    if (!err) {
+      err = readTextFileToArray<phaseCalibUnit<T>>(phaseFile, phaseCalib);
+    }
+    if (!err) {
+      err = InterpTable<T>::check(phaseCalib);
+    }
+    if (err) {
+      qWarning() << "Invalid calibration:" << toQString(*err);
+      return nullptr;
+    }
+    return std::make_shared<Calibration>(std::move(background),
+                                         std::move(phaseCalib));
+  }
+
+  // A-line size in the header of the binary calibration at `path`, if it
+  // is one
+  static std::optional<size_t> binaryALineSize(const fs::path &path) {
+    CalibFileHeader header;
+    std::ifstream ifs(path, std::ios::binary);
+    // NOLINTNEXTLINE(*-reinterpret-cast)
+    if (!ifs.read(reinterpret_cast<char *>(&header), sizeof(header)) ||
+        header.magic != CalibFileHeader::Magic) {
+      return std::nullopt;
+    }
+    return header.ALineSize;
+  }
+
+  // Returns nullptr if the file is invalid, corrupt (hash mismatch), for
+  // a different A-line size or has out of range phase indices.
+  static std::shared_ptr<Calibration<T>>
+  fromBinaryFile(int n_samples, const fs::path &path) {
+    const MappedFile file(path);
+    if (!file.ok() || file.size() < sizeof(CalibFileHeader)) {
+      return nullptr;
+    }
+
+    CalibFileHeader header;
+    std::memcpy(&header, file.data(), sizeof(header));
+    const auto n = static_cast<size_t>(header.ALineSize);
+    if (header.magic != CalibFileHeader::Magic ||
+        header.version != CalibFileHeader::Version ||
+        n != static_cast<size_t>(n_samples) ||
+        file.size() != sizeof(header) + CalibFileHeader::payloadSize(n)) {
+      qDebug() << "Invalid or mismatched binary calibration"
+               << toQString(path);
+      return nullptr;
+    }
+
+    const auto payload = file.bytes().subspan(sizeof(header));
+    if (fnv1a(payload) != header.hash) {
+      qDebug() << "Binary calibration hash mismatch" << toQString(path);
+      return nullptr;
+    }
+
+    const auto stride = CalibFileHeader::arrayStride(n);
+    const auto readArray = [&]<typename V>(size_t i, V *dst) {
+      std::memcpy(dst, payload.data() + i * stride, n * sizeof(V));
+    };
+    std::vector<float> bg(n);
+    std::vector<uint32_t> idx(n);
+    std::vector<float> l(n);
+    std::vector<float> r(n);
+    readArray(0, bg.data());
+    readArray(1, idx.data());
+    readArray(2, l.data());
+    readArray(3, r.data());
+
+    fftconv::AlignedVector<T> background(n);
+    fftconv::AlignedVector<phaseCalibUnit<T>> phaseCalib(n);
+    for (size_t i = 0; i < n; ++i) {
+      background[i] = static_cast<T>(bg[i]);
+      phaseCalib[i] = {idx[i], static_cast<T>(l[i]), static_cast<T>(r[i])};
+    }
+    if (const auto err = InterpTable<T>::check(phaseCalib)) {
+      qDebug() << "Invalid binary calibration" << toQString(path) << ":"
+               << toQString(*err);
+      return nullptr;
+    }
+    return std::make_shared<Calibration>(std::move(background),
+                                         std::move(phaseCalib));
+  }
+
+  // Writes to a temporary and renames, so readers never see a partial file
+  std::optional<std::string> saveBinaryFile(const fs::path &path) const {
+    CalibFileHeader header;
+    header.ALineSize = static_cast<uint32_t>(ALineSize());
+    const auto payload = serializePayload();
+    header.hash = fnv1a(payload);
+
+    auto tmpPath = path;
+    tmpPath += ".tmp";
+    {
+      std::ofstream ofs(tmpPath, std::ios::binary | std::ios::trunc);
+      // NOLINTBEGIN(*-reinterpret-cast)
+      ofs.write(reinterpret_cast<const char *>(&header), sizeof(header));
+      ofs.write(reinterpret_cast<const char *>(payload.data()),
+                static_cast<std::streamsize>(payload.size()));
+      // NOLINTEND(*-reinterpret-cast)
+      if (!ofs) {
+        return fmt::format("Failed to write {}", tmpPath.string());
+      }
+    }
+
+    std::error_code ec;
+    fs::rename(tmpPath, path, ec);
+    if (ec) {
+      fs::remove(tmpPath, ec);
+      return fmt::format("Failed to rename {} to {}", tmpPath.string(),
+                         path.string());
+    }
+    return std::nullopt;
+  }
+
   void saveToNewCalibDir(const fs::path &newCalibDir) const {
     if (!fs::exists(newCalibDir)) {
       fs::create_directory(newCalibDir);
     }
 
-    const auto backgroundFile = newCalibDir / "SSOCTBackground.txt";
-    const auto phaseFile = newCalibDir / "SSOCTCalibration180MHZ.txt";
+    const auto backgroundFile = newCalibDir / BackgroundFilename;
+    const auto phaseFile = newCalibDir / PhaseFilename;
 
     writeArrayToTextFile<T>(backgroundFile, background);
     writeArrayToTextFile<phaseCalibUnit<T>>(phaseFile, phaseCalib);
-  }
 
-  // Read a data bin, calculate background from the first n frames.
-  void updateBackgroundFromBinfile(const fs::path &path, int nFrames) {
-    auto reader = DatFileReader::readBinFile(path);
-    nFrames = std::min<size_t>(nFrames, reader.size());
+    if (const auto err = saveBinaryFile(newCalibDir / BinaryFilename)) {
+      qDebug() << "While saving calibration, got" << toQString(*err);
+    }
+  }
 
-    const auto samples = reader.samplesPerFrame() * nFrames;
-    fftconv::AlignedVector<uint16_t> fringe(samples);
+  // Read a data bin, estimate the background from the first n frames (see
+  // `estimateBackground`).
+  void updateBackgroundFromBinfile(const fs::path &path, int nFrames,
+                                   const BackgroundParams &params = {}) {
+    const auto reader = DatFileReader::readBinFile(path);
+    if (reader.ALineSize() != ALineSize()) {
+      qDebug() << "Background bin has" << reader.ALineSize()
+               << "samples per A-line, calibration has" << ALineSize();
+      return;
+    }
 
-    if (const auto err = reader.read(0, nFrames, fringe)) {
-      qDebug() << "While reading background bin, got" << err;
+    if (const auto err =
+            estimateBackground<T>(reader, static_cast<size_t>(nFrames),
+                                  std::span<T>(background), params)) {
+      qDebug() << "While reading background bin, got" << toQString(*err);
     } else {
-      // Read successful
-      const auto ALineSize = DatFileReader::ALineSize;
-      const auto nLines = fringe.size() / ALineSize;
-
-      // Compute average
-      fftconv::AlignedVector<double> acc(ALineSize, 0);
-      for (size_t j = 0; j < nLines; ++j) {
-        const auto offset = j * ALineSize;
-        for (size_t i = 0; i < ALineSize; ++i) {
-          acc[i] += fringe[offset + i];
-        }
-      }
+      rehash();
+    }
+  }
 
-      const auto fct = 1.0 / static_cast<double>(nLines);
-      for (auto &val : acc) {
-        val *= fct;
-      }
+private:
+  uint64_t m_hash{};
 
-      // Update background
-      std::copy(acc.begin(), acc.end(), background.begin());
+  // Payload of the binary format, see CalibFileHeader
+  [[nodiscard]] std::vector<std::byte> serializePayload() const {
+    const auto n = ALineSize();
+    const auto stride = CalibFileHeader::arrayStride(n);
+    std::vector<std::byte> payload(CalibFileHeader::payloadSize(n));
+    const auto writeArray = [&]<typename V>(size_t i, size_t j, V val) {
+      std::memcpy(payload.data() + i * stride + j * sizeof(V), &val,
+                  sizeof(V));
+    };
+    for (size_t j = 0; j < n; ++j) {
+      const auto &unit = phaseCalib[j];
+      writeArray(0, j, static_cast<float>(background[j]));
+      writeArray(1, j, static_cast<uint32_t>(unit.idx));
+      writeArray(2, j, static_cast<float>(unit.l_coeff));
+      writeArray(3, j, static_cast<float>(unit.r_coeff));
     }
+    return payload;
+  }
+
+  static bool isNewer(const fs::path &a, const fs::path &b) {
+    std::error_code ecA;
+    std::error_code ecB;
+    const auto ta = fs::last_write_time(a, ecA);
+    const auto tb = fs::last_write_time(b, ecB);
+    return !ecA && !ecB && ta > tb;
   }
 };
 
@@ -1,8 +1,11 @@
 #pragma once
 
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
 #include <type_traits>
 
-
 namespace OCT {
 
 using Float = float;
@@ -10,4 +13,31 @@ using Float = float;
 template <typename T>
 concept Floating = std::is_same_v<T, double> || std::is_same_v<T, float>;
 
+// Swept source lasers we acquire with (see calc_sampling.py). The A-line size
+// is a per-sequence property; these are the known ones.
+struct SweptSource {
+  const char *name;
+  size_t ALineSize;
+  double ALineRate; // A-lines per second
+};
+
+// NOLINTBEGIN(*-magic-numbers)
+inline constexpr std::array<SweptSource, 2> SweptSources{{
+    {"20 kHz (6144 samples)", 6144, 20e3},
+    {"125 kHz (1024 samples)", 1024, 125e3},
+}};
+
+// FNV-1a 64 bit hash, for content fingerprints used as cache keys. Chain
+// calls by passing the previous hash as `h`.
+inline constexpr uint64_t FNV1aOffset = 0xcbf29ce484222325ULL;
+inline uint64_t fnv1a(std::span<const std::byte> bytes,
+                      uint64_t h = FNV1aOffset) {
+  constexpr uint64_t prime = 0x100000001b3ULL;
+  for (const auto b : bytes) {
+    h = (h ^ static_cast<uint64_t>(b)) * prime;
+  }
+  return h;
+}
+// NOLINTEND(*-magic-numbers)
+
 }
\ No newline at end of file
@@ -3,17 +3,20 @@
 
 #ifdef OCTGUI_HAS_ALAZAR
 
+#include "Instrumentation.hpp"
+#include "Trace.hpp"
 #include "datetime.hpp"
 #include "defer.h"
-#include "timeit.hpp"
 #include <AlazarApi.h>
 #include <AlazarCmd.h>
 #include <AlazarError.h>
 #include <QDebug>
+#include <chrono>
 #include <fmt/core.h>
 #include <ios>
 #include <sstream>
 #include <string>
+#include <thread>
 
 // NOLINTBEGIN(*-do-while)
 
@@ -407,9 +410,14 @@ bool DAQ::prepareAcquisition(int maxBuffersToAcquire) noexcept {
   m_errMsg.clear();
 
   if (m_saveData) {
+    // The A-line size is only in the name for non default sources, see
+    // DatFileReader
+    const auto datetime = datetime::datetimeFormat("%Y%m%d%H%M%S");
     const auto fname =
-        fmt::format("OCT{}_{}.bin", datetime::datetimeFormat("%Y%m%d%H%M%S"),
-                    recordsPerBuffer);
+        recordSize == DatFileReader::DefaultALineSize
+            ? fmt::format("OCT{}_{}.bin", datetime, recordsPerBuffer)
+            : fmt::format("OCT{}_{}_{}.bin", datetime, recordsPerBuffer,
+                          recordSize);
     m_lastBinfile = m_savedir / fname;
     m_fs = std::fstream(m_lastBinfile, std::ios::out | std::ios::binary);
 
@@ -440,6 +448,16 @@ bool DAQ::prepareAcquisition(int maxBuffersToAcquire) noexcept {
   const U32 bytesPerRecord = (U32)(bytesPerSample * recordSize + 0.5);
   const U32 bytesPerBuffer = bytesPerRecord * recordsPerBuffer * channelCount;
 
+  // Size the frame ring for this frame size
+  const auto ringCapacity =
+      ringCapacityForBudget(m_bufferBudget, bytesPerBuffer);
+  if (!m_frames->resize(ringCapacity)) {
+    qWarning("Frame ring busy, keeping %zu slots", m_frames->capacity());
+  } else {
+    qDebug("Frame ring has %zu slots of %u bytes", ringCapacity,
+           bytesPerBuffer);
+  }
+
   // Free all memory allocated
   for (auto &buf : buffers) {
     if (buf.size() > 0) {
@@ -468,6 +486,7 @@ bool DAQ::prepareAcquisition(int maxBuffersToAcquire) noexcept {
 
 bool DAQ::acquire(int buffersToAcquire,
                   const std::function<void()> &callback) noexcept {
+  trace::setThreadName("DAQ");
   shouldStopAcquiring = false;
   acquiringData = true;
   defer { acquiringData = false; };
@@ -497,12 +516,30 @@ bool DAQ::acquire(int buffersToAcquire,
     ALAZAR_CALL(AlazarAbortAsyncRead(board));
   };
 
+  // Write frames to disk from a separate thread, as a lossless consumer of
+  // the broadcast ring
+  m_writeFailed = false;
+  std::thread writer;
+  BroadcastRing<OCTData<Float>>::ConsumerId writerId{};
+  if (m_fs.is_open()) {
+    writerId = m_frames->addConsumer("Disk writer", ConsumerPolicy::Lossless);
+    writer = std::thread([this, writerId]() { writeFramesToDisk(writerId); });
+  }
+  defer {
+    if (writer.joinable()) {
+      // Drain pending frames to disk
+      m_frames->interrupt(writerId);
+      writer.join();
+      m_frames->removeConsumer(writerId);
+    }
+  };
+
   ALAZAR_CALL(AlazarStartCapture(board));
   RETURN_BOOL_IF_FAIL();
 
   uint32_t buffersCompleted = 0;
   uint32_t bufferIdx = 0;
-  while (success && !shouldStopAcquiring &&
+  while (success && !shouldStopAcquiring && !m_writeFailed &&
          buffersCompleted < buffersToAcquire) {
     if (callback) {
       callback();
@@ -518,39 +555,25 @@ bool DAQ::acquire(int buffersToAcquire,
     success = false;
     switch (ret) {
     case ApiSuccess: {
+      trace::instant("DAQ buffer complete");
+      const auto acquiredAt = std::chrono::steady_clock::now();
       success = true;
       buffersCompleted++;
 
-      m_ringBuffer->produce_nolock(
-          [&, this](std::shared_ptr<OCTData<Float>> &dat) {
-            dat->i = buffersCompleted - 1;
-
-            // Copy data from alazar buffer to ring buffer
-            auto &fringe = dat->fringe;
-            if (fringe.size() < buf.size()) {
-              fringe.resize(buf.size());
-            }
-            std::copy(buf.data(), buf.data() + buf.size(), fringe.data());
-          });
-
-      // Save
-      if (m_fs.is_open()) {
-        try {
-          TimeIt timeit;
-          m_fs.write((char *)buf.data(), bytesPerBuffer);
-
-          const auto time_ms = timeit.get_ms();
-          const auto speed_MBps = bytesPerBuffer * 1e-3 / time_ms;
-
-          qInfo("Wrote %d bytes to file in %f ms (%f MB/s)", bytesPerBuffer,
-                time_ms, speed_MBps);
-
-        } catch (std::ios_base::failure &e) {
-          qCritical("Error: write buffer %u failed -- %u", buffersCompleted,
-                    GetLastError());
-          success = false;
+      // Blocks if the disk writer is a full ring behind
+      m_frames->produce([&, this](std::shared_ptr<OCTData<Float>> &dat) {
+        perf::ScopedProbe probe(perf::Stage::DAQCopy);
+        dat->i = buffersCompleted - 1;
+        dat->acquiredAt = acquiredAt;
+        dat->ALineSize = recordSize;
+
+        // Copy data from alazar buffer to ring buffer
+        auto &fringe = dat->fringe;
+        if (fringe.size() != buf.size()) {
+          fringe.resize(buf.size());
         }
-      }
+        std::copy(buf.data(), buf.data() + buf.size(), fringe.data());
+      });
     } break;
 
     case ApiWaitTimeout:
@@ -588,9 +611,45 @@ bool DAQ::acquire(int buffersToAcquire,
     ALAZAR_CALL(AlazarPostAsyncBuffer(board, buf.data(), bytesPerBuffer));
   }
 
+  if (m_writeFailed) {
+    m_errMsg = "DAQ: failed to write frames to " + m_lastBinfile.string();
+    success = false;
+  }
+
   return success;
 }
 
+void DAQ::writeFramesToDisk(BroadcastRing<OCTData<Float>>::ConsumerId id) {
+  trace::setThreadName("Disk writer");
+
+  const auto writeFunc = [this](std::shared_ptr<OCTData<Float>> &dat) {
+    if (m_writeFailed) {
+      // Keep draining so the producer isn't blocked until acquisition stops
+      return;
+    }
+
+    const auto bytesPerBuffer = dat->fringe.size() * sizeof(uint16_t);
+    try {
+      perf::ScopedProbe probe(perf::Stage::DAQWrite);
+      m_fs.write((char *)dat->fringe.data(), bytesPerBuffer);
+
+      const auto time_ms = probe.get_ms();
+      const auto speed_MBps = bytesPerBuffer * 1e-3 / time_ms;
+
+      qInfo("Wrote %zu bytes to file in %f ms (%f MB/s)", bytesPerBuffer,
+            time_ms, speed_MBps);
+
+    } catch (std::ios_base::failure &e) {
+      qCritical("Error: write buffer %zu failed -- %u", dat->i,
+                GetLastError());
+      m_writeFailed = true;
+    }
+  };
+
+  while (m_frames->consume(id, writeFunc)) {
+  }
+}
+
 DAQ::~DAQ() {
   for (auto &buf : buffers) {
     if (buf.size() >= 0) {
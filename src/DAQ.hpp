@@ -5,9 +5,10 @@ Implements a data acquisition interface
 
 #ifdef OCTGUI_HAS_ALAZAR
 
+#include "BroadcastRing.hpp"
 #include "Common.hpp"
+#include "FileIO.hpp"
 #include "OCTData.hpp"
-#include "RingBuffer.hpp"
 #include <array>
 #include <atomic>
 #include <filesystem>
@@ -24,8 +25,8 @@ std::string getDAQInfo();
 
 class DAQ {
 public:
-  explicit DAQ(std::shared_ptr<RingBuffer<OCTData<Float>>> buffer)
-      : m_ringBuffer(std::move(buffer)) {}
+  explicit DAQ(std::shared_ptr<BroadcastRing<OCTData<Float>>> frames)
+      : m_frames(std::move(frames)) {}
 
   DAQ(const DAQ &) = delete;
   DAQ(DAQ &&) = delete;
@@ -58,13 +59,29 @@ public:
   const fs::path &binpath() const noexcept { return m_lastBinfile; }
   const std::string &errMsg() const noexcept { return m_errMsg; }
 
-  // Get and set A line size
+  // Get and set A lines per B scan
   uint32_t getRecordsPerBuffer() const { return recordsPerBuffer; }
   void setRecordsPerBuffer(uint32_t val) { recordsPerBuffer = val; }
 
+  // Get and set A line size (samples per record), see `SweptSources`.
+  // Takes effect at the next prepareAcquisition.
+  uint32_t getRecordSize() const { return recordSize; }
+  void setRecordSize(uint32_t val) { recordSize = val; }
+
+  // Memory for the frame ring. The number of frames buffered is derived from
+  // this and the frame size in prepareAcquisition.
+  size_t getBufferBudget() const { return m_bufferBudget; }
+  void setBufferBudget(size_t bytes) { m_bufferBudget = bytes; }
+
 private:
-  // Ring buffer
-  std::shared_ptr<RingBuffer<OCTData<Float>>> m_ringBuffer;
+  // Acquired frames are broadcast to the display and the disk writer
+  std::shared_ptr<BroadcastRing<OCTData<Float>>> m_frames;
+  size_t m_bufferBudget{size_t{512} << 20};
+
+  // Lossless consumer of `m_frames` that writes fringes to `m_fs`. Runs in
+  // its own thread so slow disk writes don't delay reposting DMA buffers.
+  void writeFramesToDisk(BroadcastRing<OCTData<Float>>::ConsumerId id);
+  std::atomic<bool> m_writeFailed{false};
 
   // Control states
   std::atomic<bool> shouldStopAcquiring{false};
@@ -77,8 +94,8 @@ private:
   static constexpr size_t num_buffers{16};
   std::array<std::span<uint16_t>, num_buffers> buffers{};
 
-  uint32_t recordSize = 3 * 2048;   // ALine size
-  uint32_t recordsPerBuffer = 2200; // ALines per BScan
+  uint32_t recordSize = DatFileReader::DefaultALineSize; // ALine size
+  uint32_t recordsPerBuffer = 2200;                      // ALines per BScan
   uint32_t channelMask{};
 
   // Sampling rate
@@ -0,0 +1,169 @@
+#pragma once
+
+#include "SIMDKernels.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <opencv2/core.hpp>
+#include <utility>
+#include <vector>
+
+/*
+En-face (projection) map of a pullback: one row per frame, one column per
+A-line, each pixel the mean or max of the A-line over a depth band.
+
+The reduction is fused into the recon epilogue (see `finishBscan`), which
+accumulates the rows of the band while they're still in cache from the 8 bit
+conversion, so the map costs one SIMD add and max per pixel of the band.
+*/
+namespace OCT {
+
+enum class EnFaceMode : uint8_t { Mean = 0, Max };
+
+struct EnFaceParams {
+  EnFaceMode mode{EnFaceMode::Mean};
+  // Depth band [depthBegin, depthEnd) in rect image rows. A depthEnd of 0 is
+  // the bottom of the image.
+  int depthBegin{0};
+  int depthEnd{0};
+
+  // Band clamped to an image of `depth` rows
+  [[nodiscard]] std::pair<int, int> band(int depth) const {
+    const int end = depthEnd <= 0 ? depth : std::min(depthEnd, depth);
+    return {std::clamp(depthBegin, 0, end), end};
+  }
+};
+
+// Running per A-line sum and max of the rows of one frame's depth band
+class EnFaceAccumulator {
+public:
+  void begin(int nLines) {
+    m_sum.assign(static_cast<size_t>(nLines), 0);
+    m_max.assign(static_cast<size_t>(nLines), 0);
+    m_rows = 0;
+  }
+
+  // Add a row of the rect image (`nLines` wide)
+  void add(const uint8_t *row) {
+    simd::kernels().enFaceAccumulate(row, m_sum.data(), m_max.data(),
+                                     m_sum.size());
+    ++m_rows;
+  }
+
+  // Write the reduced row (1 x nLines) into `line`
+  void finish(EnFaceMode mode, cv::Mat_<uint8_t> &line) const {
+    const auto n = static_cast<int>(m_sum.size());
+    line.create(1, n);
+    if (mode == EnFaceMode::Max) {
+      std::copy(m_max.begin(), m_max.end(), line.begin());
+      return;
+    }
+    const uint32_t rows = std::max<uint32_t>(m_rows, 1);
+    for (int i = 0; i < n; ++i) {
+      line(0, i) = static_cast<uint8_t>((m_sum[i] + rows / 2) / rows);
+    }
+  }
+
+private:
+  std::vector<uint32_t> m_sum;
+  std::vector<uint8_t> m_max;
+  uint32_t m_rows{};
+};
+
+// En-face row of an already reconstructed rect image, e.g. from the cache
+inline void reduceEnFace(const cv::Mat_<uint8_t> &rect,
+                         const EnFaceParams &params, EnFaceAccumulator &acc,
+                         cv::Mat_<uint8_t> &line) {
+  const auto [begin, end] = params.band(rect.rows);
+  acc.begin(rect.cols);
+  for (int r = begin; r < end; ++r) {
+    acc.add(rect[r]);
+  }
+  acc.finish(params.mode, line);
+}
+
+/**
+The en-face map of a sequence, built a row at a time as frames are
+reconstructed, live or offline. Rows may arrive in any order and the map
+grows as needed for live pullbacks.
+ */
+class EnFaceMap {
+public:
+  // Drop all rows and expect `nFrames` (0 if unknown, e.g. live)
+  void reset(size_t nFrames = 0) {
+    m_expected = nFrames;
+    clear();
+  }
+
+  // Drop all rows of the same sequence, e.g. when the band changes
+  void clear() {
+    m_frames = 0;
+    m_map.release();
+  }
+
+  // Set row `i` from an en-face row (see `EnFaceAccumulator::finish`)
+  void setRow(size_t i, const cv::Mat_<uint8_t> &line) {
+    if (line.empty()) {
+      return;
+    }
+    if (!m_map.empty() && m_map.cols != line.cols) {
+      // New geometry, earlier rows don't fit
+      reset(m_expected);
+    }
+    grow(i + 1, line.cols);
+    line.copyTo(m_map.row(static_cast<int>(i)));
+    m_frames = std::max(m_frames, i + 1);
+  }
+
+  /*
+  Draw the map into `dst`, one row per frame of the sequence (or per frame
+  so far if unknown) from the top. If there are more frames than rows in
+  `dst`, rows are sampled so the whole pullback stays visible. `dst` is
+  cleared if the map is empty or a different width.
+  */
+  void render(cv::Mat_<uint8_t> dst) const {
+    dst.setTo(0);
+    if (m_map.empty() || m_map.cols != dst.cols || dst.rows == 0) {
+      return;
+    }
+    const auto n = std::max(m_frames, m_expected);
+    const auto rows = static_cast<size_t>(dst.rows);
+    if (n <= rows) {
+      m_map.rowRange(0, static_cast<int>(m_frames))
+          .copyTo(dst.rowRange(0, static_cast<int>(m_frames)));
+      return;
+    }
+    for (size_t r = 0; r < rows; ++r) {
+      const auto i = r * n / rows;
+      if (i < m_frames) {
+        m_map.row(static_cast<int>(i)).copyTo(dst.row(static_cast<int>(r)));
+      }
+    }
+  }
+
+  [[nodiscard]] const cv::Mat_<uint8_t> &map() const { return m_map; }
+  [[nodiscard]] size_t frames() const { return m_frames; }
+
+private:
+  size_t m_expected{};
+  size_t m_frames{}; // 1 + highest row set
+  // Rows past `m_frames` are unused capacity
+  cv::Mat_<uint8_t> m_map;
+
+  // Make room for `n` rows, doubling for live pullbacks
+  void grow(size_t n, int cols) {
+    const auto capacity = static_cast<size_t>(m_map.rows);
+    if (n <= capacity && !m_map.empty()) {
+      return;
+    }
+    const auto rows = m_map.empty() ? std::max(n, m_expected)
+                                    : std::max(n, 2 * capacity);
+    cv::Mat_<uint8_t> map(static_cast<int>(rows), cols, uint8_t{0});
+    if (!m_map.empty()) {
+      m_map.copyTo(map.rowRange(0, m_map.rows));
+    }
+    m_map = map;
+  }
+};
+
+} // namespace OCT
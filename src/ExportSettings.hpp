@@ -1,20 +1,44 @@
 #pragma once
 
+#include <QActionGroup>
 #include <QCheckBox>
 #include <QGridLayout>
+#include <QHBoxLayout>
 #include <QLabel>
 #include <QMenu>
+#include <QSpinBox>
 #include <QWidget>
+#include <QWidgetAction>
+#include <cstddef>
+#include <cstdint>
 #include <filesystem>
+#include <fmt/format.h>
 #include <functional>
+#include <string_view>
 #include <vector>
 
 namespace OCT {
 namespace fs = std::filesystem;
 
+enum class ExportFormat : uint8_t { TIFF = 0, PNG };
+enum class TiffCompression : uint8_t { None = 0, LZW };
+
 struct ExportSettings {
   bool saveImages{false};
   fs::path exportDir;
+
+  // Encoder
+  ExportFormat format{ExportFormat::TIFF};
+  // LZW, like cv::imwrite's TIFF default, so existing exports don't change
+  TiffCompression tiffCompression{TiffCompression::LZW};
+  // zlib level 0 (fastest, largest) to 9
+  int pngLevel{1};
+
+  // Path of image `name` (e.g. "rect") of frame `i`
+  [[nodiscard]] fs::path path(std::string_view name, size_t i) const {
+    const auto *ext = format == ExportFormat::PNG ? "png" : "tiff";
+    return exportDir / fmt::format("{}-{:03}.{}", name, i, ext);
+  }
 };
 
 class ExportSettingsWidget : public QWidget {
@@ -67,6 +91,62 @@ public:
         m_settings.saveImages = act->isChecked();
       });
     }
+
+    // Encoder
+    {
+      auto *menu = m_menu->addMenu("Format");
+      auto *group = new QActionGroup(this);
+      const auto addFormat = [&](const char *name, ExportFormat format) {
+        auto *act = new QAction(name, group);
+        act->setCheckable(true);
+        act->setChecked(m_settings.format == format);
+        menu->addAction(act);
+        connect(act, &QAction::triggered, [this, format]() {
+          this->m_dirty = true;
+          m_settings.format = format;
+        });
+      };
+      addFormat("TIFF", ExportFormat::TIFF);
+      addFormat("PNG", ExportFormat::PNG);
+    }
+    {
+      auto *menu = m_menu->addMenu("TIFF compression");
+      auto *group = new QActionGroup(this);
+      const auto addCompression = [&](const char *name,
+                                      TiffCompression compression) {
+        auto *act = new QAction(name, group);
+        act->setCheckable(true);
+        act->setChecked(m_settings.tiffCompression == compression);
+        menu->addAction(act);
+        connect(act, &QAction::triggered, [this, compression]() {
+          this->m_dirty = true;
+          m_settings.tiffCompression = compression;
+        });
+      };
+      addCompression("None", TiffCompression::None);
+      addCompression("LZW", TiffCompression::LZW);
+    }
+    {
+      auto *widget = new QWidget;
+      auto *layout = new QHBoxLayout;
+      widget->setLayout(layout);
+      layout->addWidget(new QLabel("PNG compression"));
+      auto *spinBox = new QSpinBox;
+      constexpr int maxLevel = 9;
+      spinBox->setRange(0, maxLevel);
+      spinBox->setValue(m_settings.pngLevel);
+      spinBox->setToolTip("0 is fastest, 9 is smallest");
+      layout->addWidget(spinBox);
+      connect(spinBox, &QSpinBox::valueChanged, [this](int value) {
+        this->m_dirty = true;
+        m_settings.pngLevel = value;
+      });
+
+      auto *act = new QWidgetAction(this);
+      act->setDefaultWidget(widget);
+      m_menu->addAction(act);
+    }
+    m_menu->addSeparator();
   }
 
   void setExportDir(const fs::path &exportDir) {
@@ -0,0 +1,156 @@
+#pragma once
+
+#include "Common.hpp"
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <fftconv/fftw.hpp>
+#include <fftw3.h>
+#include <filesystem>
+#include <mutex>
+#include <shared_mutex>
+#include <system_error>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/*
+FFTW wisdom persistence and plan warm-up.
+
+`fftw::EngineR2C1D<T>::get` plans lazily with cheap flags on the first frame.
+Planning the known sizes ahead of time with FFTW_MEASURE (or FFTW_EXHAUSTIVE,
+once per machine) accumulates wisdom that later plans of the same size pick
+up for free. Wisdom is saved to and loaded from the user config dir.
+
+The FFTW planner isn't thread safe, so every plan of type T in the app is
+made through `FFTWPlanner<T>` under its lock. Engines already planned are
+looked up in a separate cache, so recon never waits on a warm-up planning
+another size.
+*/
+namespace OCT {
+
+namespace fs = std::filesystem;
+
+// FFT sizes used by recon: the A-line sizes we acquire and their split
+// spectrum sizes for n_splits 1-5. Most used first.
+inline std::vector<size_t> knownFFTSizes() {
+  constexpr std::array<size_t, 2> ALineSizes{6144, 1024};
+  constexpr size_t maxSplits = 5;
+  std::vector<size_t> sizes;
+  for (const auto n : ALineSizes) {
+    for (size_t splits = 1; splits <= maxSplits; ++splits) {
+      sizes.push_back(n / splits);
+    }
+  }
+  return sizes;
+}
+
+template <Floating T> class FFTWPlanner {
+public:
+  static FFTWPlanner &get() {
+    static FFTWPlanner planner;
+    return planner;
+  }
+
+  using Engine = std::remove_reference_t<decltype(fftw::EngineR2C1D<T>::get(
+      std::declval<size_t>()))>;
+
+  // Cached engine for size `n`, planned under the planner lock if it's new
+  Engine &engine(size_t n) {
+    {
+      std::shared_lock<std::shared_mutex> lock(m_cacheMutex);
+      if (const auto it = m_engines.find(n); it != m_engines.end()) {
+        return *it->second;
+      }
+    }
+    std::unique_lock<std::mutex> lock(m_mutex);
+    return plan(n);
+  }
+
+  bool loadWisdom(const fs::path &path) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    const auto str = path.string();
+    if constexpr (std::is_same_v<T, float>) {
+      return fftwf_import_wisdom_from_filename(str.c_str()) != 0;
+    } else {
+      return fftw_import_wisdom_from_filename(str.c_str()) != 0;
+    }
+  }
+
+  bool saveWisdom(const fs::path &path) {
+    std::error_code ec;
+    fs::create_directories(path.parent_path(), ec);
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    const auto str = path.string();
+    if constexpr (std::is_same_v<T, float>) {
+      return fftwf_export_wisdom_to_filename(str.c_str()) != 0;
+    } else {
+      return fftw_export_wisdom_to_filename(str.c_str()) != 0;
+    }
+  }
+
+  /*
+  Plan the r2c FFT of each size in `sizes` with `flags` (e.g. FFTW_MEASURE)
+  to accumulate wisdom, then create the engine so the first frame doesn't
+  plan. Sizes already in the wisdom at this rigor are instant.
+
+  The lock is released between sizes so recon can plan meanwhile. Returns
+  false if cancelled (a size being planned still finishes).
+  */
+  bool warmup(const std::vector<size_t> &sizes, unsigned flags) {
+    m_cancel = false;
+    for (const auto n : sizes) {
+      if (m_cancel) {
+        return false;
+      }
+      std::unique_lock<std::mutex> lock(m_mutex);
+      planForWisdom(n, flags);
+      plan(n);
+    }
+    return true;
+  }
+
+  void cancel() { m_cancel = true; }
+
+private:
+  FFTWPlanner() = default;
+
+  std::mutex m_mutex; // The FFTW planner
+  std::atomic<bool> m_cancel{false};
+
+  std::shared_mutex m_cacheMutex;
+  std::unordered_map<size_t, Engine *> m_engines;
+
+  // Engine for size `n`, added to the cache. Requires the planner lock.
+  Engine &plan(size_t n) {
+    auto &engine = fftw::EngineR2C1D<T>::get(n);
+    std::unique_lock<std::shared_mutex> lock(m_cacheMutex);
+    m_engines.try_emplace(n, &engine);
+    return engine;
+  }
+
+  // Out-of-place on SIMD aligned buffers, like `fftw::R2CBuffer`, so the
+  // wisdom matches the plans recon makes. Requires the lock.
+  static void planForWisdom(size_t n, unsigned flags) {
+    const auto size = static_cast<int>(n);
+    if constexpr (std::is_same_v<T, float>) {
+      auto *in = fftwf_alloc_real(n);
+      auto *out = fftwf_alloc_complex(n / 2 + 1);
+      auto *plan = fftwf_plan_dft_r2c_1d(size, in, out, flags);
+      fftwf_destroy_plan(plan);
+      fftwf_free(out);
+      fftwf_free(in);
+    } else {
+      auto *in = fftw_alloc_real(n);
+      auto *out = fftw_alloc_complex(n / 2 + 1);
+      auto *plan = fftw_plan_dft_r2c_1d(size, in, out, flags);
+      fftw_destroy_plan(plan);
+      fftw_free(out);
+      fftw_free(in);
+    }
+  }
+};
+
+} // namespace OCT
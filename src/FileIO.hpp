@@ -1,5 +1,6 @@
 #pragma once
 
+#include <algorithm>
 #include <cassert>
 #include <cstring>
 #include <filesystem>
@@ -11,6 +12,7 @@
 #include <span>
 #include <stdexcept>
 #include <string>
+#include <vector>
 
 namespace OCT {
 
@@ -62,6 +64,26 @@ inline std::optional<std::string> readFile(const fs::path &path,
   return std::nullopt;
 }
 
+// Read `count` records of `recordBytes`, `strideBytes` apart from `offset`
+inline std::optional<std::string>
+readFileStrided(const fs::path &path, std::streamsize offset,
+                std::streamsize recordBytes, std::streamsize strideBytes,
+                size_t count, void *dst) {
+  std::ifstream fs(path, std::ios::binary);
+  auto *out = static_cast<char *>(dst);
+  for (size_t k = 0; k < count; ++k) {
+    // NOLINTNEXTLINE(*-narrowing-conversions)
+    fs.seekg(offset + static_cast<std::streamsize>(k) * strideBytes);
+    fs.read(out, recordBytes);
+    if (!fs) {
+      return fmt::format("Error: Read failed at record {}/{} while reading {}",
+                         k, count, path.string());
+    }
+    out += recordBytes; // NOLINT(*-pointer-arithmetic)
+  }
+  return std::nullopt;
+}
+
 } // namespace detail
 
 /**
@@ -71,10 +93,14 @@ One imaging sequence is grouped into normally 20 files.
 Each file normally has 20 frames and each frame consists of Ascans with 6144
 (2048*3) samples each. The in vivo probe acquires 2200 Ascans per frame. The
 ex vivo probe acquires 2500 Ascans per frame.
+
+Bin files from the DAQ are named OCT<datetime>_<Ascans per frame>.bin, or
+OCT<datetime>_<Ascans per frame>_<samples per Ascan>.bin for sources other
+than the 6144 sample one (e.g. 1024 for the 125 kHz laser).
  */
 struct DatFileReader {
   using T = uint16_t;
-  static constexpr size_t ALineSize = 2048LL * 3;
+  static constexpr size_t DefaultALineSize = 2048LL * 3;
 
   DatFileReader() = default;
   explicit DatFileReader(const std::span<const fs::path> files)
@@ -122,11 +148,14 @@ struct DatFileReader {
       // Parse file name
       {
         const auto stem = filepath.stem().string();
-        std::regex re(R"rgx(OCT\d+_(\d+))rgx");
+        std::regex re(R"rgx(OCT\d+_(\d+)(?:_(\d+))?)rgx");
         std::smatch match;
         int linesPerFrame = 0;
         if (std::regex_search(stem, match, re)) {
           linesPerFrame = std::stoi(match[1].str());
+          if (match[2].matched) {
+            reader.m_ALineSize = std::stoul(match[2].str());
+          }
         }
         reader.determineFrameSize(linesPerFrame);
       }
@@ -142,8 +171,12 @@ struct DatFileReader {
   // Get the number of frames available.
   [[nodiscard]] size_t size() const { return m_files.size() * m_framesPerFile; }
 
+  [[nodiscard]] size_t ALineSize() const { return m_ALineSize; }
+  [[nodiscard]] size_t linesPerFrame() const { return m_linesPerFrame; }
+  [[nodiscard]] size_t framesPerFile() const { return m_framesPerFile; }
+
   [[nodiscard]] size_t samplesPerFrame() const {
-    return m_linesPerFrame * ALineSize;
+    return m_linesPerFrame * m_ALineSize;
   }
 
   // Get the size of one frame in bytes
@@ -152,6 +185,9 @@ struct DatFileReader {
   }
 
   [[nodiscard]] auto seq() const -> const std::string & { return m_seq; }
+  [[nodiscard]] auto files() const -> const std::vector<fs::path> & {
+    return m_files;
+  }
 
   // Read `frameIdx` into buffer `dst`
   [[nodiscard]] inline std::optional<std::string>
@@ -175,11 +211,42 @@ struct DatFileReader {
     return detail::readFile(path, offset, bytesToRead, dst.data());
   }
 
+  // A-lines returned by `readDecimated` for `lineStep`
+  [[nodiscard]] size_t decimatedLines(size_t lineStep) const {
+    lineStep = std::max<size_t>(lineStep, 1);
+    return (m_linesPerFrame + lineStep - 1) / lineStep;
+  }
+
+  // Read every `lineStep`th A-line of frame `frameIdx` into `dst`, e.g. for
+  // a quick preview. Reads `decimatedLines(lineStep)` A-lines.
+  [[nodiscard]] inline std::optional<std::string>
+  readDecimated(size_t frameIdx, size_t lineStep, std::span<T> dst) const {
+    lineStep = std::max<size_t>(lineStep, 1);
+    const auto nLines = decimatedLines(lineStep);
+    if (dst.size() < nLines * m_ALineSize) {
+      return "Dst buffer too small!";
+    }
+    if (frameIdx >= size()) {
+      return "Trying to read past the end of file.";
+    }
+
+    const auto &path = m_files[frameIdx / m_framesPerFile];
+    // NOLINTBEGIN(*-narrowing-conversions)
+    const std::streamsize offset =
+        (frameIdx % m_framesPerFile) * frameSizeBytes();
+    const std::streamsize lineBytes = m_ALineSize * sizeof(T);
+    // NOLINTEND(*-narrowing-conversions)
+    const auto stride = lineBytes * static_cast<std::streamsize>(lineStep);
+    return detail::readFileStrided(path, offset, lineBytes, stride, nLines,
+                                   dst.data());
+  }
+
 private:
   std::vector<fs::path> m_files;
   std::string m_seq{"empty"};
   size_t m_framesPerFile{};
   size_t m_linesPerFrame{};
+  size_t m_ALineSize{DefaultALineSize};
 
   // Checks the size of the first file to set `framesPerFile` and
   // `linesPerFile`
@@ -189,8 +256,8 @@ private:
 
       // Invivo probe acquires 2200 Ascans per Bscan
       // Exvivo probe acquires 2500 Ascans per Bscan
-      if ((samples % ALineSize) == 0) {
-        const auto totalLines = samples / ALineSize;
+      if (m_ALineSize != 0 && (samples % m_ALineSize) == 0) {
+        const auto totalLines = samples / m_ALineSize;
 
         if (linesPerFrame == 0) {
 
@@ -213,7 +280,8 @@ private:
         m_framesPerFile = totalLines / m_linesPerFrame;
       } else {
         std::cerr << "Invalid file size: " << samples
-                  << ", not divisible by A line size " << ALineSize << ".\n";
+                  << ", not divisible by A line size " << m_ALineSize
+                  << ".\n";
       }
     }
   }
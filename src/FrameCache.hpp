@@ -0,0 +1,125 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <opencv2/core.hpp>
+#include <vector>
+
+namespace OCT {
+
+/**
+Memory bounded cache of the reconstructed rect images of one sequence,
+written by the pre-recon thread (see `Prerenderer`) and read by the GUI
+thread. Radial images aren't kept since they're cheap to make from the rect.
+
+When over budget, the frames farthest from the current position are evicted
+first. Every `clear` starts a new epoch, and inserts computed for an older
+epoch (e.g. with old params) are rejected.
+ */
+class FrameCache {
+public:
+  explicit FrameCache(size_t budgetBytes) : m_budget(budgetBytes) {}
+
+  // Drop all frames and size for a sequence of `nFrames`. Returns the new
+  // epoch to pass to `insert`.
+  uint64_t clear(size_t nFrames) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_frames.clear();
+    m_frames.resize(nFrames);
+    m_count = 0;
+    m_bytes = 0;
+    m_center = 0;
+    return ++m_epoch;
+  }
+
+  void setCenter(size_t i) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_center = i;
+  }
+
+  /*
+  Cache a copy of `rect` as frame `i`, evicting the farthest frames from the
+  center to stay in budget. Returns false (and doesn't insert) if `epoch` is
+  stale, or if the cache is full of frames no farther from the center than
+  `i`, in which case frames even farther away won't fit either.
+  */
+  bool insert(uint64_t epoch, size_t i, const cv::Mat_<uint8_t> &rect) {
+    const auto bytes = rect.total() * rect.elemSize();
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (epoch != m_epoch || i >= m_frames.size() || bytes > m_budget) {
+      return false;
+    }
+    if (!m_frames[i].empty()) {
+      return true;
+    }
+
+    while (m_bytes + bytes > m_budget) {
+      const auto far = farthest();
+      if (distance(far) <= distance(i)) {
+        return false;
+      }
+      m_bytes -= m_frames[far].total() * m_frames[far].elemSize();
+      m_frames[far].release();
+      --m_count;
+    }
+
+    rect.copyTo(m_frames[i]);
+    m_bytes += bytes;
+    ++m_count;
+    return true;
+  }
+
+  // Copy frame `i` into `rect`. Returns false if it isn't cached.
+  bool get(size_t i, cv::Mat_<uint8_t> &rect) const {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (i >= m_frames.size() || m_frames[i].empty()) {
+      return false;
+    }
+    m_frames[i].copyTo(rect);
+    return true;
+  }
+
+  [[nodiscard]] bool contains(size_t i) const {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    return i < m_frames.size() && !m_frames[i].empty();
+  }
+
+  [[nodiscard]] size_t count() const {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    return m_count;
+  }
+  [[nodiscard]] size_t bytes() const {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    return m_bytes;
+  }
+  [[nodiscard]] size_t budget() const { return m_budget; }
+
+private:
+  mutable std::mutex m_mutex;
+  std::vector<cv::Mat_<uint8_t>> m_frames; // Empty if not cached
+  size_t m_count{};
+  size_t m_bytes{};
+  size_t m_budget;
+  size_t m_center{};
+  uint64_t m_epoch{};
+
+  [[nodiscard]] size_t distance(size_t i) const {
+    return i > m_center ? i - m_center : m_center - i;
+  }
+
+  // Cached frame farthest from the center. Requires m_count > 0.
+  [[nodiscard]] size_t farthest() const {
+    size_t far = 0;
+    size_t farDist = 0;
+    for (size_t i = 0; i < m_frames.size(); ++i) {
+      if (!m_frames[i].empty() && distance(i) >= farDist) {
+        far = i;
+        farDist = distance(i);
+      }
+    }
+    return far;
+  }
+};
+
+} // namespace OCT
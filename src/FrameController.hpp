@@ -2,15 +2,25 @@
 
 #include <QAction>
 #include <QCursor>
+#include <QEvent>
 #include <QHBoxLayout>
+#include <QImage>
+#include <QLabel>
 #include <QMenu>
+#include <QMouseEvent>
+#include <QPixmap>
+#include <QProgressBar>
 #include <QSlider>
+#include <QStyle>
 #include <QString>
+#include <QTimer>
 #include <QToolTip>
 #include <QVBoxLayout>
 #include <QWidget>
 #include <Qt>
 #include <qnamespace.h>
+#include <utility>
+#include <vector>
 
 namespace OCT {
 
@@ -20,7 +30,9 @@ public:
   FrameController()
       : m_slider(new QSlider), m_menu(new QMenu("F&rame")),
         m_actNext(new QAction("Next frame")),
-        m_actPrev(new QAction("Prev frame")) {
+        m_actPrev(new QAction("Prev frame")), m_idleTimer(new QTimer(this)),
+        m_cacheProgress(new QProgressBar),
+        m_thumbPopup(new QLabel(this, Qt::ToolTip)) {
     m_slider->setMinimum(0);
     m_slider->setMaximum(0);
     m_slider->setTickInterval(1);
@@ -33,17 +45,52 @@ public:
     setLayout(layout);
     layout->addWidget(m_slider);
 
+    // Pre-recon progress, see `setCacheProgress`
+    constexpr int cacheProgressWidth = 160;
+    m_cacheProgress->setFixedWidth(cacheProgressWidth);
+    m_cacheProgress->setFormat("Cached %v/%m");
+    m_cacheProgress->setToolTip(
+        "Frames reconstructed in the background with the current params");
+    m_cacheProgress->hide();
+    layout->addWidget(m_cacheProgress);
+
+    // Thumbnail of the frame under the cursor, see `setThumbnails`
+    m_slider->setMouseTracking(true);
+    m_slider->installEventFilter(this);
+
     // Bind
     connect(m_slider, &QSlider::sliderPressed, this, [&] {
       QToolTip::showText(QCursor::pos(), QString::number(m_slider->value()));
+      showThumbnail(m_slider->value());
     });
+    // While dragging, preview every position and load the full quality
+    // frame once the slider rests for `IdleMs` or is released
+    m_idleTimer->setSingleShot(true);
+    m_idleTimer->setInterval(IdleMs);
     connect(m_slider, &QSlider::sliderMoved, this, [&] {
-      QToolTip::showText(QCursor::pos(), QString::number(m_slider->value()));
+      const auto pos = m_slider->value();
+      QToolTip::showText(QCursor::pos(), QString::number(pos));
+      showThumbnail(pos);
+      m_settled = false;
+      m_idleTimer->start();
+      Q_EMIT posPreview(pos);
+    });
+    connect(m_idleTimer, &QTimer::timeout, this, [&] {
+      if (m_slider->isSliderDown()) {
+        m_settled = true;
+        Q_EMIT posChanged(m_slider->value());
+      }
     });
     connect(m_slider, &QSlider::sliderReleased, this, [&] {
       const auto pos = m_slider->value();
       QToolTip::showText(QCursor::pos(), QString::number(pos));
-      Q_EMIT posChanged(pos);
+      m_thumbPopup->hide();
+      m_idleTimer->stop();
+      // Already loaded if the slider rested here before the release
+      if (!m_settled) {
+        Q_EMIT posChanged(pos);
+      }
+      m_settled = false;
     });
 
     // Actions and menu
@@ -66,6 +113,20 @@ public:
   [[nodiscard]] size_t size() const { return m_slider->maximum(); }
   [[nodiscard]] size_t pos() const { return m_slider->value(); }
 
+  // One thumbnail per frame, shown above the slider while hovering or
+  // dragging. Empty to disable.
+  void setThumbnails(std::vector<QImage> thumbnails) {
+    m_thumbnails = std::move(thumbnails);
+    m_thumbPopup->hide();
+  }
+
+  // `cached` of `total` frames are pre-reconstructed. Hidden if `total` is 0.
+  void setCacheProgress(size_t cached, size_t total) {
+    m_cacheProgress->setVisible(total > 0);
+    m_cacheProgress->setMaximum(static_cast<int>(total));
+    m_cacheProgress->setValue(static_cast<int>(cached));
+  }
+
 public Q_SLOTS:
 
   void nextNoEmit() {
@@ -89,15 +150,60 @@ public Q_SLOTS:
     Q_EMIT posChanged(pos());
   }
 
+protected:
+  bool eventFilter(QObject *obj, QEvent *event) override {
+    if (obj == m_slider && !m_slider->isSliderDown()) {
+      if (event->type() == QEvent::MouseMove) {
+        const auto *mouse = static_cast<QMouseEvent *>(event);
+        showThumbnail(QStyle::sliderValueFromPosition(
+            m_slider->minimum(), m_slider->maximum(),
+            static_cast<int>(mouse->position().x()), m_slider->width()));
+      } else if (event->type() == QEvent::Leave) {
+        m_thumbPopup->hide();
+      }
+    }
+    return QWidget::eventFilter(obj, event);
+  }
+
 Q_SIGNALS:
   void posChanged(size_t pos);
+  // The slider is being dragged over `pos`. A `posChanged` follows when it
+  // rests or is released.
+  void posPreview(size_t pos);
 
 private:
+  static constexpr int IdleMs = 150;
+
   QSlider *m_slider;
 
   QMenu *m_menu;
   QAction *m_actNext;
   QAction *m_actPrev;
+
+  QTimer *m_idleTimer;
+  // `posChanged` was emitted for the current drag position
+  bool m_settled{false};
+
+  QProgressBar *m_cacheProgress;
+
+  std::vector<QImage> m_thumbnails;
+  QLabel *m_thumbPopup;
+
+  // Show the thumbnail of frame `pos` above the slider at the cursor
+  void showThumbnail(int pos) {
+    if (pos < 0 || static_cast<size_t>(pos) >= m_thumbnails.size()) {
+      m_thumbPopup->hide();
+      return;
+    }
+    const auto &img = m_thumbnails[static_cast<size_t>(pos)];
+    m_thumbPopup->setPixmap(QPixmap::fromImage(img));
+    m_thumbPopup->adjustSize();
+    constexpr int margin = 4;
+    const auto x = m_slider->mapFromGlobal(QCursor::pos()).x();
+    m_thumbPopup->move(m_slider->mapToGlobal(
+        QPoint(x - img.width() / 2, -img.height() - margin)));
+    m_thumbPopup->show();
+  }
 };
 
 } // namespace OCT
\ No newline at end of file
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "Instrumentation.hpp"
 #include "Overlay.hpp"
 #include <QAction>
 #include <QEvent>
@@ -18,6 +19,7 @@
 #include <QTransform>
 #include <QWheelEvent>
 #include <Qt>
+#include <chrono>
 
 class ImageDisplay : public QGraphicsView {
   Q_OBJECT;
@@ -64,7 +66,12 @@ public:
 
 public Q_SLOTS:
 
-  void imshow(const QPixmap &pixmap) {
+  // `acquiredAt` is when the frame's fringe was acquired. If set, the
+  // acquisition to display latency is recorded when the frame is painted.
+  void imshow(const QPixmap &pixmap,
+              std::chrono::steady_clock::time_point acquiredAt = {}) {
+    OCT::perf::ScopedProbe probe(OCT::perf::Stage::Display);
+    m_pendingAcquiredAt = acquiredAt;
     m_Pixmap = pixmap;
     if (m_PixmapItem != nullptr) {
       m_Scene->removeItem(m_PixmapItem);
@@ -121,6 +128,15 @@ protected:
   void paintEvent(QPaintEvent *event) override {
     m_overlay->move(0, 0);
     QGraphicsView::paintEvent(event);
+
+    if (m_pendingAcquiredAt != std::chrono::steady_clock::time_point{}) {
+      using namespace std::chrono; // NOLINT(*-namespace)
+      const auto latency = steady_clock::now() - m_pendingAcquiredAt;
+      OCT::perf::Registry::get().record(
+          OCT::perf::Stage::Latency,
+          duration_cast<nanoseconds>(latency).count());
+      m_pendingAcquiredAt = {};
+    }
   }
 
   void resizeEvent(QResizeEvent *event) override {
@@ -170,6 +186,9 @@ private:
 
   bool m_resetZoomOnNext{true};
 
+  // Acquisition time of the frame waiting to be painted
+  std::chrono::steady_clock::time_point m_pendingAcquiredAt{};
+
   void updateTransform() {
     // Set the transformation anchor to under the mouse
     setTransformationAnchor(QGraphicsView::AnchorUnderMouse);
@@ -0,0 +1,321 @@
+#pragma once
+
+#include "Calibration.hpp"
+#include "Common.hpp"
+#include "ExportSettings.hpp"
+#include "FileIO.hpp"
+#include "OCTRecon.hpp"
+#include "Trace.hpp"
+#include "VolumeStore.hpp"
+#include <QDebug>
+#include <QtLogging>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <fftconv/aligned_vector.hpp>
+#include <filesystem>
+#include <fmt/format.h>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <oneapi/tbb/blocked_range.h>
+#include <oneapi/tbb/info.h>
+#include <oneapi/tbb/parallel_for.h>
+#include <oneapi/tbb/partitioner.h>
+#include <oneapi/tbb/task_arena.h>
+#include <opencv2/core.hpp>
+#include <opencv2/imgcodecs.hpp>
+#include <optional>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/*
+Image export off the recon thread.
+
+Encoding a TIFF or PNG takes longer than reconstructing the frame, so
+`ImageWriterPool` queues the images and encodes them on its own threads. The
+queue is bounded: when the writers fall behind, `submit` blocks the producer
+(playback, sequence export) or drops the image (live), and both are counted
+in `ImageWriterPool::Stats` so the backpressure shows up in the stats
+overlay instead of as an unexplained frame rate drop.
+*/
+namespace OCT {
+
+// cv::imwrite params for `settings`' encoder
+inline std::vector<int> imwriteParams(const ExportSettings &settings) {
+  if (settings.format == ExportFormat::PNG) {
+    return {cv::IMWRITE_PNG_COMPRESSION, std::clamp(settings.pngLevel, 0, 9)};
+  }
+  // libtiff's COMPRESSION_NONE and COMPRESSION_LZW
+  constexpr int None = 1;
+  constexpr int LZW = 5;
+  return {cv::IMWRITE_TIFF_COMPRESSION,
+          settings.tiffCompression == TiffCompression::LZW ? LZW : None};
+}
+
+class ImageWriterPool {
+public:
+  static constexpr size_t DefaultCapacity = 64;
+
+  struct Stats {
+    size_t queued{};
+    size_t capacity{};
+    size_t written{};
+    size_t failed{};
+    // Images dropped because the queue was full (non-blocking submits)
+    size_t dropped{};
+    // Submits that waited for room, and for how long in total
+    size_t blocked{};
+    double blockedMs{};
+  };
+
+  // Writers default to half the cores, the other half reconstructs
+  static size_t defaultThreads() {
+    return std::max<size_t>(2, std::thread::hardware_concurrency() / 2);
+  }
+
+  explicit ImageWriterPool(size_t threads = defaultThreads(),
+                           size_t capacity = DefaultCapacity)
+      : m_capacity(std::max<size_t>(capacity, 1)) {
+    for (size_t i = 0; i < std::max<size_t>(threads, 1); ++i) {
+      m_threads.emplace_back([this, i]() { run(i); });
+    }
+  }
+  ImageWriterPool(const ImageWriterPool &) = delete;
+  ImageWriterPool &operator=(const ImageWriterPool &) = delete;
+  ImageWriterPool(ImageWriterPool &&) = delete;
+  ImageWriterPool &operator=(ImageWriterPool &&) = delete;
+
+  // Writes what's queued, then joins the writers
+  ~ImageWriterPool() {
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_stop = true;
+    }
+    m_notEmpty.notify_all();
+    for (auto &thread : m_threads) {
+      thread.join();
+    }
+  }
+
+  /*
+  Queue `image` to be written to `path` with `settings`' encoder. `image` is
+  written as is, so it must not be reused by the caller (pass a clone of a
+  reused buffer). If the queue is full, waits for room if `block`, else
+  drops the image and returns false.
+  */
+  bool submit(fs::path path, cv::Mat image, const ExportSettings &settings,
+              bool block = true) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (m_queue.size() >= m_capacity) {
+      if (!block) {
+        ++m_stats.dropped;
+        return false;
+      }
+      const auto start = std::chrono::steady_clock::now();
+      m_notFull.wait(lock, [this] { return m_queue.size() < m_capacity; });
+      ++m_stats.blocked;
+      m_stats.blockedMs += std::chrono::duration<double, std::milli>(
+                               std::chrono::steady_clock::now() - start)
+                               .count();
+    }
+    m_queue.push_back({std::move(path), std::move(image),
+                       imwriteParams(settings)});
+    lock.unlock();
+    m_notEmpty.notify_one();
+    return true;
+  }
+
+  // Wait until every queued image is written
+  void waitIdle() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_idle.wait(lock, [this] { return m_queue.empty() && m_busy == 0; });
+  }
+
+  [[nodiscard]] Stats stats() const {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    auto stats = m_stats;
+    stats.queued = m_queue.size() + m_busy;
+    stats.capacity = m_capacity;
+    return stats;
+  }
+
+private:
+  struct Job {
+    fs::path path;
+    cv::Mat image;
+    std::vector<int> params;
+  };
+
+  size_t m_capacity;
+  mutable std::mutex m_mutex;
+  std::condition_variable m_notEmpty;
+  std::condition_variable m_notFull;
+  std::condition_variable m_idle;
+  std::deque<Job> m_queue;
+  size_t m_busy{}; // Jobs being written
+  bool m_stop{false};
+  Stats m_stats;
+  std::vector<std::thread> m_threads;
+
+  void run(size_t i) {
+    trace::setThreadName(fmt::format("Image writer {}", i));
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true) {
+      m_notEmpty.wait(lock, [this] { return m_stop || !m_queue.empty(); });
+      if (m_queue.empty()) {
+        return; // Stopped and drained
+      }
+      auto job = std::move(m_queue.front());
+      m_queue.pop_front();
+      ++m_busy;
+      lock.unlock();
+      m_notFull.notify_one();
+
+      bool ok = false;
+      try {
+        ok = cv::imwrite(job.path.string(), job.image, job.params);
+      } catch (const cv::Exception &e) {
+        qWarning() << "Failed to write" << job.path.string().c_str() << ":"
+                   << e.what();
+      }
+
+      lock.lock();
+      --m_busy;
+      ++(ok ? m_stats.written : m_stats.failed);
+      if (m_queue.empty() && m_busy == 0) {
+        m_idle.notify_all();
+      }
+    }
+  }
+};
+
+/**
+Export the rect and radial images of every frame of `reader` through
+`writer`, in parallel over chunks of consecutive frames. Frames already in
+`volume` (may be nullptr) are taken from it, the rest are reconstructed.
+`progress` is called with the number of frames done, from the recon
+threads. Returns an error message on failure, or if `cancel` was set.
+
+Like playback, `params.additionalOffset` rotates the first frame only and
+every later frame is aligned to the one before it. Within a chunk that's
+the previous frame; a chunk's first frame aligns to its predecessor from
+`volume` if it has it, else to frame 0, so chunk boundaries can differ
+slightly from playback.
+ */
+template <Floating T>
+[[nodiscard]] std::optional<std::string>
+exportSequence(const DatFileReader &reader, const Calibration<T> &calib,
+               const OCTReconParams<T> &params, const VolumeStore *volume,
+               const ExportSettings &settings, ImageWriterPool &writer,
+               const std::atomic<bool> &cancel,
+               const std::function<void(size_t)> &progress = {}) {
+  const auto ALineSize = reader.ALineSize();
+  const auto n = reader.size();
+  if (calib.ALineSize() != ALineSize) {
+    return "Calibration doesn't match the sequence's A-line size.";
+  }
+  if (n == 0) {
+    return std::nullopt;
+  }
+  std::error_code ec;
+  fs::create_directories(settings.exportDir, ec);
+  if (ec) {
+    return fmt::format("Failed to create {}: {}", settings.exportDir.string(),
+                       ec.message());
+  }
+
+  // Working state of one chunk
+  struct Local {
+    ReconBuffers<T> buf;
+    fftconv::AlignedVector<uint16_t> fringe;
+    cv::Mat_<uint8_t> rect;
+    cv::Mat_<uint8_t> radial;
+  };
+  std::atomic<size_t> done{0};
+
+  // Export frame `i` aligned to the frame in `local.buf.prevBscan`
+  const auto exportFrame = [&](Local &local, size_t i,
+                               const OCTReconParams<T> &frameParams)
+      -> std::optional<std::string> {
+    if (volume != nullptr && volume->has(i)) {
+      volume->frame(i).copyTo(local.rect);
+      local.rect.convertTo(local.buf.prevBscan, cv::DataType<T>::type);
+    } else {
+      local.fringe.resize(reader.samplesPerFrame());
+      if (auto err = reader.read(i, 1, local.fringe)) {
+        return err;
+      }
+      reconBscan_splitSpectrum(calib, local.fringe, ALineSize, frameParams,
+                               local.buf, local.rect);
+    }
+    makeRadialImage(local.rect, local.radial, params.padTop, local.buf.radial);
+
+    // The writers own what they're given, the locals are reused
+    writer.submit(settings.path("rect", i), local.rect.clone(), settings);
+    writer.submit(settings.path("radial", i), local.radial.clone(), settings);
+    if (progress) {
+      progress(++done);
+    }
+    return std::nullopt;
+  };
+
+  // Frame 0 takes the rotation and is the fallback alignment reference
+  cv::Mat_<uint8_t> reference;
+  {
+    Local local;
+    if (auto err = exportFrame(local, 0, params)) {
+      return err;
+    }
+    reference = local.rect.clone();
+  }
+  auto chained = params;
+  chained.additionalOffset = 0;
+
+  std::atomic<bool> failed{false};
+  std::string error;
+  const auto grain = std::max<size_t>(
+      8, n / (4 * static_cast<size_t>(tbb::info::default_concurrency())));
+  tbb::parallel_for(
+      tbb::blocked_range<size_t>(1, n, grain),
+      [&](const tbb::blocked_range<size_t> &chunk) {
+        // The recon's nested parallel loops must not steal another chunk onto
+        // this thread while it's in the middle of this one
+        tbb::this_task_arena::isolate([&] {
+          Local local;
+          const auto prev = chunk.begin() - 1;
+          const auto ref = volume != nullptr && volume->has(prev)
+                               ? volume->frame(prev)
+                               : reference;
+          ref.convertTo(local.buf.prevBscan, cv::DataType<T>::type);
+
+          for (auto i = chunk.begin(); i != chunk.end(); ++i) {
+            if (cancel || failed) {
+              return;
+            }
+            if (auto err = exportFrame(local, i, chained)) {
+              if (!failed.exchange(true)) {
+                error = *err;
+              }
+              return;
+            }
+          }
+        });
+      },
+      tbb::simple_partitioner{});
+
+  if (failed) {
+    return error;
+  }
+  if (cancel) {
+    return "Cancelled";
+  }
+  return std::nullopt;
+}
+
+} // namespace OCT
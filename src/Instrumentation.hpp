@@ -0,0 +1,396 @@
+#pragma once
+
+#include "Trace.hpp"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fmt/format.h>
+#include <fstream>
+#include <opencv2/core.hpp>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace OCT::perf {
+
+namespace fs = std::filesystem;
+
+// Pipeline stages with a latency histogram
+enum class Stage : uint8_t {
+  ReadFringe = 0, // Read fringe from disk into the ring buffer
+  DAQCopy,        // Copy DMA buffer into the ring buffer
+  DAQWrite,       // Write DMA buffer to the bin file
+  ReconALines,    // Background, k-linearization, FFT, log compression
+  Distortion,     // Distortion correction
+  Align,          // Align Bscan to the previous frame
+  Rerender,       // Re-apply display params to the last frame, no recon
+  Preview,        // Decimated recon while scrubbing, see `reconPreview`
+  Radial,         // Polar to cartesian
+  LMode,          // Add a frame to the L-mode, see `LModeBuilder`
+  Volume,         // Write a frame to the volume store, see `VolumeStore`
+  Export,         // Write images to disk
+  Combine,        // Make combined image
+  Pixmap,         // cv::Mat to QPixmap
+  Display,        // ImageDisplay::imshow on the GUI thread
+  Total,          // ReconWorker, fringe to display
+  Latency,        // Fringe acquired (DMA complete or read) to painted
+  Count
+};
+
+constexpr size_t StageCount = static_cast<size_t>(Stage::Count);
+
+constexpr std::array<const char *, StageCount> StageNames{
+    "Read fringe", "DAQ copy", "DAQ write", "Recon A-lines", "Distortion",
+    "Align",       "Rerender", "Preview",   "Radial",        "L-mode",
+    "Volume",      "Export",   "Combine",   "Pixmap",        "Display",
+    "Total",       "Acq to paint"};
+
+/**
+Lock-free log-linear latency histogram.
+
+Values (nanoseconds) are binned into 16 linear sub-buckets per power of two
+(~6% resolution). `record` is wait-free apart from the max update and can be
+called from any thread. Reads are approximate while writers are active.
+ */
+class LatencyHistogram {
+public:
+  static constexpr int SubBits = 4;
+  static constexpr size_t SubBuckets = size_t{1} << SubBits;
+  static constexpr size_t NumBuckets = 64 * SubBuckets;
+
+  void record(uint64_t ns) noexcept {
+    m_buckets[bucketIndex(ns)].fetch_add(1, std::memory_order_relaxed);
+    m_count.fetch_add(1, std::memory_order_relaxed);
+    m_sum.fetch_add(ns, std::memory_order_relaxed);
+
+    auto prevMax = m_max.load(std::memory_order_relaxed);
+    while (ns > prevMax && !m_max.compare_exchange_weak(
+                               prevMax, ns, std::memory_order_relaxed)) {
+    }
+  }
+
+  [[nodiscard]] uint64_t count() const noexcept {
+    return m_count.load(std::memory_order_relaxed);
+  }
+
+  [[nodiscard]] double meanMs() const noexcept {
+    const auto n = count();
+    if (n == 0) {
+      return 0.0;
+    }
+    const auto sum = m_sum.load(std::memory_order_relaxed);
+    // NOLINTNEXTLINE(*-magic-numbers)
+    return static_cast<double>(sum) / static_cast<double>(n) * 1e-6;
+  }
+
+  [[nodiscard]] double maxMs() const noexcept {
+    // NOLINTNEXTLINE(*-magic-numbers)
+    return static_cast<double>(m_max.load(std::memory_order_relaxed)) * 1e-6;
+  }
+
+  // p in [0, 1]
+  [[nodiscard]] double percentileMs(double p) const noexcept {
+    std::array<uint64_t, NumBuckets> counts{};
+    uint64_t total{};
+    for (size_t i = 0; i < NumBuckets; ++i) {
+      counts[i] = m_buckets[i].load(std::memory_order_relaxed);
+      total += counts[i];
+    }
+    if (total == 0) {
+      return 0.0;
+    }
+
+    const auto target = std::max<uint64_t>(
+        1, static_cast<uint64_t>(std::ceil(p * static_cast<double>(total))));
+    uint64_t cumulative{};
+    for (size_t i = 0; i < NumBuckets; ++i) {
+      cumulative += counts[i];
+      if (cumulative >= target) {
+        // NOLINTNEXTLINE(*-magic-numbers)
+        return static_cast<double>(bucketMidpoint(i)) * 1e-6;
+      }
+    }
+    return maxMs();
+  }
+
+  void reset() noexcept {
+    for (auto &b : m_buckets) {
+      b.store(0, std::memory_order_relaxed);
+    }
+    m_count.store(0, std::memory_order_relaxed);
+    m_sum.store(0, std::memory_order_relaxed);
+    m_max.store(0, std::memory_order_relaxed);
+  }
+
+private:
+  std::array<std::atomic<uint64_t>, NumBuckets> m_buckets{};
+  std::atomic<uint64_t> m_count{};
+  std::atomic<uint64_t> m_sum{};
+  std::atomic<uint64_t> m_max{};
+
+  static size_t bucketIndex(uint64_t ns) noexcept {
+    if (ns < SubBuckets) {
+      return static_cast<size_t>(ns);
+    }
+    const auto msb = static_cast<size_t>(std::bit_width(ns)) - 1;
+    const auto shift = msb - SubBits;
+    const auto sub = static_cast<size_t>(ns >> shift) & (SubBuckets - 1);
+    return std::min((shift + 1) * SubBuckets + sub, NumBuckets - 1);
+  }
+
+  static uint64_t bucketMidpoint(size_t idx) noexcept {
+    if (idx < SubBuckets) {
+      return idx;
+    }
+    const auto shift = idx / SubBuckets - 1;
+    const auto sub = idx % SubBuckets;
+    const auto lower = static_cast<uint64_t>(SubBuckets + sub) << shift;
+    return lower + ((uint64_t{1} << shift) >> 1);
+  }
+};
+
+/**
+Hit and miss counts of a cache, safe to update and read from any thread.
+ */
+class CacheCounter {
+public:
+  void hit() noexcept { m_hits.fetch_add(1, std::memory_order_relaxed); }
+  void miss() noexcept { m_misses.fetch_add(1, std::memory_order_relaxed); }
+
+  [[nodiscard]] uint64_t hits() const noexcept {
+    return m_hits.load(std::memory_order_relaxed);
+  }
+  [[nodiscard]] uint64_t misses() const noexcept {
+    return m_misses.load(std::memory_order_relaxed);
+  }
+
+  // e.g. "12 hit / 3 miss (80%)"
+  [[nodiscard]] std::string format() const {
+    const auto h = hits();
+    const auto total = h + misses();
+    const double pct =
+        total == 0
+            ? 0.0
+            : 100.0 * static_cast<double>(h) / static_cast<double>(total);
+    return fmt::format("{} hit / {} miss ({:.0f}%)", h, total - h, pct);
+  }
+
+  void reset() noexcept {
+    m_hits.store(0, std::memory_order_relaxed);
+    m_misses.store(0, std::memory_order_relaxed);
+  }
+
+private:
+  std::atomic<uint64_t> m_hits{};
+  std::atomic<uint64_t> m_misses{};
+};
+
+/**
+Process wide latency histograms, one per `Stage`.
+ */
+class Registry {
+public:
+  static Registry &get() {
+    static Registry registry;
+    return registry;
+  }
+
+  void record(Stage stage, uint64_t ns) noexcept {
+    m_stages[static_cast<size_t>(stage)].record(ns);
+  }
+
+  [[nodiscard]] const LatencyHistogram &stage(Stage stage) const {
+    return m_stages[static_cast<size_t>(stage)];
+  }
+
+  void reset() noexcept {
+    for (auto &h : m_stages) {
+      h.reset();
+    }
+  }
+
+  // Extra key/value rows appended to the summary and CSV (e.g. ring buffer
+  // counters that are owned elsewhere).
+  using ExtraRows = std::vector<std::pair<std::string, std::string>>;
+
+  // Multi-line text summary for the image overlay. Stages that were never hit
+  // are skipped.
+  [[nodiscard]] std::string summary(const ExtraRows &extra = {}) const {
+    std::string out = fmt::format("{:<14}{:>8}{:>8}{:>8}{:>8}\n", "ms", "p50",
+                                  "p95", "p99", "max");
+    for (size_t i = 0; i < StageCount; ++i) {
+      const auto &h = m_stages[i];
+      if (h.count() == 0) {
+        continue;
+      }
+      // NOLINTBEGIN(*-magic-numbers)
+      out += fmt::format("{:<14}{:>8.2f}{:>8.2f}{:>8.2f}{:>8.2f}\n",
+                         StageNames[i], h.percentileMs(0.50),
+                         h.percentileMs(0.95), h.percentileMs(0.99),
+                         h.maxMs());
+      // NOLINTEND(*-magic-numbers)
+    }
+    for (const auto &[key, val] : extra) {
+      out += fmt::format("{:<14}{:>32}\n", key, val);
+    }
+    if (!out.empty()) {
+      out.pop_back();
+    }
+    return out;
+  }
+
+  // Dump all stages to CSV. Returns false if the file couldn't be written.
+  bool writeCSV(const fs::path &path, const ExtraRows &extra = {}) const {
+    std::ofstream ofs(path);
+    if (!ofs.is_open()) {
+      return false;
+    }
+
+    ofs << "stage,count,mean_ms,p50_ms,p95_ms,p99_ms,max_ms\n";
+    for (size_t i = 0; i < StageCount; ++i) {
+      const auto &h = m_stages[i];
+      // NOLINTBEGIN(*-magic-numbers)
+      ofs << fmt::format("{},{},{:.4f},{:.4f},{:.4f},{:.4f},{:.4f}\n",
+                         StageNames[i], h.count(), h.meanMs(),
+                         h.percentileMs(0.50), h.percentileMs(0.95),
+                         h.percentileMs(0.99), h.maxMs());
+      // NOLINTEND(*-magic-numbers)
+    }
+
+    if (!extra.empty()) {
+      ofs << "\ncounter,value\n";
+      for (const auto &[key, val] : extra) {
+        ofs << key << ',' << val << '\n';
+      }
+    }
+    return !ofs.fail();
+  }
+
+  /*
+  Append one row with the percentiles of `stage` to a CSV log (e.g. one row per
+  acquisition session), writing the header if the file is new.
+  */
+  bool appendSessionLog(const fs::path &path, Stage stage,
+                        const std::string &session) const {
+    const bool exists = fs::exists(path);
+    std::ofstream ofs(path, std::ios::app);
+    if (!ofs.is_open()) {
+      return false;
+    }
+    if (!exists) {
+      ofs << "session,stage,count,mean_ms,p50_ms,p95_ms,p99_ms,max_ms\n";
+    }
+    const auto &h = this->stage(stage);
+    // NOLINTBEGIN(*-magic-numbers)
+    ofs << fmt::format("{},{},{},{:.4f},{:.4f},{:.4f},{:.4f},{:.4f}\n",
+                       session, StageNames[static_cast<size_t>(stage)],
+                       h.count(), h.meanMs(), h.percentileMs(0.50),
+                       h.percentileMs(0.95), h.percentileMs(0.99), h.maxMs());
+    // NOLINTEND(*-magic-numbers)
+    return !ofs.fail();
+  }
+
+  void reset(Stage stage) noexcept {
+    m_stages[static_cast<size_t>(stage)].reset();
+  }
+
+private:
+  Registry() = default;
+  std::array<LatencyHistogram, StageCount> m_stages{};
+};
+
+/**
+RAII probe that records the lifetime of a scope into the stage histogram, and
+into the timeline trace when tracing is enabled.
+Like `TimeIt`, the elapsed time is also available with `get_ms()`.
+Example:
+{
+  perf::ScopedProbe probe(perf::Stage::Radial);
+  makeRadialImage(...);
+}
+ */
+class ScopedProbe {
+public:
+  using clock = trace::Clock;
+
+  explicit ScopedProbe(Stage stage) noexcept
+      : m_stage(stage), m_start(clock::now()) {}
+
+  ScopedProbe(const ScopedProbe &) = delete;
+  ScopedProbe(ScopedProbe &&) = delete;
+  ScopedProbe &operator=(const ScopedProbe &) = delete;
+  ScopedProbe &operator=(ScopedProbe &&) = delete;
+
+  ~ScopedProbe() {
+    const auto end = clock::now();
+    Registry::get().record(
+        m_stage, std::chrono::duration_cast<std::chrono::nanoseconds>(
+                     end - m_start)
+                     .count());
+    trace::complete(StageNames[static_cast<size_t>(m_stage)], m_start, end);
+  }
+
+  [[nodiscard]] float get_ms() const {
+    using namespace std::chrono; // NOLINT(*-namespace)
+    const auto elapsed = clock::now() - m_start;
+    const auto nano = duration_cast<nanoseconds>(elapsed).count();
+    constexpr float fct_nano2mili = 1.0e-6;
+    return static_cast<float>(nano) * fct_nano2mili;
+  }
+
+private:
+  Stage m_stage;
+  clock::time_point m_start;
+};
+
+/**
+cv::MatAllocator that counts cv::Mat buffer allocations, to check that the
+recon pipeline reaches a steady state without allocating image buffers per
+frame. Delegates to OpenCV's standard allocator. Scratch memory that OpenCV
+functions allocate internally without a cv::Mat isn't counted.
+ */
+class MatAllocCounter : public cv::MatAllocator {
+public:
+  static MatAllocCounter &get() {
+    static MatAllocCounter counter;
+    return counter;
+  }
+
+  // Make this the default allocator for all new cv::Mat buffers
+  static void install() { cv::Mat::setDefaultAllocator(&get()); }
+
+  [[nodiscard]] uint64_t count() const noexcept {
+    return m_count.load(std::memory_order_relaxed);
+  }
+
+  cv::UMatData *allocate(int dims, const int *sizes, int type, void *data,
+                         size_t *step, cv::AccessFlag flags,
+                         cv::UMatUsageFlags usageFlags) const override {
+    if (data == nullptr) {
+      m_count.fetch_add(1, std::memory_order_relaxed);
+    }
+    return m_std->allocate(dims, sizes, type, data, step, flags, usageFlags);
+  }
+
+  bool allocate(cv::UMatData *data, cv::AccessFlag accessFlags,
+                cv::UMatUsageFlags usageFlags) const override {
+    return m_std->allocate(data, accessFlags, usageFlags);
+  }
+
+  void deallocate(cv::UMatData *data) const override {
+    m_std->deallocate(data);
+  }
+
+private:
+  MatAllocCounter() = default;
+  cv::MatAllocator *m_std{cv::Mat::getStdAllocator()};
+  mutable std::atomic<uint64_t> m_count{};
+};
+
+} // namespace OCT::perf
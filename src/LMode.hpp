@@ -0,0 +1,150 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <opencv2/core.hpp>
+#include <vector>
+
+namespace OCT {
+
+/**
+Longitudinal (L-mode) cut through a pullback: the A-line at the cut angle
+and the opposite one from every frame, stacked along the pullback axis.
+
+The image is (2 * depth) x frames. Column i is frame i, with the opposite
+A-line flipped in the top half (deepest at the top) and the A-line at the
+angle in the bottom half, so the catheter is in the middle row.
+
+`addFrame` writes one column, O(depth). It also keeps the frame's rect
+image decimated to `angles` A-lines, stored one A-line per row, so
+`setAngle` re-samples every frame with two contiguous copies per frame
+instead of reconstructing them again. Frames may arrive in any order, and
+the image grows as needed for live pullbacks.
+ */
+class LModeBuilder {
+public:
+  static constexpr size_t DefaultAngles = 360;
+
+  // Drop all frames and expect `nFrames` (0 if unknown, e.g. live)
+  void reset(size_t nFrames = 0, size_t angles = DefaultAngles) {
+    m_angles = std::max<size_t>(angles, 2);
+    m_angle %= m_angles;
+    m_depth = 0;
+    m_frames = 0;
+    m_expected = nFrames;
+    m_capacity = nFrames;
+    m_have.assign(nFrames, false);
+    m_store.clear();
+    m_image.release();
+  }
+
+  // Cut angle in degrees, in the same angular reference as the rect image's
+  // columns (A-line 0 is 0 degrees)
+  void setAngle(double degrees) {
+    degrees -= 360.0 * std::floor(degrees / 360.0);
+    m_angle = static_cast<size_t>(std::lround(
+                  degrees / 360.0 * static_cast<double>(m_angles))) %
+              m_angles;
+    for (size_t i = 0; i < m_frames; ++i) {
+      if (m_have[i]) {
+        writeColumn(i);
+      }
+    }
+  }
+  [[nodiscard]] double angle() const {
+    return 360.0 * static_cast<double>(m_angle) /
+           static_cast<double>(m_angles);
+  }
+
+  // Add or replace frame `i` from its rect image (depth x A-lines)
+  void addFrame(size_t i, const cv::Mat_<uint8_t> &rect) {
+    if (rect.empty()) {
+      return;
+    }
+    const auto depth = static_cast<size_t>(rect.rows);
+    if (depth != m_depth) {
+      // New geometry, earlier frames don't fit
+      reset(m_expected, m_angles);
+      m_depth = depth;
+    }
+    grow(i + 1);
+
+    // Decimate to `m_angles` A-lines, one per row
+    uint8_t *dst = frameStore(i);
+    const auto nLines = static_cast<size_t>(rect.cols);
+    for (size_t a = 0; a < m_angles; ++a) {
+      const auto col = static_cast<int>(a * nLines / m_angles);
+      uint8_t *line = dst + a * m_depth;
+      for (size_t d = 0; d < m_depth; ++d) {
+        line[d] = rect(static_cast<int>(d), col);
+      }
+    }
+    m_have[i] = true;
+    m_frames = std::max(m_frames, i + 1);
+    writeColumn(i);
+  }
+
+  // (2 * depth) x frames (at least the expected frames), empty before the
+  // first frame. A view, valid until the next `addFrame` or `reset`.
+  [[nodiscard]] cv::Mat_<uint8_t> image() const {
+    if (m_image.empty()) {
+      return {};
+    }
+    const auto cols = std::max(m_frames, m_expected);
+    return m_image(cv::Rect(0, 0, static_cast<int>(cols), m_image.rows));
+  }
+  [[nodiscard]] size_t frames() const { return m_frames; }
+
+private:
+  size_t m_angles{DefaultAngles};
+  size_t m_angle{};
+  size_t m_depth{};
+  size_t m_frames{};   // 1 + highest frame index added
+  size_t m_expected{}; // Frames in the sequence, 0 if unknown
+  size_t m_capacity{}; // Frames allocated in the store and image
+  std::vector<bool> m_have;
+  std::vector<uint8_t> m_store; // [frame][angle][depth]
+  cv::Mat_<uint8_t> m_image;
+
+  uint8_t *frameStore(size_t i) {
+    return m_store.data() + i * m_angles * m_depth;
+  }
+
+  // Make room for `n` frames, doubling for live pullbacks
+  void grow(size_t n) {
+    if (n <= m_capacity && !m_image.empty()) {
+      return;
+    }
+    const auto capacity = m_image.empty()
+                              ? std::max(n, m_capacity)
+                              : std::max(n, 2 * m_capacity);
+    m_store.resize(capacity * m_angles * m_depth);
+    m_have.resize(capacity, false);
+
+    cv::Mat_<uint8_t> image(static_cast<int>(2 * m_depth),
+                            static_cast<int>(capacity), uint8_t{0});
+    if (!m_image.empty()) {
+      m_image.copyTo(image(cv::Rect(0, 0, m_image.cols, m_image.rows)));
+    }
+    m_image = image;
+    m_capacity = capacity;
+  }
+
+  void writeColumn(size_t i) {
+    const uint8_t *store = frameStore(i);
+    const uint8_t *line = store + m_angle * m_depth;
+    const uint8_t *opposite =
+        store + ((m_angle + m_angles / 2) % m_angles) * m_depth;
+    const auto col = static_cast<int>(i);
+    for (size_t d = 0; d < m_depth; ++d) {
+      m_image(static_cast<int>(m_depth - 1 - d), col) = opposite[d];
+      m_image(static_cast<int>(m_depth + d), col) = line[d];
+    }
+  }
+};
+
+} // namespace OCT
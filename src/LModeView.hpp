@@ -0,0 +1,130 @@
+#pragma once
+
+#include "ImageDisplay.hpp"
+#include "LMode.hpp"
+#include <QHBoxLayout>
+#include <QImage>
+#include <QLabel>
+#include <QPixmap>
+#include <QSlider>
+#include <QString>
+#include <QTimer>
+#include <QVBoxLayout>
+#include <QWidget>
+#include <Qt>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <opencv2/core.hpp>
+
+namespace OCT {
+
+/**
+L-mode (longitudinal) view of the loaded sequence or live pullback, see
+`LModeBuilder`.
+
+`addFrame` may be called from any thread (the recon worker and pre-recon
+thread) and only updates the builder. The display is refreshed on the GUI
+thread at most every `RefreshMs`, so a fast pullback doesn't flood it.
+ */
+class LModeView : public QWidget {
+  Q_OBJECT
+public:
+  static constexpr int RefreshMs = 100;
+
+  LModeView()
+      : m_display(new ImageDisplay), m_angleSlider(new QSlider),
+        m_angleLabel(new QLabel), m_refreshTimer(new QTimer(this)) {
+    m_angleSlider->setOrientation(Qt::Horizontal);
+    m_angleSlider->setMinimum(0);
+    m_angleSlider->setMaximum(359);
+    m_angleSlider->setToolTip("Cut angle of the L-mode");
+    m_angleLabel->setText(angleText(0));
+
+    // GUI
+    // ---
+    auto *layout = new QVBoxLayout;
+    setLayout(layout);
+    layout->addWidget(m_display);
+    {
+      auto *hlayout = new QHBoxLayout;
+      layout->addLayout(hlayout);
+      hlayout->addWidget(new QLabel("Angle"));
+      hlayout->addWidget(m_angleSlider);
+      hlayout->addWidget(m_angleLabel);
+    }
+
+    // Bind
+    connect(m_angleSlider, &QSlider::valueChanged, this, &LModeView::setAngle);
+    m_refreshTimer->setInterval(RefreshMs);
+    connect(m_refreshTimer, &QTimer::timeout, this, &LModeView::refresh);
+    m_refreshTimer->start();
+  }
+
+  // Add or replace frame `i` from its rect image. Thread safe.
+  void addFrame(size_t i, const cv::Mat_<uint8_t> &rect) {
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_builder.addFrame(i, rect);
+    }
+    m_dirty = true;
+  }
+
+public Q_SLOTS:
+  // Clear for a new sequence of `nFrames` (0 if unknown, e.g. live)
+  void reset(size_t nFrames) {
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_builder.reset(nFrames);
+      m_builder.setAngle(m_angleSlider->value());
+    }
+    m_dirty = true;
+  }
+
+  // Cut angle in degrees. Re-samples the stored frames, no recon.
+  void setAngle(int degrees) {
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_builder.setAngle(degrees);
+    }
+    m_angleLabel->setText(angleText(degrees));
+    m_dirty = true;
+  }
+
+private:
+  ImageDisplay *m_display;
+  QSlider *m_angleSlider;
+  QLabel *m_angleLabel;
+  QTimer *m_refreshTimer;
+
+  std::mutex m_mutex;
+  LModeBuilder m_builder;
+  std::atomic<bool> m_dirty{false};
+
+  static QString angleText(int degrees) {
+    return QString("%1°").arg(degrees, 3);
+  }
+
+  void refresh() {
+    // Stays dirty while hidden
+    if (!isVisible() || !m_dirty.exchange(false)) {
+      return;
+    }
+
+    QImage img;
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      const auto mat = m_builder.image();
+      if (!mat.empty()) {
+        img = QImage(mat.data, mat.cols, mat.rows,
+                     static_cast<qsizetype>(mat.step),
+                     QImage::Format_Grayscale8)
+                  .copy();
+      }
+    }
+    m_display->imshow(QPixmap::fromImage(img));
+  }
+};
+
+} // namespace OCT
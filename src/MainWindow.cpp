@@ -1,35 +1,48 @@
 #include "MainWindow.hpp"
 #include "AcquisitionController.hpp"
+#include "Benchmark.hpp"
 #include "DAQ.hpp"
 #include "ExportSettings.hpp"
 #include "FileIO.hpp"
 #include "FrameController.hpp"
 #include "ImageDisplay.hpp"
+#include "Instrumentation.hpp"
 #include "MotorDriver.hpp"
 #include "OCTRecon.hpp"
 #include "OCTReconParamsController.hpp"
 #include "ReconWorker.hpp"
+#include "SIMDKernels.hpp"
+#include "SyntheticFringe.hpp"
+#include "Trace.hpp"
 #include "datetime.hpp"
 #include "strOps.hpp"
 #include "timeit.hpp"
+#include <QActionGroup>
 #include <QDockWidget>
 #include <QFileDialog>
 #include <QFileInfo>
+#include <QHBoxLayout>
 #include <QLabel>
 #include <QMenuBar>
 #include <QMessageBox>
 #include <QMimeData>
+#include <QSpinBox>
 #include <QStackedLayout>
 #include <QStandardPaths>
 #include <QStatusBar>
+#include <QThreadPool>
 #include <QVBoxLayout>
+#include <QWidgetAction>
 #include <Qt>
 #include <algorithm>
 #include <fftconv/aligned_vector.hpp>
 #include <filesystem>
 #include <fmt/format.h>
 #include <fmt/std.h>
+#include <fstream>
 #include <opencv2/opencv.hpp>
+#include <system_error>
+#include <vector>
 
 namespace OCT {
 
@@ -38,12 +51,40 @@ MainWindow::MainWindow()
       m_menuView(menuBar()->addMenu("&View")), m_imageDisplay(new ImageDisplay),
       m_frameController(new FrameController),
       m_reconParamsController(new OCTReconParamsController),
-      m_motorDriver(new MotorDriver),
+      m_motorDriver(new MotorDriver), m_lmodeView(new LModeView),
+      m_produceRetryTimer(new QTimer(this)),
       m_ringBuffer(std::make_shared<RingBuffer<OCTData<Float>>>()),
-      m_worker(new ReconWorker(m_ringBuffer, DatFileReader::ALineSize,
+      m_liveRing(std::make_shared<BroadcastRing<OCTData<Float>>>(
+          LiveRingCapacity)),
+      m_worker(new ReconWorker(m_ringBuffer, DatFileReader::DefaultALineSize,
                                m_imageDisplay)),
-
-      m_exportSettingsWidget(new ExportSettingsWidget) {
+      m_frameCache(std::make_shared<FrameCache>(FrameCacheBudget)),
+      m_prerenderer(new Prerenderer(
+          m_frameCache,
+          [view = m_lmodeView](size_t i, const cv::Mat_<uint8_t> &rect) {
+            view->addFrame(i, rect);
+          })),
+
+      m_volumeView(new VolumeRenderView),
+      m_exportSettingsWidget(new ExportSettingsWidget),
+      m_actOptimizeFFT(new QAction("Optimize FFT plans")),
+      m_statsTimer(new QTimer(this)) {
+
+  trace::setThreadName("GUI");
+  m_produceRetryTimer->setSingleShot(true);
+  m_produceRetryTimer->setInterval(ProduceRetryMs);
+  connect(m_produceRetryTimer, &QTimer::timeout, this, [this]() {
+    if (m_pendingFrame) {
+      const auto [i, previewLineStep] = *m_pendingFrame;
+      produceFrame(i, previewLineStep);
+    }
+  });
+  m_worker->setPreviewParams(m_previewParams);
+  perf::MatAllocCounter::install();
+  qInfo() << "Recon SIMD kernels:" << simd::toString(simd::kernels().isa);
+  if (const auto err = simd::checkKernels(simd::kernels().isa)) {
+    qWarning() << "Recon SIMD kernels differ from scalar:" << err->c_str();
+  }
 
   // Configure MainWindow
   // --------------------
@@ -76,6 +117,8 @@ MainWindow::MainWindow()
 
     connect(m_frameController, &FrameController::posChanged, this,
             &MainWindow::loadFrame);
+    connect(m_frameController, &FrameController::posPreview, this,
+            &MainWindow::previewFrame);
 
     menuBar()->addMenu(m_frameController->menu());
   }
@@ -90,6 +133,9 @@ MainWindow::MainWindow()
     dock->toggleViewAction();
 
     dock->setWidget(m_reconParamsController);
+
+    connect(m_reconParamsController, &OCTReconParamsController::paramsChanged,
+            this, &MainWindow::reconParamsChanged);
   }
 
   // Export settings
@@ -101,6 +147,35 @@ MainWindow::MainWindow()
     dock->setWidget(m_exportSettingsWidget);
     dock->hide();
     menuBar()->addMenu(m_exportSettingsWidget->menu());
+
+    m_actExportSequence = new QAction("Export whole sequence");
+    m_actExportSequence->setToolTip(
+        "Save the rect and radial images of every frame, using all cores");
+    m_exportSettingsWidget->menu()->addAction(m_actExportSequence);
+    connect(m_actExportSequence, &QAction::triggered, this,
+            &MainWindow::exportWholeSequence);
+  }
+
+  // L-mode
+  {
+    auto *dock = new QDockWidget("L-mode");
+    this->addDockWidget(Qt::BottomDockWidgetArea, dock);
+    m_menuView->addAction(dock->toggleViewAction());
+    dock->toggleViewAction()->setShortcut({Qt::CTRL | Qt::SHIFT | Qt::Key_L});
+
+    dock->setWidget(m_lmodeView);
+    dock->hide();
+  }
+
+  // 3D view
+  {
+    auto *dock = new QDockWidget("3D view");
+    this->addDockWidget(Qt::RightDockWidgetArea, dock);
+    m_menuView->addAction(dock->toggleViewAction());
+    dock->toggleViewAction()->setShortcut({Qt::CTRL | Qt::SHIFT | Qt::Key_V});
+
+    dock->setWidget(m_volumeView);
+    dock->hide();
   }
 
   // Motor Driver
@@ -110,7 +185,7 @@ MainWindow::MainWindow()
   motorDock->setWidget(m_motorDriver);
 
 #ifdef OCTGUI_HAS_ALAZAR
-  m_acqController = new AcquisitionController(m_ringBuffer, m_motorDriver);
+  m_acqController = new AcquisitionController(m_liveRing, m_motorDriver);
 
   // Acquisition
   {
@@ -126,6 +201,15 @@ MainWindow::MainWindow()
             &AcquisitionControllerObj::sigAcquisitionStarted, this, [this]() {
               // Set reconWorker to live (no block) mode
               m_worker->setNoBlockMode(true);
+              stopPrerender();
+              m_lmodeView->reset(0);
+              m_worker->resetEnFace(0);
+
+              // Start a new latency session
+              perf::Registry::get().reset(perf::Stage::Latency);
+              m_live = true;
+              m_imageDisplay->overlay()->setLatencyVisible(true);
+              updateStatsTimer();
 
               // Clear overlay progress
               m_imageDisplay->overlay()->setProgress(0, 0);
@@ -136,6 +220,18 @@ MainWindow::MainWindow()
             [this](const QString &qpath) {
               // Return to blocking mode where every incoming frame is processed
               m_worker->setNoBlockMode(false);
+
+              // Log this session's latency percentiles
+              m_live = false;
+              m_imageDisplay->overlay()->setLatencyVisible(false);
+              updateStatsTimer();
+              const auto session =
+                  qpath.isEmpty() ? datetime::datetimeISO8601()
+                                  : toPath(qpath).filename().string();
+              const auto logPath =
+                  toPath(defaultDataDir) / "OCTGui latency log.csv";
+              perf::Registry::get().appendSessionLog(
+                  logPath, perf::Stage::Latency, session);
               tryLoadBinfile(qpath);
             });
 
@@ -172,6 +268,152 @@ MainWindow::MainWindow()
   // -------------
   m_menuView->addAction(m_imageDisplay->actResetZoom());
 
+  // Pipeline stats
+  {
+    constexpr int statsRefreshMs = 500;
+    m_statsTimer->setInterval(statsRefreshMs);
+    connect(m_statsTimer, &QTimer::timeout, this, [this]() {
+      auto *overlay = m_imageDisplay->overlay();
+      const auto &registry = perf::Registry::get();
+      if (overlay->statsVisible()) {
+        const auto summary = registry.summary(this->pipelineCounters());
+        overlay->setStats(QString::fromStdString(summary));
+      }
+      if (m_live) {
+        const auto &latency = registry.stage(perf::Stage::Latency);
+        // NOLINTBEGIN(*-magic-numbers)
+        overlay->setLatency(QString::fromStdString(
+            fmt::format("Latency p50 {:.1f} ms, p95 {:.1f} ms",
+                        latency.percentileMs(0.50),
+                        latency.percentileMs(0.95))));
+        // NOLINTEND(*-magic-numbers)
+      }
+    });
+
+    auto *act = new QAction("Pipeline stats");
+    act->setCheckable(true);
+    act->setShortcut({Qt::CTRL | Qt::SHIFT | Qt::Key_S});
+    m_menuView->addAction(act);
+    connect(act, &QAction::toggled, this, [this](bool checked) {
+      m_imageDisplay->overlay()->setStatsVisible(checked);
+      updateStatsTimer();
+    });
+
+    auto *actReset = new QAction("Reset pipeline stats");
+    m_menuView->addAction(actReset);
+    connect(actReset, &QAction::triggered, this,
+            []() { perf::Registry::get().reset(); });
+
+    // Timeline trace. Written to the desktop when recording stops.
+    auto *actTrace = new QAction("Record pipeline trace");
+    actTrace->setCheckable(true);
+    m_menuFile->addAction(actTrace);
+    connect(actTrace, &QAction::toggled, this, [this](bool checked) {
+      auto &tracer = trace::Tracer::get();
+      if (checked) {
+        tracer.start();
+        statusBarMessage("Recording pipeline trace");
+        return;
+      }
+
+      const auto path =
+          toPath(QStandardPaths::writableLocation(
+              QStandardPaths::DesktopLocation)) /
+          fmt::format("OCTGui trace {}.json",
+                      datetime::datetimeFormat("%Y%m%d%H%M%S"));
+      if (tracer.stop(path)) {
+        statusBarMessage(toQString(
+            fmt::format("Wrote pipeline trace to {}", path.string())));
+      } else {
+        statusBarMessage(toQString(fmt::format(
+            "Failed to write pipeline trace to {}", path.string())));
+      }
+    });
+
+    auto *actExport = new QAction("Export pipeline stats (CSV)");
+    m_menuFile->addAction(actExport);
+    connect(actExport, &QAction::triggered, this, [this]() {
+      const QString filename = QFileDialog::getSaveFileName(
+          this, "Export pipeline stats", defaultDataDir, "CSV (*.csv)");
+      if (filename.isEmpty()) {
+        return;
+      }
+      if (perf::Registry::get().writeCSV(toPath(filename),
+                                         this->pipelineCounters())) {
+        statusBarMessage("Exported pipeline stats to " + filename);
+      } else {
+        statusBarMessage("Failed to export pipeline stats to " + filename);
+      }
+    });
+  }
+
+  // Playback ring buffer overflow policy
+  {
+    auto *menu = m_menuView->addMenu("Playback buffer overflow");
+    auto *group = new QActionGroup(this);
+    const auto addPolicy = [&](const char *name, OverflowPolicy policy) {
+      auto *act = new QAction(name, group);
+      act->setCheckable(true);
+      act->setChecked(policy == m_ringBuffer->overflowPolicy());
+      menu->addAction(act);
+      connect(act, &QAction::triggered, this,
+              [this, policy]() { m_ringBuffer->setOverflowPolicy(policy); });
+    };
+    addPolicy("Drop oldest", OverflowPolicy::DropOldest);
+    addPolicy("Drop newest", OverflowPolicy::DropNewest);
+    addPolicy("Block", OverflowPolicy::Block);
+  }
+
+  // En-face map mode and depth band
+  {
+    auto *menu = m_menuView->addMenu("En-face map");
+    auto *group = new QActionGroup(this);
+    const auto addMode = [&](const char *name,
+                             std::optional<EnFaceMode> mode) {
+      auto *act = new QAction(name, group);
+      act->setCheckable(true);
+      act->setChecked(mode ? m_enFaceOn && m_enFaceParams.mode == *mode
+                           : !m_enFaceOn);
+      menu->addAction(act);
+      connect(act, &QAction::triggered, this, [this, mode]() {
+        m_enFaceOn = mode.has_value();
+        m_enFaceParams.mode = mode.value_or(m_enFaceParams.mode);
+        updateEnFace();
+      });
+    };
+    addMode("Off", std::nullopt);
+    addMode("Mean", EnFaceMode::Mean);
+    addMode("Max", EnFaceMode::Max);
+    menu->addSeparator();
+
+    // Depth band spin boxes in the menu
+    const auto addDepth = [&](const char *name, int EnFaceParams::*member,
+                              const char *special) {
+      auto *widget = new QWidget;
+      auto *layout = new QHBoxLayout;
+      widget->setLayout(layout);
+      layout->addWidget(new QLabel(name));
+      auto *spinBox = new QSpinBox;
+      constexpr int maxDepth = 1000;
+      spinBox->setRange(0, maxDepth);
+      spinBox->setSuffix("px");
+      spinBox->setSpecialValueText(special);
+      spinBox->setValue(m_enFaceParams.*member);
+      layout->addWidget(spinBox);
+      connect(spinBox, &QSpinBox::valueChanged, this,
+              [this, member](int value) {
+                m_enFaceParams.*member = value;
+                updateEnFace();
+              });
+
+      auto *act = new QWidgetAction(this);
+      act->setDefaultWidget(widget);
+      menu->addAction(act);
+    };
+    addDepth("Depth from", &EnFaceParams::depthBegin, "Top");
+    addDepth("Depth to", &EnFaceParams::depthEnd, "Bottom");
+  }
+
   {
     auto *act = new QAction("Import calibration directory");
     m_menuFile->addAction(act);
@@ -208,8 +450,100 @@ MainWindow::MainWindow()
     });
   }
 
+  {
+    auto *act = new QAction("Generate synthetic sequence");
+    m_menuFile->addAction(act);
+    act->setToolTip("Write a synthetic pullback to a temporary bin file and "
+                    "open it. Uses the loaded calibration if there is one.");
+
+    connect(act, &QAction::triggered, this, [this]() {
+      constexpr size_t nFrames = 10;
+      // Sized for the loaded calibration, so it's used as is
+      SyntheticFringeParams fringeParams;
+      if (m_calib != nullptr) {
+        fringeParams.ALineSize = m_calib->ALineSize();
+      }
+      const SyntheticFringeGenerator<Float> generator(m_calib, fringeParams);
+      if (generator.calibration() != m_calib) {
+        m_calib = generator.calibration();
+        m_worker->setCalibration(m_calib);
+      }
+
+      const auto dir = toPath(QStandardPaths::writableLocation(
+                           QStandardPaths::TempLocation)) /
+                       "OCTGui synthetic";
+      const auto path = generator.writeBinFile(dir, nFrames);
+      this->tryLoadBinfile(toQString(path));
+
+      // Only the loaded synthetic sequence is kept. Files still open (e.g.
+      // on Windows) are removed by the next generate.
+      std::error_code ec;
+      std::vector<fs::path> stale;
+      for (const auto &entry : fs::directory_iterator(dir, ec)) {
+        if (entry.path() != path) {
+          stale.push_back(entry.path());
+        }
+      }
+      for (const auto &file : stale) {
+        fs::remove(file, ec);
+      }
+    });
+
+    auto *actBench = new QAction("Run recon benchmark");
+    m_menuFile->addAction(actBench);
+    actBench->setToolTip("Reconstruct synthetic frames for each swept source "
+                         "with the current recon params and report time, "
+                         "A-lines/s against the source's A-line rate and "
+                         "cv::Mat allocations per frame.");
+
+    connect(actBench, &QAction::triggered, this, [this, actBench]() {
+      actBench->setEnabled(false);
+      statusBarMessage("Running recon benchmark...");
+      const auto params = m_reconParamsController->params();
+      QThreadPool::globalInstance()->start([this, actBench, params]() {
+        QString msg;
+        for (const auto &source : SweptSources) {
+          SyntheticFringeParams fringeParams;
+          fringeParams.ALineSize = source.ALineSize;
+          const auto result = benchmarkRecon(fringeParams, params);
+          const auto line = fmt::format(
+              "{} ({:.0f}% of {:.0f} A-lines/s)", result.summary(),
+              100.0 * result.ALinesPerSec / source.ALineRate,
+              source.ALineRate);
+          qInfo().noquote() << QString::fromStdString(line);
+          msg = QString::fromStdString(line);
+        }
+        QMetaObject::invokeMethod(this, [this, actBench, msg]() {
+          statusBarMessage(msg);
+          actBench->setEnabled(true);
+        });
+      });
+    });
+  }
+
+  // FFTW wisdom and plan warm-up
+  {
+    const auto configDir = toPath(
+        QStandardPaths::writableLocation(QStandardPaths::AppConfigLocation));
+    m_fftwWisdomPath = configDir / "fftwf_wisdom.txt";
+    m_fftwExhaustiveMarker = configDir / "fftwf_wisdom_exhaustive";
+
+    m_menuFile->addAction(m_actOptimizeFFT);
+    m_actOptimizeFFT->setToolTip(
+        "Run an exhaustive FFTW planning pass for the known FFT sizes and save "
+        "the wisdom. Takes a few minutes and only needs to run once per "
+        "machine.");
+    connect(m_actOptimizeFFT, &QAction::triggered, this,
+            [this]() { warmupFFTW(true); });
+
+    warmupFFTW(false);
+  }
+
   // Recon worker thread
   {
+    m_worker->setLiveRing(m_liveRing);
+    m_worker->setLModeView(m_lmodeView);
+    m_worker->setImageWriter(m_imageWriter);
     m_worker->moveToThread(&m_workerThread);
     connect(&m_workerThread, &QThread::finished, m_worker,
             &ReconWorker::deleteLater);
@@ -219,6 +553,19 @@ MainWindow::MainWindow()
     QMetaObject::invokeMethod(m_worker, &ReconWorker::start);
   }
 
+  // Pre-recon thread, only runs when the GUI and recon worker are idle
+  {
+    m_prerenderer->moveToThread(&m_prerenderThread);
+    connect(&m_prerenderThread, &QThread::finished, m_prerenderer,
+            &Prerenderer::deleteLater);
+    connect(m_prerenderer, &Prerenderer::progress, m_frameController,
+            &FrameController::setCacheProgress);
+    connect(m_prerenderer, &Prerenderer::progress, m_volumeView,
+            &VolumeRenderView::storeUpdated);
+    m_prerenderThread.start(QThread::IdlePriority);
+    QMetaObject::invokeMethod(m_prerenderer, &Prerenderer::start);
+  }
+
   // DAQ Info
   {
 #ifdef OCTGUI_HAS_ALAZAR
@@ -275,7 +622,9 @@ void MainWindow::dropEvent(QDropEvent *event) {
 
 void MainWindow::tryLoadCalibDirectory(const QString &calibDir) {
   constexpr int statusTimeoutMs = 10000;
-  m_calib = Calibration<Float>::fromCalibDir(DatFileReader::ALineSize,
+  const auto ALineSize = m_datReader.ok() ? m_datReader.ALineSize()
+                                          : DatFileReader::DefaultALineSize;
+  m_calib = Calibration<Float>::fromCalibDir(static_cast<int>(ALineSize),
                                              toPath(calibDir));
 
   if (m_calib != nullptr) {
@@ -289,6 +638,8 @@ void MainWindow::tryLoadCalibDirectory(const QString &calibDir) {
 #endif
 
     if (m_datReader.ok()) {
+      restartPrerender(m_frameController->pos());
+      updateThumbnails();
       loadFrame(m_frameController->pos());
     }
 
@@ -348,27 +699,30 @@ void MainWindow::loadFrame(size_t i) {
 
     // Recon
     const auto params = m_reconParamsController->params();
+    const bool paramsStale =
+        firstStaleStage(m_reconParams, params) < ReconStage::Radial;
     if (params.additionalOffset != 0) {
       m_reconParamsController->clearOffset();
+      m_rotation += params.additionalOffset;
     }
     m_worker->setParams(params);
+    // The offset is now part of the frame's alignment
+    m_reconParams = params;
+    m_reconParams.additionalOffset = 0;
+
+    // Cached frames are stale for the new params (padTop only affects the
+    // radial image, which isn't cached)
+    if (paramsStale) {
+      restartPrerender(i);
+    } else {
+      m_prerenderer->setCenter(i);
+    }
 
     if (m_exportSettingsWidget->dirty()) {
       m_worker->setExportSettings(m_exportSettingsWidget->settings());
     }
 
-    // Read the current fringe data
-    i = std::clamp<size_t>(i, 0, m_datReader.size());
-
-    m_ringBuffer->produce([&, this](std::shared_ptr<OCTData<Float>> &dat) {
-      dat->i = i;
-      if (auto err = m_datReader.read(i, 1, dat->fringe); err) {
-        const auto msg = fmt::format("While loading {}/{}, got {}", i,
-                                     m_datReader.size(), *err);
-        QMetaObject::invokeMethod(this, &MainWindow::statusBarMessage,
-                                  QString::fromStdString(msg));
-      }
-    });
+    produceFrame(i, 0);
 
   } else {
     statusBarMessage(
@@ -377,7 +731,327 @@ void MainWindow::loadFrame(size_t i) {
   }
 }
 
+void MainWindow::previewFrame(size_t i) {
+  if (m_calib != nullptr && m_datReader.ok()) {
+    produceFrame(i, m_previewParams.lineStep);
+  }
+}
+
+void MainWindow::produceFrame(size_t i, size_t previewLineStep) {
+  // Read the current fringe data
+  i = std::clamp<size_t>(i, 0, m_datReader.size());
+
+  // Never block the GUI thread on the worker, see `m_pendingFrame`
+  m_pendingFrame.reset();
+  const auto produce = [&, this](std::shared_ptr<OCTData<Float>> &dat) {
+    perf::ScopedProbe probe(perf::Stage::ReadFringe);
+    dat->i = i;
+    dat->ALineSize = m_datReader.ALineSize();
+    dat->linesPerFrame = m_datReader.linesPerFrame();
+    dat->previewLineStep = previewLineStep;
+
+    // Full quality frames from the pre-recon cache, also while scrubbing
+    dat->cached = m_frameCache->get(i, dat->imgRect);
+    m_shownFromCache = dat->cached;
+    if (dat->cached) {
+      m_frameCacheStats.hit();
+      dat->previewLineStep = 0;
+      m_shownPreview = false;
+      dat->acquiredAt = std::chrono::steady_clock::now();
+      return;
+    }
+    m_frameCacheStats.miss();
+    m_shownPreview = previewLineStep != 0;
+
+    const auto err =
+        previewLineStep != 0
+            ? m_datReader.readDecimated(i, previewLineStep, dat->fringe)
+            : m_datReader.read(i, 1, dat->fringe);
+    if (err) {
+      const auto msg = fmt::format("While loading {}/{}, got {}", i,
+                                   m_datReader.size(), *err);
+      QMetaObject::invokeMethod(this, &MainWindow::statusBarMessage,
+                                QString::fromStdString(msg));
+    }
+    dat->acquiredAt = std::chrono::steady_clock::now();
+  };
+  if (!m_ringBuffer->produce(produce, false) &&
+      m_ringBuffer->overflowPolicy() == OverflowPolicy::Block) {
+    m_pendingFrame = {i, previewLineStep};
+    m_produceRetryTimer->start();
+  }
+}
+
+void MainWindow::reconParamsChanged() {
+  auto params = m_reconParamsController->params();
+
+  // Live frames pick up the params with the next frame
+  if (m_live) {
+    m_worker->setParams(params);
+    return;
+  }
+  if (m_calib == nullptr || !m_datReader.ok()) {
+    return;
+  }
+
+  const auto stale = firstStaleStage(m_reconParams, params);
+  if (stale == ReconStage::Count) {
+    return;
+  }
+  // A cached or preview frame isn't in the worker's recon stages, so
+  // re-rendering would show the last full frame instead
+  const bool canRerender = !m_shownFromCache && !m_shownPreview;
+  if (stale != ReconStage::ALines && canRerender) {
+    if (params.additionalOffset != 0) {
+      m_reconParamsController->clearOffset();
+      m_rotation += params.additionalOffset;
+    }
+    m_worker->requestRerender(params);
+
+    // The offset is now part of the frame's alignment
+    params.additionalOffset = 0;
+    m_worker->setParams(params);
+    m_reconParams = params;
+
+    if (stale != ReconStage::Radial) {
+      restartPrerender(m_frameController->pos());
+    }
+  } else {
+    loadFrame(m_frameController->pos());
+  }
+}
+
+void MainWindow::updateStatsTimer() {
+  if (m_live || m_imageDisplay->overlay()->statsVisible()) {
+    m_statsTimer->start();
+  } else {
+    m_statsTimer->stop();
+  }
+}
+
+perf::Registry::ExtraRows MainWindow::pipelineCounters() const {
+  const auto stats = m_ringBuffer->stats();
+  perf::Registry::ExtraRows rows{
+      {"Ring occupancy", fmt::format("{}/{}", stats.occupancy, stats.capacity)},
+      {"Ring produced", fmt::format("{}", stats.produced)},
+      {"Ring consumed", fmt::format("{}", stats.consumed)},
+      {"Ring dropped", fmt::format("{} oldest, {} newest", stats.overwritten,
+                                   stats.rejected)},
+      {"Ring blocked", fmt::format("{}", stats.blocked)},
+      {"Mat allocs", fmt::format("{}", perf::MatAllocCounter::get().count())},
+      {"Ring superseded", fmt::format("{}", stats.superseded)},
+  };
+
+  rows.emplace_back("Frame cache",
+                    fmt::format("{}, {}/{} MB", m_frameCacheStats.format(),
+                                m_frameCache->bytes() >> 20,
+                                m_frameCache->budget() >> 20));
+
+  const auto &stageStats = m_worker->stageStats();
+  for (size_t i = 0; i < ReconStageCount; ++i) {
+    rows.emplace_back(fmt::format("Cache {}", ReconStageNames[i]),
+                      stageStats[i].format());
+  }
+
+  const auto exports = m_imageWriter->stats();
+  if (exports.written + exports.failed + exports.dropped + exports.queued >
+      0) {
+    rows.emplace_back("Export queue", fmt::format("{}/{}", exports.queued,
+                                                  exports.capacity));
+    rows.emplace_back("Export written",
+                      fmt::format("{}, failed {}, dropped {}", exports.written,
+                                  exports.failed, exports.dropped));
+    rows.emplace_back("Export blocked", fmt::format("{} ({:.1f} ms)",
+                                                    exports.blocked,
+                                                    exports.blockedMs));
+  }
+
+  const auto live = m_liveRing->stats();
+  if (live.produced > 0) {
+    rows.emplace_back("Live produced", fmt::format("{}", live.produced));
+    rows.emplace_back("Live blocked", fmt::format("{} ({:.1f} ms)",
+                                                  live.producerBlocked,
+                                                  live.producerBlockedMs));
+    for (const auto &c : live.consumers) {
+      rows.emplace_back(c.name + " lag",
+                        fmt::format("{} (max {}), skipped {}", c.lag,
+                                    c.maxLag, c.skipped));
+    }
+  }
+  return rows;
+}
+
+void MainWindow::restartPrerender(size_t center) {
+  if (m_calib == nullptr || !m_datReader.ok() || m_live) {
+    stopPrerender();
+    return;
+  }
+  auto params = m_reconParamsController->params();
+  params.additionalOffset = m_rotation;
+  updateVolume(params);
+  m_prerenderer->restart(m_datReader, m_calib, params, center, m_volume);
+}
+
+void MainWindow::stopPrerender() {
+  m_prerenderer->cancel();
+  m_frameCache->clear(0);
+  m_frameController->setCacheProgress(0, 0);
+  m_worker->setVolumeStore(nullptr);
+  m_volumeView->setVolume(nullptr, 0);
+}
+
+void MainWindow::updateVolume(const OCTReconParams<Float> &params) {
+  const auto rect =
+      frameGeometry(static_cast<int>(m_datReader.linesPerFrame()), params)
+          .rect;
+  const VolumeGeometry geometry{static_cast<size_t>(rect.height),
+                                static_cast<size_t>(rect.width),
+                                m_datReader.size()};
+  const auto &seqFile = m_datReader.files().front();
+  const auto dir = toPath(QStandardPaths::writableLocation(
+                       QStandardPaths::CacheLocation)) /
+                   "volumes";
+  const auto path = VolumeStore::pathFor(dir, seqFile, geometry);
+  const auto key = volumeKey(m_datReader, *m_calib, params);
+
+  // Same file, start over in place. Otherwise a new store, the old one is
+  // unmapped once the worker and pre-recon let go of it.
+  if (m_volume != nullptr && m_volume->path() == path) {
+    m_volume->reset(key);
+  } else {
+    std::error_code ec;
+    fs::create_directories(dir, ec);
+    VolumeStore::prune(dir, seqFile, path);
+    m_volume = std::make_shared<VolumeStore>();
+    if (auto err = m_volume->open(path, geometry, key)) {
+      qWarning() << "Volume store:" << toQString(*err);
+      m_volume.reset();
+    }
+  }
+  m_worker->setVolumeStore(m_volume);
+  m_volumeView->setVolume(m_volume, params.padTop);
+}
+
+void MainWindow::updateThumbnails() {
+  if (m_thumbCancel != nullptr) {
+    *m_thumbCancel = true;
+  }
+  m_frameController->setThumbnails({});
+  if (m_calib == nullptr || !m_datReader.ok()) {
+    return;
+  }
+
+  auto cancel = std::make_shared<std::atomic<bool>>(false);
+  m_thumbCancel = cancel;
+  const auto params = m_reconParamsController->params();
+  QThreadPool::globalInstance()->start([this, reader = m_datReader,
+                                        calib = m_calib, params,
+                                        thumbParams = m_thumbParams,
+                                        cancel]() {
+    TimeIt timeit;
+    const auto path = thumbnailPath(reader);
+    const auto key = thumbnailKey(reader, *calib, params, thumbParams);
+
+    auto thumbs = loadThumbnails(path, key);
+    const bool fromFile = thumbs.has_value();
+    if (!fromFile) {
+      Thumbnails made;
+      if (auto err = makeThumbnails(reader, *calib, params, thumbParams, made,
+                                    *cancel)) {
+        if (!*cancel) {
+          qWarning() << "Failed to make thumbnails:" << toQString(*err);
+        }
+        return;
+      }
+      // Best effort, the data dir may be read only
+      if (auto err = saveThumbnails(path, made, key)) {
+        qDebug() << "Failed to save thumbnails:" << toQString(*err);
+      }
+      thumbs = std::move(made);
+    }
+
+    std::vector<QImage> images;
+    images.reserve(thumbs->count());
+    for (size_t i = 0; i < thumbs->count(); ++i) {
+      const auto mat = thumbs->at(i);
+      images.push_back(QImage(mat.data, mat.cols, mat.rows,
+                              static_cast<qsizetype>(mat.step),
+                              QImage::Format_Grayscale8)
+                           .copy());
+    }
+    const auto msg = QString::fromStdString(
+        fmt::format("Thumbnails {} in {:.0f} ms",
+                    fromFile ? "loaded" : "made", timeit.get_ms()));
+
+    QMetaObject::invokeMethod(
+        this, [this, images = std::move(images), cancel, msg]() mutable {
+          if (*cancel) {
+            return;
+          }
+          m_frameController->setThumbnails(std::move(images));
+          qInfo() << msg;
+        });
+  });
+}
+
+void MainWindow::exportWholeSequence() {
+  if (m_exportCancel != nullptr) {
+    *m_exportCancel = true;
+    return;
+  }
+  if (m_calib == nullptr || !m_datReader.ok() || m_live) {
+    statusBarMessage("Load a sequence and calibration files to export.");
+    return;
+  }
+
+  auto cancel = std::make_shared<std::atomic<bool>>(false);
+  m_exportCancel = cancel;
+  m_actExportSequence->setText("Cancel sequence export");
+  auto params = m_reconParamsController->params();
+  params.additionalOffset = m_rotation;
+  QThreadPool::globalInstance()->start([this, reader = m_datReader,
+                                        calib = m_calib, params,
+                                        settings =
+                                            m_exportSettingsWidget->settings(),
+                                        volume = m_volume,
+                                        writer = m_imageWriter, cancel]() {
+    TimeIt timeit;
+    const auto n = reader.size();
+    const auto step = std::max<size_t>(n / 100, 1);
+    const auto err = exportSequence(
+        reader, *calib, params, volume.get(), settings, *writer, *cancel,
+        [this, n, step](size_t done) {
+          if (done % step == 0 || done == n) {
+            const auto msg = QString::fromStdString(
+                fmt::format("Exporting frame {}/{}...", done, n));
+            QMetaObject::invokeMethod(
+                this, [this, msg]() { statusBarMessage(msg); });
+          }
+        });
+    writer->waitIdle();
+
+    const auto msg = QString::fromStdString(
+        err ? fmt::format("Sequence export stopped: {}", *err)
+            : fmt::format("Exported {} frames to {} in {:.1f} s", n,
+                          settings.exportDir, timeit.get_ms() / 1000));
+    qInfo() << msg;
+    QMetaObject::invokeMethod(this, [this, cancel, msg]() {
+      if (m_exportCancel == cancel) {
+        m_exportCancel.reset();
+        m_actExportSequence->setText("Export whole sequence");
+      }
+      statusBarMessage(msg);
+    });
+  });
+}
+
 void MainWindow::afterDatReaderReady() {
+  m_worker->invalidateCache();
+  m_rotation = 0;
+  m_lmodeView->reset(m_datReader.size());
+  m_worker->resetEnFace(m_datReader.size());
+  restartPrerender(0);
+  updateThumbnails();
 
   // Update image overlay sequence label
   m_imageDisplay->overlay()->setSequence(
@@ -396,16 +1070,81 @@ void MainWindow::afterDatReaderReady() {
   m_exportSettingsWidget->setExportDir(exportDir);
   fs::create_directories(exportDir);
 
-  // Ensure the ring buffers have enough storage
+  // Size the ring buffer for this frame size and ensure it has enough storage
   const auto fringeSize = m_datReader.samplesPerFrame();
-  m_ringBuffer->forEach([fringeSize](std::shared_ptr<OCTData<Float>> &dat) {
+  m_ringBuffer->resize(ringCapacityForBudget(PlaybackBufferBudget,
+                                             fringeSize * sizeof(uint16_t)));
+  const auto nLines = m_datReader.linesPerFrame();
+  const auto geom = frameGeometry(static_cast<int>(nLines),
+                                  m_reconParamsController->params());
+  m_ringBuffer->forEach([&](std::shared_ptr<OCTData<Float>> &dat) {
     dat->fringe.resize(fringeSize);
+    dat->allocateImages(geom.rect, geom.radial, geom.combined);
   });
 };
 
+void MainWindow::warmupFFTW(bool exhaustive) {
+  m_actOptimizeFFT->setEnabled(false);
+  if (exhaustive) {
+    statusBarMessage("Optimizing FFT plans...");
+  }
+
+  QThreadPool::globalInstance()->start([this, exhaustive]() {
+    auto &planner = FFTWPlanner<Float>::get();
+    planner.loadWisdom(m_fftwWisdomPath);
+
+    TimeIt timeit;
+    const auto flags = exhaustive ? FFTW_EXHAUSTIVE : FFTW_MEASURE;
+    const bool finished = planner.warmup(knownFFTSizes(), flags);
+    const auto elapsed = timeit.get_ms();
+
+    if (!planner.saveWisdom(m_fftwWisdomPath)) {
+      qWarning() << "Failed to save FFTW wisdom to"
+                 << toQString(m_fftwWisdomPath);
+    }
+    if (finished && exhaustive) {
+      std::ofstream(m_fftwExhaustiveMarker).put('\n');
+    }
+
+    const auto msg = QString::fromStdString(
+        fmt::format("FFT plans {} in {:.0f} ms{}",
+                    exhaustive ? "optimized" : "ready", elapsed,
+                    finished ? "" : " (cancelled)"));
+    qInfo() << msg;
+
+    QMetaObject::invokeMethod(this, [this, exhaustive, msg]() {
+      const bool optimized = fs::exists(m_fftwExhaustiveMarker);
+      m_actOptimizeFFT->setEnabled(true);
+      m_actOptimizeFFT->setText(optimized ? "Optimize FFT plans (done)"
+                                          : "Optimize FFT plans");
+      if (exhaustive) {
+        statusBarMessage(msg);
+      } else if (!optimized) {
+        statusBarMessage("FFT plans are not optimized for this machine yet, "
+                         "see File > Optimize FFT plans");
+      }
+    });
+  });
+}
+
 void MainWindow::closeEvent(QCloseEvent *event) {
-  m_ringBuffer->quit();
+  m_prerenderer->cancel();
+  m_prerenderer->setShouldStop(true);
+  m_prerenderThread.quit();
+  m_prerenderThread.wait();
+  FFTWPlanner<Float>::get().cancel();
+  if (m_thumbCancel != nullptr) {
+    *m_thumbCancel = true;
+  }
+  if (m_exportCancel != nullptr) {
+    *m_exportCancel = true;
+  }
+  m_volumeView->cancel();
+  m_produceRetryTimer->stop();
+  QThreadPool::globalInstance()->waitForDone();
   m_worker->setShouldStop(true);
+  m_ringBuffer->quit();
+  m_liveRing->quit();
   m_workerThread.quit();
   m_workerThread.wait();
   QMainWindow::closeEvent(event);
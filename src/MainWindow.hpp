@@ -1,14 +1,24 @@
 #pragma once
 
+#include "BroadcastRing.hpp"
 #include "Common.hpp"
 #include "ExportSettings.hpp"
+#include "FFTWPlanner.hpp"
 #include "FileIO.hpp"
+#include "FrameCache.hpp"
 #include "FrameController.hpp"
 #include "ImageDisplay.hpp"
+#include "ImageExport.hpp"
+#include "Instrumentation.hpp"
+#include "LModeView.hpp"
 #include "MotorDriver.hpp"
 #include "OCTReconParamsController.hpp"
+#include "Prerenderer.hpp"
 #include "ReconWorker.hpp"
 #include "RingBuffer.hpp"
+#include "Thumbnails.hpp"
+#include "VolumeRenderView.hpp"
+#include "VolumeStore.hpp"
 #include <QAction>
 #include <QDockwidget>
 #include <QDropEvent>
@@ -17,7 +27,12 @@
 #include <QMenu>
 #include <QStatusBar>
 #include <QThread>
+#include <QTimer>
+#include <atomic>
+#include <filesystem>
 #include <memory>
+#include <optional>
+#include <utility>
 
 #ifdef OCTGUI_HAS_ALAZAR
 #include "AcquisitionController.hpp"
@@ -40,6 +55,12 @@ public Q_SLOTS:
   void tryLoadBinfile(const QString &qpath);
 
   void loadFrame(size_t i);
+  // Fast decimated recon of frame `i` while scrubbing (see `reconPreview`)
+  void previewFrame(size_t i);
+
+  // Re-render the current frame from the cached recon stages if the A-line
+  // stage isn't stale, otherwise reconstruct it again.
+  void reconParamsChanged();
 
 protected:
   void dragEnterEvent(QDragEnterEvent *event) override;
@@ -55,6 +76,8 @@ private:
   FrameController *m_frameController;
   OCTReconParamsController *m_reconParamsController;
   MotorDriver *m_motorDriver;
+  // Built from the frames the worker and pre-recon reconstruct
+  LModeView *m_lmodeView;
 
 #ifdef WIN32
   QString defaultDataDir{"C:/Data/"};
@@ -65,19 +88,105 @@ private:
 #endif
   DatFileReader m_datReader;
   std::shared_ptr<Calibration<Float>> m_calib;
-
-  // ring buffer for reading fringes
+  // Params of the last recon requested by `loadFrame`
+  OCTReconParams<Float> m_reconParams;
+  PreviewParams m_previewParams;
+  // En-face map below the rect image
+  EnFaceParams m_enFaceParams;
+  bool m_enFaceOn{true};
+  void updateEnFace() {
+    m_worker->setEnFaceParams(m_enFaceOn ? std::optional(m_enFaceParams)
+                                         : std::nullopt);
+  }
+
+  // Read frame `i` into the ring buffer for the worker. With a nonzero
+  // `previewLineStep`, only every `previewLineStep`th A-line for a preview.
+  void produceFrame(size_t i, size_t previewLineStep);
+  // (i, previewLineStep) of the last frame that didn't fit in the ring under
+  // OverflowPolicy::Block. The GUI thread doesn't wait for room, it retries
+  // every `ProduceRetryMs` until the worker frees a slot.
+  static constexpr int ProduceRetryMs = 5;
+  std::optional<std::pair<size_t, size_t>> m_pendingFrame;
+  QTimer *m_produceRetryTimer;
+
+  // ring buffer for reading fringes, sized from a memory budget for the
+  // loaded sequence's frame size
+  static constexpr size_t PlaybackBufferBudget = size_t{256} << 20;
   std::shared_ptr<RingBuffer<OCTData<Float>>> m_ringBuffer;
+  // Live frames from the DAQ, broadcast to display and disk writer
+  static constexpr size_t LiveRingCapacity = 8;
+  std::shared_ptr<BroadcastRing<OCTData<Float>>> m_liveRing;
   ReconWorker *m_worker;
   QThread m_workerThread;
 
+  // Background pre-recon of the loaded sequence (see `Prerenderer`) into a
+  // cache that `produceFrame` serves frames from
+  static constexpr size_t FrameCacheBudget = size_t{1} << 30;
+  std::shared_ptr<FrameCache> m_frameCache;
+  Prerenderer *m_prerenderer;
+  QThread m_prerenderThread;
+  perf::CacheCounter m_frameCacheStats;
+  // Sum of the rotations (additionalOffset) applied to this sequence
+  int m_rotation{};
+  // The last frame loaded came from the cache, so the worker's recon stages
+  // don't hold it and it can't be re-rendered
+  bool m_shownFromCache{false};
+  // The last frame loaded was a decimated preview (see
+  // `OCTData::previewLineStep`), which the worker's recon stages don't hold
+  // either
+  bool m_shownPreview{false};
+  // Restart the pre-recon from frame `center` with the current calibration
+  // and params, or stop it if there's nothing to reconstruct
+  void restartPrerender(size_t center);
+  void stopPrerender();
+
+  // Memory mapped store of the loaded sequence's rect images (see
+  // `VolumeStore`), written by the worker and pre-recon. Reopened in the
+  // app's cache directory for the recon `params` of a `restartPrerender`,
+  // nullptr if it can't be (e.g. the disk is full).
+  std::shared_ptr<VolumeStore> m_volume;
+  void updateVolume(const OCTReconParams<Float> &params);
+  // 3D view of `m_volume`
+  VolumeRenderView *m_volumeView;
+
+  // Slider thumbnails of the loaded sequence, loaded from or saved to the
+  // sequence's sidecar file in the background
+  ThumbnailParams m_thumbParams;
+  std::shared_ptr<std::atomic<bool>> m_thumbCancel;
+  void updateThumbnails();
+
   ExportSettingsWidget *m_exportSettingsWidget;
+  // Encodes saved images off the recon thread, for the worker and the
+  // whole sequence export
+  std::shared_ptr<ImageWriterPool> m_imageWriter{
+      std::make_shared<ImageWriterPool>()};
+  // Reconstruct and save every frame of the loaded sequence in the
+  // background, or cancel the export in progress
+  QAction *m_actExportSequence{};
+  std::shared_ptr<std::atomic<bool>> m_exportCancel;
+  void exportWholeSequence();
+
+  // FFTW wisdom in the user config dir. The marker file records that the
+  // exhaustive planning pass has run on this machine.
+  fs::path m_fftwWisdomPath;
+  fs::path m_fftwExhaustiveMarker;
+  QAction *m_actOptimizeFFT;
+  // Load wisdom and plan the known FFT sizes in the background, then save
+  void warmupFFTW(bool exhaustive);
+
+  // Refresh the pipeline stats overlay panel and the live latency label
+  QTimer *m_statsTimer;
+  bool m_live{false};
+  void updateStatsTimer();
 
 #ifdef OCTGUI_HAS_ALAZAR
   // Acquisition
   AcquisitionController *m_acqController;
 #endif
 
+  // Ring buffer counters to append to the pipeline stats
+  [[nodiscard]] perf::Registry::ExtraRows pipelineCounters() const;
+
   // Called after a new DatReader is ready.
   // Updates UI elements with the new DatReader.
   void afterDatReaderReady();
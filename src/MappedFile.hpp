@@ -0,0 +1,215 @@
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <span>
+#include <system_error>
+#include <utility>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace OCT {
+
+namespace fs = std::filesystem;
+
+/**
+Memory map of a whole file, read-only by default. Move only; unmaps on
+destruction. `ok()` is false if the file couldn't be opened or is empty.
+
+A ReadWrite map is shared: writes go to the file (through the page cache)
+and the file's size is fixed, see `allocateFile` to size it first.
+ */
+class MappedFile {
+public:
+  enum class Access : uint8_t { ReadOnly, ReadWrite };
+
+  MappedFile() = default;
+  explicit MappedFile(const fs::path &path, Access access = Access::ReadOnly)
+      : m_writable(access == Access::ReadWrite) {
+    open(path);
+  }
+
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+  MappedFile(MappedFile &&other) noexcept
+      : m_data(std::exchange(other.m_data, nullptr)),
+        m_size(std::exchange(other.m_size, 0)),
+        m_writable(std::exchange(other.m_writable, false)) {}
+  MappedFile &operator=(MappedFile &&other) noexcept {
+    if (this != &other) {
+      close();
+      m_data = std::exchange(other.m_data, nullptr);
+      m_size = std::exchange(other.m_size, 0);
+      m_writable = std::exchange(other.m_writable, false);
+    }
+    return *this;
+  }
+  ~MappedFile() { close(); }
+
+  [[nodiscard]] bool ok() const { return m_data != nullptr; }
+  [[nodiscard]] const std::byte *data() const { return m_data; }
+  [[nodiscard]] size_t size() const { return m_size; }
+  [[nodiscard]] std::span<const std::byte> bytes() const {
+    return {m_data, m_size};
+  }
+  // nullptr unless mapped ReadWrite
+  [[nodiscard]] std::byte *writableData() const {
+    return m_writable ? m_data : nullptr;
+  }
+
+  // Write dirty pages back to the file now instead of eventually
+  void flush() const {
+    if (m_data != nullptr && m_writable) {
+#ifdef _WIN32
+      FlushViewOfFile(m_data, 0);
+#else
+      msync(m_data, m_size, MS_SYNC);
+#endif
+    }
+  }
+
+private:
+  std::byte *m_data{};
+  size_t m_size{};
+  bool m_writable{false};
+
+#ifdef _WIN32
+  void open(const fs::path &path) {
+    const DWORD fileAccess =
+        m_writable ? GENERIC_READ | GENERIC_WRITE : GENERIC_READ;
+    const DWORD share =
+        m_writable ? FILE_SHARE_READ | FILE_SHARE_WRITE : FILE_SHARE_READ;
+    HANDLE file = CreateFileW(path.c_str(), fileAccess, share, nullptr,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+      return;
+    }
+    LARGE_INTEGER size{};
+    if (GetFileSizeEx(file, &size) != 0 && size.QuadPart > 0) {
+      HANDLE mapping = CreateFileMappingW(
+          file, nullptr, m_writable ? PAGE_READWRITE : PAGE_READONLY, 0, 0,
+          nullptr);
+      if (mapping != nullptr) {
+        void *ptr = MapViewOfFile(
+            mapping, m_writable ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, 0);
+        if (ptr != nullptr) {
+          m_data = static_cast<std::byte *>(ptr);
+          m_size = static_cast<size_t>(size.QuadPart);
+        }
+        // The view keeps the mapping alive
+        CloseHandle(mapping);
+      }
+    }
+    CloseHandle(file);
+  }
+
+  void close() {
+    if (m_data != nullptr) {
+      UnmapViewOfFile(m_data);
+      m_data = nullptr;
+      m_size = 0;
+    }
+  }
+#else
+  void open(const fs::path &path) {
+    const int fd = ::open(path.c_str(), m_writable ? O_RDWR : O_RDONLY);
+    if (fd < 0) {
+      return;
+    }
+    struct stat st{};
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+      const auto size = static_cast<size_t>(st.st_size);
+      void *ptr =
+          m_writable
+              ? mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)
+              : mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (ptr != MAP_FAILED) {
+        m_data = static_cast<std::byte *>(ptr);
+        m_size = size;
+      }
+    }
+    // The mapping stays valid after closing the fd
+    ::close(fd);
+  }
+
+  void close() {
+    if (m_data != nullptr) {
+      munmap(m_data, m_size);
+      m_data = nullptr;
+      m_size = 0;
+    }
+  }
+#endif
+};
+
+/**
+Grow `path` to `size` bytes, creating it if it's missing, with the space
+allocated on disk. Unlike a sparse `fs::resize_file`, a full disk is an
+error here instead of a SIGBUS (access violation on Windows) when a page of
+a ReadWrite map of the file is first written. Content up to the old size is
+kept.
+ */
+inline std::error_code allocateFile(const fs::path &path, size_t size) {
+#ifdef _WIN32
+  HANDLE file = CreateFileW(path.c_str(), GENERIC_READ | GENERIC_WRITE,
+                            FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr,
+                            OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (file == INVALID_HANDLE_VALUE) {
+    return {static_cast<int>(GetLastError()), std::system_category()};
+  }
+  FILE_ALLOCATION_INFO alloc{};
+  alloc.AllocationSize.QuadPart = static_cast<LONGLONG>(size);
+  FILE_END_OF_FILE_INFO eof{};
+  eof.EndOfFile.QuadPart = static_cast<LONGLONG>(size);
+  std::error_code ec;
+  if (SetFileInformationByHandle(file, FileAllocationInfo, &alloc,
+                                 sizeof(alloc)) == 0 ||
+      SetFileInformationByHandle(file, FileEndOfFileInfo, &eof,
+                                 sizeof(eof)) == 0) {
+    ec = {static_cast<int>(GetLastError()), std::system_category()};
+  }
+  CloseHandle(file);
+  return ec;
+#else
+  const int fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644); // NOLINT
+  if (fd < 0) {
+    return {errno, std::generic_category()};
+  }
+  int err = 0;
+#ifdef __APPLE__
+  // No posix_fallocate, reserve what isn't allocated yet then set the size
+  struct stat st{};
+  if (fstat(fd, &st) != 0) {
+    err = errno;
+  } else {
+    const auto allocated = static_cast<off_t>(st.st_blocks) * 512;
+    fstore_t store{F_ALLOCATEALL, F_PEOFPOSMODE, 0,
+                   std::max<off_t>(static_cast<off_t>(size) - allocated, 0),
+                   0};
+    if ((store.fst_length > 0 && fcntl(fd, F_PREALLOCATE, &store) != 0) ||
+        ftruncate(fd, static_cast<off_t>(size)) != 0) {
+      err = errno;
+    }
+  }
+#else
+  err = posix_fallocate(fd, 0, static_cast<off_t>(size));
+#endif
+  ::close(fd);
+  return {err, std::generic_category()};
+#endif
+}
+
+} // namespace OCT
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "Common.hpp"
+#include <chrono>
 #include <fftconv/aligned_vector.hpp>
 #include <opencv2/opencv.hpp>
 
@@ -8,11 +9,32 @@ namespace OCT {
 
 template <Floating T> struct OCTData {
   fftconv::AlignedVector<uint16_t> fringe;
+  // Samples per A-line of `fringe`, set by the producer
+  size_t ALineSize{};
   size_t i{};
 
+  // Scrubbing preview (see `reconPreview`): nonzero if `fringe` only holds
+  // every `previewLineStep`th of the `linesPerFrame` A-lines of the frame
+  size_t previewLineStep{};
+  size_t linesPerFrame{};
+  // `imgRect` was filled from the pre-recon cache and there's no fringe
+  bool cached{};
+
+  // Monotonic time when the fringe became available (DMA buffer complete, or
+  // read from disk). Used to measure acquisition to display latency.
+  std::chrono::steady_clock::time_point acquiredAt{};
+
   cv::Mat_<uint8_t> imgRect;
   cv::Mat_<uint8_t> imgRadial;
   cv::Mat_<uint8_t> imgCombined;
+
+  // Preallocate the image buffers for a frame geometry (see `frameGeometry`).
+  // They are then reused by every frame that passes through this ring slot.
+  void allocateImages(cv::Size rect, cv::Size radial, cv::Size combined) {
+    imgRect.create(rect);
+    imgRadial.create(radial);
+    imgCombined.create(combined);
+  }
 };
 
 } // namespace OCT
\ No newline at end of file
@@ -2,22 +2,30 @@
 
 #include "Calibration.hpp"
 #include "Common.hpp"
+#include "EnFace.hpp"
+#include "FFTWPlanner.hpp"
+#include "Instrumentation.hpp"
+#include "SIMDKernels.hpp"
 #include "phasecorr.hpp"
 #include "timeit.hpp"
+#include <algorithm>
 #include <cassert>
+#include <cmath>
 #include <fftconv/aligned_vector.hpp>
 #include <fftconv/fftw.hpp>
 #include <fftw3.h>
 #include <fmt/format.h>
 #include <numbers>
 #include <oneapi/tbb/blocked_range.h>
-#include <oneapi/tbb/scalable_allocator.h>
+#include <oneapi/tbb/enumerable_thread_specific.h>
+#include <oneapi/tbb/partitioner.h>
 #include <opencv2/core.hpp>
 #include <opencv2/core/base.hpp>
 #include <opencv2/opencv.hpp>
+#include <optional>
 #include <span>
 #include <tbb/parallel_for.h>
-#include <tbb/scalable_allocator.h>
+#include <vector>
 
 // NOLINTBEGIN(*-pointer-arithmetic, *-magic-numbers, *-reinterpret-cast)
 
@@ -47,41 +55,52 @@ template <Floating T> struct OCTReconParams {
   int additionalOffset = 0;
 };
 
+// `power` is |X|^2 of an `fftSize` point FFT (see `simd::power`)
 template <typename T, typename Tout = T>
-void logCompress(const std::span<Tout> out,
-                 const std::span<const fftw::Complex<T>> cx, T contrast,
-                 T brightness) {
-  const T fct = 1.0 / cx.size();
+void logCompress(const std::span<Tout> out, const std::span<const T> power,
+                 size_t fftSize, T contrast, T brightness) {
+  assert(out.size() <= power.size());
+  const T fct = 1.0 / fftSize;
   const T fct2 = 20 * log10(fct); // 20 because fct is not squared
   for (size_t i = 0; i < out.size(); ++i) {
-    const T ro = cx[i][0];
-    const T io = cx[i][1];
-    T val = ro * ro + io * io;
-    // Note the 10 * log10 is because val is the square
-    val = contrast * (10 * log10(val) + brightness + fct2);
+    // Note the 10 * log10 is because power is the square
+    const T val = contrast * (10 * log10(power[i]) + brightness + fct2);
     out[i] = std::clamp<T>(val, 0, 255);
   }
 }
 
+// Log power in dB of an `fftSize` point FFT, normalized like `logCompress`:
+// out[i] = 10 * log10(power[i] / fftSize^2)
+template <typename T>
+void logPower(const std::span<T> out, const std::span<const T> power,
+              size_t fftSize) {
+  assert(out.size() <= power.size());
+  const T fct2 = 20 * log10(T{1} / fftSize);
+  for (size_t i = 0; i < out.size(); ++i) {
+    out[i] = 10 * log10(power[i]) + fct2;
+  }
+}
+
+// Display mapping of `logPower` output for `nSplits` consecutive splits of
+// `out.size()` each: the sum over splits of clamp(contrast * (dB +
+// brightness), 0, 255), i.e. the sum of each split's `logCompress`.
 template <typename T, typename Tout = T>
-void logCompress_add(const std::span<Tout> out,
-                     const std::span<const fftw::Complex<T>> inCx, T contrast,
-                     T brightness, size_t offsetTop = 0) {
-  assert(out.size() <= inCx.size());
-  const T fct = 1.0 / inCx.size();
-  const T fct2 = 20 * log10(fct); // 20 because fct is not squared
-  for (size_t i = offsetTop; i < out.size(); ++i) {
-    const T ro = inCx[i][0];
-    const T io = inCx[i][1];
-    T val = ro * ro + io * io;
-    // Note the 10 * log10 is because val is squared
-    val = contrast * (10 * log10(val) + brightness + fct2);
-    out[i] += std::clamp<T>(val, 0, 255);
+void mapLogPower(const std::span<Tout> out, const T *dB, size_t nSplits,
+                 T contrast, T brightness, size_t offsetTop = 0) {
+  const size_t depth = out.size();
+  offsetTop = std::min(offsetTop, depth);
+  std::fill_n(out.data(), offsetTop, Tout{});
+  for (size_t i = offsetTop; i < depth; ++i) {
+    T acc{};
+    for (size_t s = 0; s < nSplits; ++s) {
+      acc += std::clamp<T>(contrast * (dB[s * depth + i] + brightness), 0, 255);
+    }
+    out[i] = acc;
   }
 }
 
 inline int getDistortionOffset(const cv::Mat &mat, int theoryWidth,
-                               int NumAlines) {
+                               int NumAlines, cvMod::PhaseCorrWorkspace &ws) {
   constexpr int additionalCorrWidth = 0;
   const int corrWidth = NumAlines - theoryWidth + additionalCorrWidth;
   auto firstStrip = mat(cv::Rect(0, 0, corrWidth, mat.rows));
@@ -98,8 +117,15 @@ inline int getDistortionOffset(const cv::Mat &mat, int theoryWidth,
   //   cv::imshow("lastStrip", lastStripDebug);
   // }
 
-  return static_cast<int>(std::round(
-      cvMod::phaseCorrelate(firstStrip, lastStrip).x - additionalCorrWidth));
+  return static_cast<int>(
+      std::round(cvMod::phaseCorrelate(firstStrip, lastStrip, ws).x -
+                 additionalCorrWidth));
+}
+
+inline int getDistortionOffset(const cv::Mat &mat, int theoryWidth,
+                               int NumAlines) {
+  cvMod::PhaseCorrWorkspace ws;
+  return getDistortionOffset(mat, theoryWidth, NumAlines, ws);
 }
 
 inline void shiftXCircular(const cv::Mat &src, cv::Mat &dst, int shiftX) {
@@ -139,243 +165,653 @@ template <Floating T> auto getHamming(int n) {
   return win;
 }
 
-/**
-Original impl. without split spectrum
- */
+// Number of A-lines in the rect image after distortion correction
+inline int theoreticalALines(int nLines) {
+  if (nLines == 2200) {
+    // Only use distortion correction for the proximal driven in vivo probe
+    return 2000;
+  }
+  // 2500: Don't need distortion correction for the ex vivo probe.
+  return nLines;
+}
+
+// Output image sizes for a frame geometry
+struct FrameGeometry {
+  cv::Size rect;
+  cv::Size radial;
+  cv::Size combined;
+};
+
 template <Floating T>
-[[nodiscard]] cv::Mat_<uint8_t>
-reconBscan(const Calibration<T> &calib, const std::span<const uint16_t> fringe,
-           const size_t ALineSize, const OCTReconParams<T> &params = {}) {
+FrameGeometry frameGeometry(int nLines, const OCTReconParams<T> &params) {
+  const cv::Size rect(theoreticalALines(nLines), params.imageDepth);
+  const int dim = std::min(rect.width, rect.height);
+  const cv::Size radial(dim * 2, dim * 2);
+  return {rect, radial, {radial.width + rect.width, radial.height}};
+}
 
-  assert((fringe.size() % ALineSize) == 0);
-  const auto nLines = fringe.size() / ALineSize;
+/**
+Precomputed polar to cartesian lookup for `makeRadialImage`.
 
-  const auto win = getHamming<T>(ALineSize);
-  const auto contrast = params.contrast;
-  const auto brightness = params.brightness;
-  const size_t imageDepth = params.imageDepth;
+Equivalent to warpPolar (inverse map, nearest neighbour, fill outliers) on the
+top-padded, transposed rect image followed by a horizontal flip, but the map
+is only rebuilt when the rect size or padding changes and the padded and
+transposed intermediates are never materialized.
+ */
+class RadialMap {
+public:
+  void update(cv::Size rectSize, int padTop) {
+    if (rectSize == m_rectSize && padTop == m_padTop) {
+      return;
+    }
+    m_rectSize = rectSize;
+    m_padTop = padTop;
+
+    const int dim = std::min(rectSize.width, rectSize.height);
+    m_size = dim * 2;
+    m_srcIdx.resize(static_cast<size_t>(m_size) * m_size);
+
+    // Polar source: rows are angles (A-lines), cols are radius (padded depth)
+    const int nAngles = rectSize.width;
+    const int nRadius = rectSize.height + padTop;
+    const double Kmag = static_cast<double>(dim) / nRadius;
+    const double Kangle = 2 * std::numbers::pi / nAngles;
+    const double center = dim;
+
+    tbb::parallel_for(0, m_size, [&](int y) {
+      int32_t *idx = m_srcIdx.data() + static_cast<size_t>(y) * m_size;
+      for (int x = 0; x < m_size; ++x) {
+        // Flipped horizontally
+        const double dx = (m_size - 1 - x) - center;
+        const double dy = y - center;
+
+        const auto r = static_cast<int>(std::lround(std::hypot(dx, dy) / Kmag));
+        double angle = std::atan2(dy, dx);
+        if (angle < 0) {
+          angle += 2 * std::numbers::pi;
+        }
+        auto a = static_cast<int>(std::lround(angle / Kangle));
+        if (a >= nAngles) {
+          a -= nAngles;
+        }
 
-  // cv::Mat constructor takes (height, width)
-  cv::Mat_<T> mat(nLines, imageDepth);
+        const int depth = r - padTop;
+        if (r >= nRadius || depth < 0) {
+          idx[x] = -1;
+        } else {
+          idx[x] = depth * rectSize.width + a;
+        }
+      }
+    });
+  }
 
-  const auto &fft = fftw::EngineR2C1D<T>::get(ALineSize);
+  void apply(const cv::Mat_<uint8_t> &in, cv::Mat_<uint8_t> &out) const {
+    assert(in.isContinuous() && in.size() == m_rectSize);
+    out.create(m_size, m_size);
+    const uint8_t *src = in.ptr<uint8_t>();
+    tbb::parallel_for(0, m_size, [&](int y) {
+      const int32_t *idx = m_srcIdx.data() + static_cast<size_t>(y) * m_size;
+      auto *dst = out.ptr<uint8_t>(y);
+      for (int x = 0; x < m_size; ++x) {
+        dst[x] = idx[x] < 0 ? 0 : src[idx[x]];
+      }
+    });
+  }
 
-  tbb::blocked_range<size_t> range(0, nLines);
-  tbb::parallel_for(range, [&](const tbb::blocked_range<size_t> &range) {
-    fftw::R2CBuffer<T> fftBuf(ALineSize);
-    std::vector<T, tbb::scalable_allocator<T>> alineBuf(ALineSize);
-    std::vector<T, tbb::scalable_allocator<T>> linearKFringe(ALineSize);
+private:
+  cv::Size m_rectSize;
+  int m_padTop{-1};
+  int m_size{};
+  // Index into the rect image for each output pixel, -1 for background
+  std::vector<int32_t> m_srcIdx;
+};
 
-    for (size_t j = range.begin(); j < range.end(); ++j) {
-      const auto offset = j * ALineSize;
+/**
+Per-thread scratch for the A-line loop, aligned for FFTW and reused across
+frames instead of allocated per task chunk.
+ */
+template <Floating T> struct ReconScratch {
+  std::optional<fftw::R2CBuffer<T>> fftBuf;
+  fftconv::AlignedVector<T> alineBuf;
+  fftconv::AlignedVector<T> linearKFringe;
+  fftconv::AlignedVector<T> power;
+
+  // Sized for the largest plan (no split) and at least `imageDepth` output
+  // bins, since the image can be deeper than a short FFT's output (e.g.
+  // 1024 sample A-lines). Only reallocates when the sizes change.
+  //
+  // `planSize` is the size of the FFTs about to run. Output bins from
+  // `planSize / 2 + 1` to `imageDepth` aren't written by them, so bins left
+  // there by a larger FFT (another split count, or no split) are zeroed.
+  void resize(size_t ALineSize, size_t imageDepth, size_t planSize) {
+    const auto fftSize = std::max(ALineSize, 2 * imageDepth);
+    if (alineBuf.size() != ALineSize || fftSize != m_fftSize) {
+      fftBuf.emplace(fftSize);
+      alineBuf.resize(ALineSize);
+      linearKFringe.resize(ALineSize);
+      power.resize(fftSize / 2 + 1);
+      m_fftSize = fftSize;
+      m_written = fftSize / 2 + 1; // Zero it all
+    }
 
-      // 1. Subtract background
-      for (int i = 0; i < ALineSize; ++i) {
-        alineBuf[i] = fringe[offset + i] - calib.background[i];
-      }
+    const auto planBins = planSize / 2 + 1;
+    if (m_written > planBins) {
+      const auto end = std::min(m_written, fftSize / 2 + 1);
+      std::fill_n(reinterpret_cast<T *>(fftBuf->out + planBins),
+                  2 * (end - planBins), T{});
+    }
+    m_written = planBins;
+  }
 
-      // 2. Interpolate phase calibration data
-      for (int i = 0; i < ALineSize - 1; ++i) {
-        const auto idx = calib.phaseCalib[i].idx;
-        const auto unit = calib.phaseCalib[idx];
-        const auto l_coeff = unit.l_coeff;
-        const auto r_coeff = unit.r_coeff;
-        linearKFringe[i] =
-            alineBuf[idx] * l_coeff + alineBuf[idx + 1] * r_coeff;
-      }
+private:
+  size_t m_fftSize{};
+  // Output bins that may be non-zero
+  size_t m_written{};
+};
 
-      // 3. FFT
-      // Window
-      for (int i = 0; i < ALineSize; ++i) {
-        fftBuf.in[i] = win[i] * linearKFringe[i];
-      }
-      fft.forward(fftBuf.in, fftBuf.out);
+/**
+A-lines per TBB task, chosen so a task's fringe input and output rows fit in
+L2 alongside the thread's FFT scratch. Assumes 256 KB of L2 per core, the
+smallest on the machines we run on.
+ */
+template <Floating T>
+size_t reconGrainSize(size_t ALineSize, size_t fftSize, size_t imageDepth) {
+  constexpr size_t L2Bytes = size_t{256} << 10;
+  constexpr size_t maxGrain = 64;
+  const size_t scratchBytes = 2 * ALineSize * sizeof(T) +
+                              fftSize * sizeof(T) +
+                              (fftSize / 2 + 1) * sizeof(fftw::Complex<T>);
+  const size_t lineBytes =
+      ALineSize * sizeof(uint16_t) + imageDepth * sizeof(T);
+  const size_t avail = L2Bytes > scratchBytes ? L2Bytes - scratchBytes : 0;
+  return std::clamp<size_t>(avail / lineBytes, 1, maxGrain);
+}
 
-      // 4. Copy result into image
-      T *outptr = reinterpret_cast<T *>(mat.ptr(j));
-      logCompress<T>({outptr, imageDepth}, {fftBuf.out, ALineSize}, contrast,
-                     brightness);
+/**
+Working buffers reused across frames by one recon thread (e.g. ReconWorker).
+
+cv::Mat::create only reallocates when the geometry changes, so in steady state
+a frame is reconstructed without allocating image buffers. Also holds the
+previous frame for alignment.
+ */
+template <Floating T> struct ReconBuffers {
+  cv::Mat_<T> alines;    // nLines x imageDepth, one A-line per row
+  cv::Mat_<T> bscan;     // Transposed, imageDepth x nLines
+  cv::Mat_<T> corrected; // Distortion corrected, imageDepth x theoretical
+  cv::Mat_<T> prevBscan; // Previous frame for alignment
+
+  // Per split log power (see `logPower`) of the last split spectrum recon,
+  // nLines x (dBSplits * imageDepth). Kept so display only params can be
+  // re-applied without recon, see `mapALines`. dBSplits is 0 if stale.
+  cv::Mat_<T> dB;
+  int dBSplits{};
+
+  // Geometry found by the last `correctBscan`, reused when re-rendering
+  int distortionOffset{};
+  int shift{}; // Total circshift applied, including additionalOffset
+
+  cvMod::PhaseCorrWorkspace distortionWs;
+  cvMod::PhaseCorrWorkspace alignWs;
+
+  RadialMap radial;
+
+  // En-face row of the last frame, see `finishBscan`
+  EnFaceAccumulator enFace;
+  cv::Mat_<uint8_t> enFaceLine;
+
+  // Per TBB worker thread scratch, and the partitioner that replays the same
+  // task to thread mapping every frame so each thread's scratch stays hot.
+  tbb::enumerable_thread_specific<ReconScratch<T>> scratch;
+  tbb::affinity_partitioner partitioner;
+
+  // Hamming window of size `n`, recomputed only when `n` changes
+  const fftconv::AlignedVector<T> &hamming(size_t n) {
+    if (win.size() != n) {
+      win = getHamming<T>(static_cast<int>(n));
     }
-  });
+    return win;
+  }
 
-  mat = mat.t();
+private:
+  fftconv::AlignedVector<T> win;
+};
+
+/**
+Transpose the A-lines in `buf.alines` into a Bscan, correct distortion and
+align to the previous frame. The result is kept in `buf.prevBscan` for the
+next frame's alignment and for `finishBscan`.
+
+With `reuseGeometry`, the distortion offset and alignment shift found by the
+last call are reused instead of estimated, e.g. when the same frame is
+re-mapped with new display params.
+ */
+template <Floating T>
+void correctBscan(ReconBuffers<T> &buf, bool reuseGeometry = false) {
+  const int nLines = buf.alines.rows;
+  cv::transpose(buf.alines, buf.bscan);
+  cv::Mat_<T> *mat = &buf.bscan;
 
   // Distortion correction and resize to theoretical aline number
   {
-    TimeIt timeit;
-
-    size_t theoreticalALines = nLines;
-    if (nLines == 2500) {
-      // theoreticalALines = 2234;
-      // Don't need distortion correction for the ex vivo probe.
-    } else if (nLines == 2200) {
-      theoreticalALines = 2000;
-
-      const cv::Size targetSize(theoreticalALines, mat.rows);
-      const int distOffset =
-          getDistortionOffset(mat, theoreticalALines, nLines);
-      cv::resize(mat(cv::Rect(0, 0, theoreticalALines + distOffset, mat.rows)),
-                 mat, targetSize);
+    perf::ScopedProbe probe(perf::Stage::Distortion);
+
+    const int theoretical = theoreticalALines(nLines);
+    if (theoretical != nLines) {
+      const cv::Size targetSize(theoretical, buf.bscan.rows);
+      if (!reuseGeometry) {
+        buf.distortionOffset = getDistortionOffset(buf.bscan, theoretical,
+                                                   nLines, buf.distortionWs);
+      }
+      cv::resize(buf.bscan(cv::Rect(0, 0, theoretical + buf.distortionOffset,
+                                    buf.bscan.rows)),
+                 buf.corrected, targetSize);
+      mat = &buf.corrected;
     }
-
-    // fmt::println("Distortion correction elapsed: {} ms", timeit.get_ms());
   }
 
   // Align Bscans
   {
-    TimeIt timeit;
-    static cv::Mat_<T> prevMat;
-    if (prevMat.cols == mat.cols && prevMat.rows == mat.rows) {
-      int alignOffset = std::round(cvMod::phaseCorrelate(prevMat, mat).x);
-      circshift(mat, alignOffset + params.additionalOffset);
+    perf::ScopedProbe probe(perf::Stage::Align);
+    if (!reuseGeometry) {
+      buf.shift = 0;
+      if (buf.prevBscan.size() == mat->size()) {
+        buf.shift = static_cast<int>(std::round(
+            cvMod::phaseCorrelate(buf.prevBscan, *mat, buf.alignWs).x));
+      }
     }
-    mat.copyTo(prevMat);
+    if (buf.shift != 0) {
+      circshift(*mat, buf.shift);
+    }
+    mat->copyTo(buf.prevBscan);
+  }
+}
+
+/**
+Rotate the corrected Bscan by `additionalOffset` A-lines (kept for the next
+frame's alignment) and convert to 8 bit.
 
-    // fmt::println("Align correction elapsed: {} ms", timeit.get_ms());
+With `enFace`, also reduce the frame's depth band into `buf.enFaceLine`. The
+conversion then runs in strips of rows, and each strip's rows in the band
+are accumulated while they're still in L1.
+ */
+template <Floating T>
+void finishBscan(ReconBuffers<T> &buf, int additionalOffset,
+                 cv::Mat_<uint8_t> &out, const EnFaceParams *enFace = nullptr) {
+  if (additionalOffset != 0) {
+    circshift(buf.prevBscan, additionalOffset);
+    buf.shift += additionalOffset;
+  }
+  if (enFace == nullptr) {
+    buf.prevBscan.convertTo(out, CV_8U);
+    return;
+  }
+
+  constexpr int StripRows = 16;
+  const int rows = buf.prevBscan.rows;
+  out.create(rows, buf.prevBscan.cols);
+  const auto [begin, end] = enFace->band(rows);
+  buf.enFace.begin(out.cols);
+  for (int r0 = 0; r0 < rows; r0 += StripRows) {
+    const int r1 = std::min(r0 + StripRows, rows);
+    buf.prevBscan.rowRange(r0, r1).convertTo(out.rowRange(r0, r1), CV_8U);
+    for (int r = std::max(r0, begin); r < std::min(r1, end); ++r) {
+      buf.enFace.add(out[r]);
+    }
   }
+  buf.enFace.finish(enFace->mode, buf.enFaceLine);
+}
 
-  cv::Mat_<uint8_t> outmat;
-  mat.convertTo(outmat, CV_8U);
-  return mat;
+template <Floating T>
+void postprocessBscan(ReconBuffers<T> &buf, const OCTReconParams<T> &params,
+                      cv::Mat_<uint8_t> &out) {
+  correctBscan(buf);
+  finishBscan(buf, params.additionalOffset, out);
 }
 
 /**
-Split the `n` point sampled spectral fringe to `n_splits`, using size `n /
-n_splits` FFTs instead of size `n` FFTs, and average the result
+Original impl. without split spectrum
  */
 template <Floating T>
-[[nodiscard]] cv::Mat_<uint8_t> reconBscan_splitSpectrum(
-    const Calibration<T> &calib, const std::span<const uint16_t> fringe,
-    const size_t ALineSize, const OCTReconParams<T> &params = {}) {
+void reconBscan(const Calibration<T> &calib,
+                const std::span<const uint16_t> fringe, const size_t ALineSize,
+                const OCTReconParams<T> &params, ReconBuffers<T> &buf,
+                cv::Mat_<uint8_t> &out) {
 
   assert((fringe.size() % ALineSize) == 0);
   const auto nLines = fringe.size() / ALineSize;
 
+  const auto &win = buf.hamming(ALineSize);
+  const auto contrast = params.contrast;
+  const auto brightness = params.brightness;
+  const size_t imageDepth = params.imageDepth;
+
+  // cv::Mat constructor takes (height, width)
+  cv::Mat_<T> &mat = buf.alines;
+  mat.create(nLines, imageDepth);
+
+  const auto &fft = FFTWPlanner<T>::get().engine(ALineSize);
+
+  {
+    perf::ScopedProbe probe(perf::Stage::ReconALines);
+    const auto grain = reconGrainSize<T>(ALineSize, ALineSize, imageDepth);
+    tbb::blocked_range<size_t> range(0, nLines, grain);
+    const auto body = [&](const tbb::blocked_range<size_t> &range) {
+      auto &scratch = buf.scratch.local();
+      scratch.resize(ALineSize, imageDepth, ALineSize);
+      auto &fftBuf = *scratch.fftBuf;
+      auto &alineBuf = scratch.alineBuf;
+      auto &linearKFringe = scratch.linearKFringe;
+      auto &power = scratch.power;
+      const auto &interp = calib.interp;
+
+      for (size_t j = range.begin(); j < range.end(); ++j) {
+        const auto offset = j * ALineSize;
+
+        // 1. Subtract background
+        simd::subtractBackground<T>(fringe.data() + offset,
+                                    calib.background.data(), alineBuf.data(),
+                                    ALineSize);
+
+        // 2. Interpolate phase calibration data
+        simd::interpolate<T>(alineBuf.data(), interp.idx.data(),
+                             interp.lCoeff.data(), interp.rCoeff.data(),
+                             linearKFringe.data(), interp.idx.size());
+
+        // 3. FFT
+        // Window
+        simd::window<T>(linearKFringe.data(), win.data(), fftBuf.in,
+                        ALineSize);
+        fft.forward(fftBuf.in, fftBuf.out);
+
+        // 4. Copy result into image
+        simd::power<T>(reinterpret_cast<const T *>(fftBuf.out), power.data(),
+                       imageDepth);
+        T *outptr = reinterpret_cast<T *>(mat.ptr(j));
+        logCompress<T>({outptr, imageDepth}, power, ALineSize, contrast,
+                       brightness);
+      }
+    };
+    tbb::parallel_for(range, body, buf.partitioner);
+  }
+
+  buf.dBSplits = 0;
+  postprocessBscan(buf, params, out);
+}
+
+template <Floating T>
+[[nodiscard]] cv::Mat_<uint8_t>
+reconBscan(const Calibration<T> &calib, const std::span<const uint16_t> fringe,
+           const size_t ALineSize, const OCTReconParams<T> &params = {}) {
+  thread_local ReconBuffers<T> buf;
+  cv::Mat_<uint8_t> out;
+  reconBscan(calib, fringe, ALineSize, params, buf, out);
+  return out;
+}
+
+/**
+A-line stage of `reconBscan_splitSpectrum`: fringe to log compressed A-lines
+in `buf.alines`, keeping the per split log power in `buf.dB`.
+ */
+template <Floating T>
+void reconALines_splitSpectrum(const Calibration<T> &calib,
+                               const std::span<const uint16_t> fringe,
+                               const size_t ALineSize,
+                               const OCTReconParams<T> &params,
+                               ReconBuffers<T> &buf) {
+  assert((fringe.size() % ALineSize) == 0);
+  const auto nLines = fringe.size() / ALineSize;
   const size_t n_splits = params.n_splits;
   const size_t splitSize = ALineSize / n_splits;
 
-  const auto win = getHamming<T>(splitSize);
+  const auto &win = buf.hamming(splitSize);
   const auto contrast = params.contrast;
   const auto brightness = params.brightness;
   const size_t imageDepth = params.imageDepth;
 
   // cv::Mat constructor takes (height, width)
-  // std::vector<cv::Mat_<T>> mats(n_splits);
-  // for (int i_split = 0; i_split < n_splits; ++i_split) {
-  //   mats[i_split] = cv::Mat_<T>(nLines, imageDepth);
-  // }
-  cv::Mat_<T> mat = cv::Mat_<T>::zeros(nLines, imageDepth);
-
-  const auto &fft = fftw::EngineR2C1D<T>::get(splitSize);
-
-  tbb::blocked_range<size_t> range(0, nLines);
-  tbb::parallel_for(range, [&](const tbb::blocked_range<size_t> &range) {
-    fftw::R2CBuffer<T> fftBuf(ALineSize);
-    std::vector<T, tbb::scalable_allocator<T>> alineBuf(ALineSize);
-    std::vector<T, tbb::scalable_allocator<T>> linearKFringe(ALineSize);
+  cv::Mat_<T> &mat = buf.alines;
+  mat.create(nLines, imageDepth);
+  buf.dB.create(nLines, n_splits * imageDepth);
+  buf.dBSplits = static_cast<int>(n_splits);
+
+  const auto &fft = FFTWPlanner<T>::get().engine(splitSize);
+
+  perf::ScopedProbe probe(perf::Stage::ReconALines);
+  const auto grain = reconGrainSize<T>(ALineSize, splitSize, imageDepth);
+  tbb::blocked_range<size_t> range(0, nLines, grain);
+  const auto body = [&](const tbb::blocked_range<size_t> &range) {
+    auto &scratch = buf.scratch.local();
+    scratch.resize(ALineSize, imageDepth, splitSize);
+    auto &fftBuf = *scratch.fftBuf;
+    auto &alineBuf = scratch.alineBuf;
+    auto &linearKFringe = scratch.linearKFringe;
+    auto &power = scratch.power;
+    const auto &interp = calib.interp;
 
     for (size_t j = range.begin(); j < range.end(); ++j) {
       const auto offset = j * ALineSize;
 
       // 1. Subtract background
-      for (int i = 0; i < ALineSize; ++i) {
-        alineBuf[i] = fringe[offset + i] - calib.background[i];
-      }
+      simd::subtractBackground<T>(fringe.data() + offset,
+                                  calib.background.data(), alineBuf.data(),
+                                  ALineSize);
 
       // 2. Interpolate phase calibration data
-      for (int i = 0; i < ALineSize - 1; ++i) {
-        const auto idx = calib.phaseCalib[i].idx;
-        const auto unit = calib.phaseCalib[idx];
-        const auto l_coeff = unit.l_coeff;
-        const auto r_coeff = unit.r_coeff;
-        linearKFringe[i] =
-            alineBuf[idx] * l_coeff + alineBuf[idx + 1] * r_coeff;
-      }
+      simd::interpolate<T>(alineBuf.data(), interp.idx.data(),
+                           interp.lCoeff.data(), interp.rCoeff.data(),
+                           linearKFringe.data(), interp.idx.size());
 
-      for (int i_split = 0; i_split < n_splits; ++i_split) {
+      T *dBptr = buf.dB.ptr(j);
+      for (size_t i_split = 0; i_split < n_splits; ++i_split) {
         // 3. Windowed FFT over splits
-        const int offset = i_split * splitSize;
-        for (int i = 0; i < splitSize; ++i) {
-          fftBuf.in[i] = win[i] * linearKFringe[offset + i];
-        }
+        const size_t offset = i_split * splitSize;
+        simd::window<T>(linearKFringe.data() + offset, win.data(), fftBuf.in,
+                        splitSize);
         fft.forward(fftBuf.in, fftBuf.out);
 
-        // 4. Copy result into image
-        T *outptr = reinterpret_cast<T *>(mat.ptr(j));
-        logCompress_add<T>({outptr, imageDepth}, {fftBuf.out, splitSize},
-                           contrast, brightness, params.clearTop);
+        // 4. Log power of the split
+        simd::power<T>(reinterpret_cast<const T *>(fftBuf.out), power.data(),
+                       imageDepth);
+        logPower<T>({dBptr + i_split * imageDepth, imageDepth}, power,
+                    splitSize);
       }
+
+      // 5. Map into the image while the row is in cache
+      T *outptr = mat.ptr(j);
+      mapLogPower<T>({outptr, imageDepth}, dBptr, n_splits, contrast,
+                     brightness, params.clearTop);
     }
-  });
+  };
+  tbb::parallel_for(range, body, buf.partitioner);
+}
 
-  mat = mat.t();
+/**
+Split the `n` point sampled spectral fringe to `n_splits`, using size `n /
+n_splits` FFTs instead of size `n` FFTs, and average the result.
 
-  // Distortion correction and resize to theoretical aline number
-  {
-    TimeIt timeit;
-
-    size_t theoreticalALines = nLines;
-    if (nLines == 2500) {
-      // theoreticalALines = 2234;
-      // Don't need distortion correction for the ex vivo probe.
-    } else if (nLines == 2200) {
-      // Only use distortion correction for the proximal driven in vivo probe
-      theoreticalALines = 2000;
-
-      const cv::Size targetSize(theoreticalALines, mat.rows);
-      const int distOffset =
-          getDistortionOffset(mat, theoreticalALines, nLines);
-      cv::resize(mat(cv::Rect(0, 0, theoreticalALines + distOffset, mat.rows)),
-                 mat, targetSize);
-    }
+The result is written to `out`, reusing its storage and the working buffers
+in `buf` when the geometry hasn't changed.
+ */
+template <Floating T>
+void reconBscan_splitSpectrum(const Calibration<T> &calib,
+                              const std::span<const uint16_t> fringe,
+                              const size_t ALineSize,
+                              const OCTReconParams<T> &params,
+                              ReconBuffers<T> &buf, cv::Mat_<uint8_t> &out) {
+  reconALines_splitSpectrum(calib, fringe, ALineSize, params, buf);
+  postprocessBscan(buf, params, out);
+}
 
-    // fmt::println("Distortion correction elapsed: {} ms", timeit.get_ms());
+/**
+Map the log power kept in `buf.dB` by the last split spectrum A-line stage
+to `buf.alines` with the display params (contrast, brightness, clearTop),
+without FFTs. Returns false if `buf.dB` doesn't match `params` (imageDepth,
+n_splits), in which case the A-line stage must be rerun.
+ */
+template <Floating T>
+bool mapALines(ReconBuffers<T> &buf, const OCTReconParams<T> &params) {
+  const auto n_splits = static_cast<size_t>(buf.dBSplits);
+  const auto imageDepth = static_cast<size_t>(params.imageDepth);
+  if (n_splits == 0 || params.n_splits != buf.dBSplits ||
+      buf.dB.cols != static_cast<int>(n_splits * imageDepth)) {
+    return false;
   }
 
-  // Align Bscans
-  {
-    TimeIt timeit;
-    static cv::Mat_<T> prevMat;
-    if (prevMat.cols == mat.cols && prevMat.rows == mat.rows) {
-      int alignOffset = std::round(cvMod::phaseCorrelate(prevMat, mat).x);
-      circshift(mat, alignOffset + params.additionalOffset);
-    }
-    mat.copyTo(prevMat);
+  cv::Mat_<T> &mat = buf.alines;
+  mat.create(buf.dB.rows, static_cast<int>(imageDepth));
+  const auto contrast = static_cast<T>(params.contrast);
+  const auto brightness = static_cast<T>(params.brightness);
+  tbb::parallel_for(0, mat.rows, [&](int j) {
+    mapLogPower<T>({mat.ptr(j), imageDepth}, buf.dB.ptr(j), n_splits,
+                   contrast, brightness, params.clearTop);
+  });
+  return true;
+}
 
-    // fmt::println("Align correction elapsed: {} ms", timeit.get_ms());
-  }
+template <Floating T>
+[[nodiscard]] cv::Mat_<uint8_t> reconBscan_splitSpectrum(
+    const Calibration<T> &calib, const std::span<const uint16_t> fringe,
+    const size_t ALineSize, const OCTReconParams<T> &params = {}) {
+  thread_local ReconBuffers<T> buf;
+  cv::Mat_<uint8_t> out;
+  reconBscan_splitSpectrum(calib, fringe, ALineSize, params, buf, out);
+  return out;
+}
 
-  cv::Mat_<uint8_t> outmat;
-  mat.convertTo(outmat, CV_8U);
-  return mat;
+inline void makeRadialImage(const cv::Mat_<uint8_t> &in, cv::Mat_<uint8_t> &out,
+                            int padTop, RadialMap &map) {
+  map.update(in.size(), padTop);
+  map.apply(in, out);
 }
 
 inline void makeRadialImage(const cv::Mat_<uint8_t> &in, cv::Mat_<uint8_t> &out,
                             int padTop = 0) {
+  thread_local RadialMap map;
+  makeRadialImage(in, out, padTop, map);
+}
 
-  const int dim = std::min(in.rows, in.cols);
+/**
+Scrubbing preview settings, see `reconPreview`.
+ */
+struct PreviewParams {
+  // Use every `lineStep`th A-line of the frame
+  size_t lineStep{8};
+  // Use a `1 / fftDecimation` window of the spectrum, so a shorter FFT. The
+  // depth scale is unchanged (same sample spacing), the axial resolution is
+  // lower. Reduced if the FFT would be too short for `imageDepth`.
+  size_t fftDecimation{4};
+};
 
-  // const cv::Size dsize{dim, dim};
-  // const double radius = dim / 2;
-  // const cv::Point2f center(radius, radius);
+/**
+Fast, lower quality recon of the rect image for scrubbing through a sequence.
+
+`fringe` holds every `preview.lineStep`th A-line of a frame of `nLines`
+A-lines (see `DatFileReader::readDecimated`). Each A-line is reconstructed
+from the center `1 / preview.fftDecimation` of its spectrum with one FFT,
+then the image is upsampled to the full frame's rect geometry so the preview
+and the full quality frame display the same. There's no distortion
+estimation or alignment, and the buffers (and alignment state) of the full
+recon in `buf` are not touched if `buf` is a separate instance.
+ */
+template <Floating T>
+void reconPreviewRect(const Calibration<T> &calib,
+                      const std::span<const uint16_t> fringe,
+                      const size_t ALineSize, const size_t nLines,
+                      const OCTReconParams<T> &params,
+                      const PreviewParams &preview, ReconBuffers<T> &buf,
+                      cv::Mat_<uint8_t> &rect) {
+  assert((fringe.size() % ALineSize) == 0);
+  const auto nPreview = fringe.size() / ALineSize;
+  const size_t imageDepth = params.imageDepth;
+  const size_t lineStep = std::max<size_t>(preview.lineStep, 1);
 
-  const cv::Size dsize{dim * 2, dim * 2};
-  const double radius = dim;
-  const auto radiusf = static_cast<float>(radius);
-  const cv::Point2f center(radiusf, radiusf);
+  // Same FFT sizes as the split spectrum recon, so the plans are warm
+  size_t decimation = std::max<size_t>(preview.fftDecimation, 1);
+  while (decimation > 1 && ALineSize / decimation < 2 * imageDepth) {
+    --decimation;
+  }
+  const size_t fftSize = ALineSize / decimation;
+  const size_t specOffset = (ALineSize - fftSize) / 2;
 
-  const int flags = cv::WARP_FILL_OUTLIERS + cv::WARP_INVERSE_MAP;
+  const auto &win = buf.hamming(fftSize);
+  const auto contrast = static_cast<T>(params.contrast);
+  const auto brightness = static_cast<T>(params.brightness);
+  // The split spectrum recon sums the splits, see `mapLogPower`
+  const auto nSplits = static_cast<T>(std::max(params.n_splits, 1));
 
-  if (padTop != 0) {
-    cv::copyMakeBorder(in, out, padTop, 0, 0, 0, cv::BORDER_CONSTANT);
-    cv::warpPolar(out.t(), out, dsize, center, radius,
-                  flags); // linear Polar, 3
-  } else {
-    cv::warpPolar(in.t(), out, dsize, center, radius,
-                  flags); // linear Polar, 3
+  cv::Mat_<T> &mat = buf.alines;
+  mat.create(static_cast<int>(nPreview), static_cast<int>(imageDepth));
+
+  const auto &fft = FFTWPlanner<T>::get().engine(fftSize);
+
+  {
+    perf::ScopedProbe probe(perf::Stage::Preview);
+    const auto grain = reconGrainSize<T>(ALineSize, fftSize, imageDepth);
+    tbb::blocked_range<size_t> range(0, nPreview, grain);
+    const auto body = [&](const tbb::blocked_range<size_t> &range) {
+      auto &scratch = buf.scratch.local();
+      scratch.resize(ALineSize, imageDepth, fftSize);
+      auto &fftBuf = *scratch.fftBuf;
+      auto &alineBuf = scratch.alineBuf;
+      auto &linearKFringe = scratch.linearKFringe;
+      auto &power = scratch.power;
+      const auto &interp = calib.interp;
+
+      for (size_t j = range.begin(); j < range.end(); ++j) {
+        simd::subtractBackground<T>(fringe.data() + j * ALineSize,
+                                    calib.background.data(), alineBuf.data(),
+                                    ALineSize);
+
+        // Only the samples in the spectral window are linearized
+        simd::interpolate<T>(alineBuf.data(), interp.idx.data() + specOffset,
+                             interp.lCoeff.data() + specOffset,
+                             interp.rCoeff.data() + specOffset,
+                             linearKFringe.data(), fftSize);
+
+        simd::window<T>(linearKFringe.data(), win.data(), fftBuf.in, fftSize);
+        fft.forward(fftBuf.in, fftBuf.out);
+
+        simd::power<T>(reinterpret_cast<const T *>(fftBuf.out), power.data(),
+                       imageDepth);
+        const std::span<T> dB{power.data(), imageDepth};
+        logPower<T>(dB, dB, fftSize);
+
+        T *outptr = mat.ptr(static_cast<int>(j));
+        mapLogPower<T>({outptr, imageDepth}, dB.data(), 1, contrast,
+                       brightness, params.clearTop);
+        for (size_t i = 0; i < imageDepth; ++i) {
+          outptr[i] *= nSplits;
+        }
+      }
+    };
+    tbb::parallel_for(range, body, buf.partitioner);
+
+    // Crop to the theoretical A-lines like the distortion correction (without
+    // estimating the offset) and upsample to the full rect geometry
+    cv::transpose(mat, buf.bscan);
+    const int theoretical = theoreticalALines(static_cast<int>(nLines));
+    const int cols = std::clamp<int>(
+        static_cast<int>((theoretical + lineStep - 1) / lineStep), 1,
+        buf.bscan.cols);
+    cv::resize(buf.bscan(cv::Rect(0, 0, cols, buf.bscan.rows)),
+               buf.corrected, cv::Size(theoretical, buf.bscan.rows), 0, 0,
+               cv::INTER_LINEAR);
+    buf.corrected.convertTo(rect, CV_8U);
   }
+}
 
-  cv::flip(out, out, 1);
+// `reconPreviewRect` and the radial image
+template <Floating T>
+void reconPreview(const Calibration<T> &calib,
+                  const std::span<const uint16_t> fringe,
+                  const size_t ALineSize, const size_t nLines,
+                  const OCTReconParams<T> &params,
+                  const PreviewParams &preview, ReconBuffers<T> &buf,
+                  cv::Mat_<uint8_t> &rect, cv::Mat_<uint8_t> &radial) {
+  reconPreviewRect(calib, fringe, ALineSize, nLines, params, preview, buf,
+                   rect);
+  perf::ScopedProbe probe(perf::Stage::Radial);
+  makeRadialImage(rect, radial, params.padTop, buf.radial);
 }
 
 } // namespace OCT
@@ -4,12 +4,15 @@
 #include "OCTRecon.hpp"
 #include <QGridLayout>
 #include <QLabel>
+#include <QSignalBlocker>
 #include <QSpinBox>
 #include <QWidget>
 
 namespace OCT {
 
 class OCTReconParamsController : public QWidget {
+  Q_OBJECT
+
 public:
   OCTReconParamsController() {
     auto *layout = new QGridLayout;
@@ -124,11 +127,17 @@ public:
 
   [[nodiscard]] auto params() const { return m_params; }
 
+  // Doesn't emit `paramsChanged`
   void clearOffset() {
     m_params.additionalOffset = 0;
+    QSignalBlocker blocker(m_offsetSpinbox);
     m_offsetSpinbox->setValue(0);
   }
 
+Q_SIGNALS:
+  // Any param changed from the GUI
+  void paramsChanged();
+
 private:
   OCTReconParams<Float> m_params{};
   std::vector<std::function<void()>> updateGuiFromParamsCallbacks;
@@ -141,7 +150,10 @@ private:
 
   QSpinBox *m_offsetSpinbox{};
 
-  void _paramsUpdatedInternal() { updateGuiFromParams(); }
+  void _paramsUpdatedInternal() {
+    updateGuiFromParams();
+    Q_EMIT paramsChanged();
+  }
 };
 
 } // namespace OCT
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <QFont>
+#include <QFontDatabase>
 #include <QGridLayout>
 #include <QHBoxLayout>
 #include <QLabel>
@@ -69,14 +71,22 @@ public:
   explicit ImageOverlay(QWidget *parent)
       : OverlayWidget(parent), m_sequence(new QLabel), m_filename(new QLabel),
         m_modality(new QLabel), m_progress(new QLabel), m_imageSize(new QLabel),
-        m_zoom(new QLabel) {
+        m_zoom(new QLabel), m_latency(new QLabel), m_stats(new QLabel) {
     topLeftLayout()->addWidget(m_sequence);
 
+    // Pipeline stats panel, hidden by default
+    m_stats->setFont(QFontDatabase::systemFont(QFontDatabase::FixedFont));
+    m_stats->setAlignment(Qt::AlignRight | Qt::AlignTop);
+    m_stats->hide();
+    topRightLayout()->addWidget(m_stats);
+
     bottomLeftLayout()->addWidget(m_modality);
     bottomLeftLayout()->addWidget(m_progress);
     bottomLeftLayout()->addWidget(m_imageSize);
 
+    bottomRightLayout()->addWidget(m_latency);
     bottomRightLayout()->addWidget(m_zoom);
+    m_latency->hide();
   }
 
 public Q_SLOTS:
@@ -99,6 +109,14 @@ public Q_SLOTS:
     m_zoom->setText(QString("Zoom: %1%").arg(static_cast<int>(zoom * 100)));
   }
 
+  // Live acquisition to display latency, only shown during acquisition
+  void setLatencyVisible(bool visible) { m_latency->setVisible(visible); }
+  void setLatency(const QString &latency) { m_latency->setText(latency); }
+
+  void setStatsVisible(bool visible) { m_stats->setVisible(visible); }
+  [[nodiscard]] bool statsVisible() const { return !m_stats->isHidden(); }
+  void setStats(const QString &stats) { m_stats->setText(stats); }
+
   void clear() {
     m_sequence->clear();
     m_modality->clear();
@@ -120,4 +138,8 @@ private:
 
   // Bottom right
   QLabel *m_zoom;
+  QLabel *m_latency;
+
+  // Top right
+  QLabel *m_stats;
 };
@@ -0,0 +1,276 @@
+#pragma once
+
+#include "Calibration.hpp"
+#include "Common.hpp"
+#include "FileIO.hpp"
+#include "FrameCache.hpp"
+#include "OCTRecon.hpp"
+#include "ReconPipeline.hpp"
+#include "Trace.hpp"
+#include "VolumeStore.hpp"
+#include <QObject>
+#include <QtLogging>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <fftconv/aligned_vector.hpp>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <oneapi/tbb/task_arena.h>
+#include <optional>
+#include <qdebug.h>
+#include <utility>
+
+/*
+Background pre-recon of the loaded sequence into a `FrameCache`.
+
+Frames are reconstructed outward from the current position (i, i+1, i-1,
+i+2, ...) until the sequence is done or the cache budget is full. Each
+direction has its own pipeline, so a frame is aligned to its neighbour
+towards the start position like in sequential playback. Frames already
+cached are skipped, and only serve as the alignment reference.
+
+Runs on its own thread, which MainWindow starts at idle priority, and the
+recon runs in a low priority TBB arena so interactive recon always wins.
+`restart` (new params, calibration or sequence) and `setCenter` cancel the
+current walk between frames.
+*/
+namespace OCT {
+
+class Prerenderer : public QObject {
+  Q_OBJECT
+
+public:
+  // Called on the pre-recon thread with each frame added to the cache
+  using FrameCallback =
+      std::function<void(size_t i, const cv::Mat_<uint8_t> &rect)>;
+
+  explicit Prerenderer(std::shared_ptr<FrameCache> cache,
+                       FrameCallback onFrame = {})
+      : m_cache(std::move(cache)), m_onFrame(std::move(onFrame)) {}
+
+Q_SIGNALS:
+  // `cached` of `total` frames are in the cache
+  void progress(size_t cached, size_t total);
+
+public Q_SLOTS:
+  void setShouldStop(bool shouldStop) {
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_shouldStop = shouldStop;
+    }
+    m_cv.notify_one();
+  }
+
+  /*
+  Drop the cache and pre-reconstruct `reader` with `calib` and `params`
+  from frame `center`. `params.additionalOffset` rotates the first frame,
+  the rest inherit it through alignment.
+
+  Frames are also written to `volume` (if not nullptr), and frames it
+  already has for these params are copied into the cache instead of
+  reconstructed.
+  */
+  void restart(const DatFileReader &reader,
+               std::shared_ptr<Calibration<Float>> calib,
+               const OCTReconParams<Float> &params, size_t center,
+               std::shared_ptr<VolumeStore> volume = {}) {
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      Job job;
+      job.reader = reader;
+      job.calib = std::move(calib);
+      job.params = params;
+      job.center = center;
+      job.epoch = m_cache->clear(reader.size());
+      job.volumeEpoch = volume ? volume->epoch() : 0;
+      job.volume = std::move(volume);
+      m_job = std::move(job);
+      ++m_jobId;
+    }
+    m_cache->setCenter(center);
+    m_cv.notify_one();
+    Q_EMIT progress(0, reader.size());
+  }
+
+  // Continue outward from frame `center`, keeping what's cached
+  void setCenter(size_t center) {
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      if (!m_job || m_job->center == center) {
+        return;
+      }
+      m_job->center = center;
+      m_job->params.additionalOffset = 0;
+      ++m_jobId;
+    }
+    m_cache->setCenter(center);
+    m_cv.notify_one();
+  }
+
+  // Stop pre-reconstructing (e.g. during live acquisition). The cache is
+  // kept until the next `restart`.
+  void cancel() {
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_job.reset();
+      ++m_jobId;
+    }
+    m_cv.notify_one();
+  }
+
+  void start() {
+    trace::setThreadName("Prerenderer");
+
+    while (true) {
+      Job job;
+      uint64_t jobId{};
+      {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cv.wait(lock, [this] {
+          return m_shouldStop || (m_job && m_jobId != m_doneJobId);
+        });
+        if (m_shouldStop) {
+          return;
+        }
+        job = *m_job;
+        jobId = m_jobId;
+      }
+
+      try {
+        run(job, jobId);
+      } catch (std::exception &e) {
+        qDebug() << "Exception in Prerenderer" << e.what();
+      }
+
+      std::unique_lock<std::mutex> lock(m_mutex);
+      if (m_jobId == jobId) {
+        m_doneJobId = jobId;
+      }
+    }
+  }
+
+private:
+  struct Job {
+    DatFileReader reader;
+    std::shared_ptr<Calibration<Float>> calib;
+    OCTReconParams<Float> params;
+    size_t center{};
+    uint64_t epoch{};
+    std::shared_ptr<VolumeStore> volume;
+    uint64_t volumeEpoch{};
+  };
+
+  std::shared_ptr<FrameCache> m_cache;
+  FrameCallback m_onFrame;
+
+  std::mutex m_mutex;
+  std::condition_variable m_cv;
+  std::optional<Job> m_job;
+  std::atomic<uint64_t> m_jobId{};
+  uint64_t m_doneJobId{};
+  bool m_shouldStop{false};
+
+  // Walking one direction from the center
+  struct Direction {
+    ReconPipeline<Float> pipeline;
+    // Cached frame to align the next recon to, set when frames are skipped
+    std::optional<size_t> reference;
+  };
+  Direction m_forward;
+  Direction m_backward;
+  fftconv::AlignedVector<uint16_t> m_fringe;
+
+  tbb::task_arena m_arena{tbb::task_arena::automatic, 1,
+                          tbb::task_arena::priority::low};
+
+  [[nodiscard]] bool cancelled(uint64_t jobId) const {
+    return m_jobId.load(std::memory_order_relaxed) != jobId;
+  }
+
+  // Reconstruct frame `i` into the cache (or copy it from the volume store),
+  // or skip it if it's cached. Returns false if it doesn't fit in the cache.
+  bool step(const Job &job, Direction &dir, size_t i,
+            const OCTReconParams<Float> &params) {
+    if (m_cache->contains(i)) {
+      dir.reference = i;
+      return true;
+    }
+    if (job.volume && job.volume->has(i)) {
+      dir.reference = i;
+      return insert(job, i, job.volume->frame(i));
+    }
+    if (dir.reference) {
+      cv::Mat_<uint8_t> ref;
+      if (m_cache->get(*dir.reference, ref)) {
+        dir.pipeline.setAlignmentReference(ref);
+      }
+      dir.reference.reset();
+    }
+
+    m_fringe.resize(job.reader.samplesPerFrame());
+    if (auto err = job.reader.read(i, 1, m_fringe)) {
+      qWarning() << "Pre-recon of frame" << i << "failed:" << err->c_str();
+      return false;
+    }
+
+    const ReconFrameKey key{i, job.reader.ALineSize(), job.calib->hash(),
+                            job.epoch};
+    m_arena.execute(
+        [&] { dir.pipeline.run(*job.calib, m_fringe, key, params); });
+    if (job.volume) {
+      job.volume->write(job.volumeEpoch, i, dir.pipeline.rect());
+    }
+    return insert(job, i, dir.pipeline.rect());
+  }
+
+  // Cache `rect` as frame `i` and pass it on to `m_onFrame`
+  bool insert(const Job &job, size_t i, const cv::Mat_<uint8_t> &rect) {
+    if (!m_cache->insert(job.epoch, i, rect)) {
+      return false;
+    }
+    if (m_onFrame) {
+      m_onFrame(i, rect);
+    }
+    return true;
+  }
+
+  void run(const Job &job, uint64_t jobId) {
+    const auto n = job.reader.size();
+    if (job.calib == nullptr || job.center >= n ||
+        job.calib->ALineSize() != job.reader.ALineSize()) {
+      return;
+    }
+    for (auto *dir : {&m_forward, &m_backward}) {
+      dir->pipeline.invalidate();
+      dir->pipeline.setAlignmentReference({});
+      dir->reference.reset();
+    }
+
+    // Both directions start from the center frame
+    auto params = job.params;
+    if (!step(job, m_forward, job.center, params)) {
+      return;
+    }
+    params.additionalOffset = 0;
+    m_backward.reference = job.center;
+
+    bool forward = true;
+    bool backward = true;
+    for (size_t d = 1; (forward || backward) && !cancelled(jobId); ++d) {
+      forward = forward && job.center + d < n &&
+                step(job, m_forward, job.center + d, params);
+      if (cancelled(jobId)) {
+        break;
+      }
+      backward = backward && d <= job.center &&
+                 step(job, m_backward, job.center - d, params);
+      Q_EMIT progress(m_cache->count(), n);
+    }
+    Q_EMIT progress(m_cache->count(), n);
+  }
+};
+
+} // namespace OCT
@@ -0,0 +1,209 @@
+#pragma once
+
+#include "Calibration.hpp"
+#include "Common.hpp"
+#include "Instrumentation.hpp"
+#include "OCTRecon.hpp"
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <opencv2/core.hpp>
+#include <optional>
+#include <span>
+#include <utility>
+
+/*
+Staged recon with per stage caching and lazy invalidation.
+
+The recon of a frame is a chain of stages whose outputs are kept in the
+pipeline. Each param is declared with the stage that first depends on it:
+
+  Stage    Work                                   Params
+  ALines   fringe to per split log power (FFTs)   imageDepth, n_splits
+  Map      log power to display values            contrast, brightness,
+                                                  clearTop
+  Correct  transpose, distortion, alignment       -
+  Shift    rotation, conversion to 8 bit,         additionalOffset
+           en-face row (see `setEnFace`)
+  Radial   polar to cartesian                     padTop
+
+A stage reruns if one of its params changed or an earlier stage reran, so
+e.g. padTop only redoes Radial and additionalOffset only Shift and Radial.
+Correct reuses the distortion and alignment it estimated for the frame
+unless ALines reran. A different frame (`ReconFrameKey`) reruns everything.
+*/
+namespace OCT {
+
+enum class ReconStage : uint8_t {
+  ALines = 0,
+  Map,
+  Correct,
+  Shift,
+  Radial,
+  Count
+};
+
+constexpr size_t ReconStageCount = static_cast<size_t>(ReconStage::Count);
+
+constexpr std::array<const char *, ReconStageCount> ReconStageNames{
+    "A-lines", "Map", "Correct", "Shift", "Radial"};
+
+template <Floating T> using ReconParamMember = int OCTReconParams<T>::*;
+
+// The stage that first depends on each param
+template <Floating T>
+inline constexpr std::array<std::pair<ReconParamMember<T>, ReconStage>, 7>
+    ReconParamStages{{
+        {&OCTReconParams<T>::imageDepth, ReconStage::ALines},
+        {&OCTReconParams<T>::n_splits, ReconStage::ALines},
+        {&OCTReconParams<T>::contrast, ReconStage::Map},
+        {&OCTReconParams<T>::brightness, ReconStage::Map},
+        {&OCTReconParams<T>::clearTop, ReconStage::Map},
+        {&OCTReconParams<T>::additionalOffset, ReconStage::Shift},
+        {&OCTReconParams<T>::padTop, ReconStage::Radial},
+    }};
+
+/*
+First stage with a param that differs between `cached` and `params`, or
+ReconStage::Count if none does. additionalOffset is a one-off rotation that
+is never cached (always 0 in `cached`), so any nonzero value is a change.
+*/
+template <Floating T>
+ReconStage firstStaleStage(const OCTReconParams<T> &cached,
+                           const OCTReconParams<T> &params) {
+  auto first = ReconStage::Count;
+  for (const auto &[member, stage] : ReconParamStages<T>) {
+    if (cached.*member != params.*member) {
+      first = std::min(first, stage);
+    }
+  }
+  return first;
+}
+
+// Identity of a frame's input: equal keys mean the same fringe
+struct ReconFrameKey {
+  size_t i{};
+  size_t ALineSize{};
+  uint64_t calibHash{};
+  // Bumped by the owner when the input changes, e.g. a new sequence
+  uint64_t generation{};
+
+  bool operator==(const ReconFrameKey &) const = default;
+};
+
+template <Floating T> class ReconPipeline {
+public:
+  /*
+  Reconstruct `fringe` into `rect()` and `radial()`. If `key` is the cached
+  frame, only the stages stale for `params` are rerun.
+  */
+  void run(const Calibration<T> &calib, std::span<const uint16_t> fringe,
+           const ReconFrameKey &key, const OCTReconParams<T> &params) {
+    const auto first = m_valid && key == m_key
+                           ? firstStaleStage(m_params, params)
+                           : ReconStage::ALines;
+    m_key = key;
+    runFrom(first, &calib, fringe, params);
+  }
+
+  /*
+  Rerun the stale stages of the cached frame for `params`. Returns false
+  (and does nothing) if there's no cached frame or the A-line stage is
+  stale, which needs the fringe.
+  */
+  bool rerun(const OCTReconParams<T> &params) {
+    const auto first = firstStaleStage(m_params, params);
+    if (!m_valid || first == ReconStage::ALines) {
+      return false;
+    }
+    runFrom(first, nullptr, {}, params);
+    return true;
+  }
+
+  // Drop the cached frame, e.g. when its input may have changed
+  void invalidate() { m_valid = false; }
+
+  // Align the next frame to `rect` (e.g. a neighbouring frame reconstructed
+  // elsewhere) instead of to the last frame run here
+  void setAlignmentReference(const cv::Mat_<uint8_t> &rect) {
+    rect.convertTo(m_buf.prevBscan, cv::DataType<T>::type);
+  }
+
+  // Also reduce each frame into an en-face row (see `finishBscan`), from the
+  // next time the Shift stage runs. std::nullopt turns it off.
+  void setEnFace(std::optional<EnFaceParams> params) { m_enFace = params; }
+
+  [[nodiscard]] bool valid() const { return m_valid; }
+  [[nodiscard]] const ReconFrameKey &key() const { return m_key; }
+  [[nodiscard]] const cv::Mat_<uint8_t> &rect() const { return m_rect; }
+  [[nodiscard]] const cv::Mat_<uint8_t> &radial() const { return m_radial; }
+  // En-face row of the frame, empty if `setEnFace` is off
+  [[nodiscard]] const cv::Mat_<uint8_t> &enFaceLine() const {
+    return m_buf.enFaceLine;
+  }
+
+  // Per stage cache hits (stage skipped) and misses (stage ran)
+  [[nodiscard]] const auto &stats() const { return m_stats; }
+
+private:
+  ReconBuffers<T> m_buf;
+  cv::Mat_<uint8_t> m_rect;
+  cv::Mat_<uint8_t> m_radial;
+  std::optional<EnFaceParams> m_enFace;
+
+  bool m_valid{false};
+  ReconFrameKey m_key;
+  // Params of the cached stage outputs
+  OCTReconParams<T> m_params;
+
+  std::array<perf::CacheCounter, ReconStageCount> m_stats;
+
+  void runFrom(ReconStage first, const Calibration<T> *calib,
+               std::span<const uint16_t> fringe,
+               const OCTReconParams<T> &params) {
+    const auto runs = [&](ReconStage stage) {
+      auto &counter = m_stats[static_cast<size_t>(stage)];
+      if (first <= stage) {
+        counter.miss();
+        return true;
+      }
+      counter.hit();
+      return false;
+    };
+
+    // The A-line kernel also maps (Map), see `reconALines_splitSpectrum`
+    m_valid = false;
+    const bool reranALines = runs(ReconStage::ALines);
+    if (reranALines) {
+      const auto ALineSize = m_key.ALineSize;
+      reconALines_splitSpectrum(*calib, fringe, ALineSize, params, m_buf);
+    }
+    if (runs(ReconStage::Map) && !reranALines) {
+      perf::ScopedProbe probe(perf::Stage::Rerender);
+      if (!mapALines(m_buf, params)) {
+        return;
+      }
+    }
+    if (runs(ReconStage::Correct)) {
+      correctBscan(m_buf, !reranALines);
+    }
+    if (runs(ReconStage::Shift)) {
+      finishBscan(m_buf, params.additionalOffset, m_rect,
+                  m_enFace ? &*m_enFace : nullptr);
+      if (!m_enFace) {
+        m_buf.enFaceLine.release();
+      }
+    }
+    if (runs(ReconStage::Radial)) {
+      perf::ScopedProbe probe(perf::Stage::Radial);
+      makeRadialImage(m_rect, m_radial, params.padTop, m_buf.radial);
+    }
+
+    m_params = params;
+    m_params.additionalOffset = 0;
+    m_valid = true;
+  }
+};
+
+} // namespace OCT
@@ -1,17 +1,28 @@
 #pragma once
 
+#include "BroadcastRing.hpp"
 #include "Common.hpp"
+#include "EnFace.hpp"
 #include "ExportSettings.hpp"
 #include "ImageDisplay.hpp"
+#include "ImageExport.hpp"
+#include "Instrumentation.hpp"
+#include "LModeView.hpp"
 #include "OCTData.hpp"
 #include "OCTRecon.hpp"
+#include "ReconPipeline.hpp"
 #include "RingBuffer.hpp"
+#include "Trace.hpp"
+#include "VolumeStore.hpp"
 #include <QImage>
 #include <QObject>
 #include <QPixmap>
 #include <QtLogging>
 #include <atomic>
+#include <chrono>
 #include <cstddef>
+#include <mutex>
+#include <optional>
 #include <qdebug.h>
 #include <utility>
 
@@ -47,15 +58,86 @@ public Q_SLOTS:
   void setShouldStop(bool shouldStop) { this->shouldStop = shouldStop; }
 
   void setParams(OCTReconParams<Float> params) { m_params = params; }
+  void setPreviewParams(PreviewParams params) { m_previewParams = params; }
+
+  // The input of frame indices seen so far changed (e.g. a new sequence),
+  // so the cached stages of the last frame can't be reused.
+  void invalidateCache() { ++m_generation; }
+
+  // Per stage cache hits and misses, readable from any thread
+  [[nodiscard]] const auto &stageStats() const { return m_pipeline.stats(); }
+
+  // Re-render the last reconstructed frame with `params` from the cached
+  // stages (see `ReconPipeline::rerun`). The worker picks the request up
+  // between frames; only the latest request is kept, so slider drags
+  // coalesce.
+  void requestRerender(OCTReconParams<Float> params) {
+    {
+      std::unique_lock<std::mutex> lock(m_rerenderMutex);
+      m_rerenderParams = params;
+      m_rerenderRequestedAt = std::chrono::steady_clock::now();
+    }
+    m_rerenderPending = true;
+    m_ringBuffer->interrupt();
+  }
   void setExportSettings(const ExportSettings &settings) {
     m_exportSettings = settings;
   }
 
+  /*
+  En-face map of the sequence (see `EnFaceMap`), drawn below the rect image
+  in the combined image. std::nullopt turns it off. Picked up with the next
+  frame, like `resetEnFace`.
+  */
+  void setEnFaceParams(std::optional<EnFaceParams> params) {
+    std::unique_lock<std::mutex> lock(m_enFaceMutex);
+    m_enFaceRequest.params = params;
+    m_enFaceRequest.paramsChanged = true;
+  }
+  // Clear the en-face map for a new sequence of `nFrames` (0 if unknown)
+  void resetEnFace(size_t nFrames) {
+    std::unique_lock<std::mutex> lock(m_enFaceMutex);
+    m_enFaceRequest.reset = nFrames;
+  }
+
+  // Fully reconstructed frames of the loaded sequence are also written to
+  // `volume` (see `VolumeStore`), nullptr for none
+  void setVolumeStore(std::shared_ptr<VolumeStore> volume) {
+    std::unique_lock<std::mutex> lock(m_volumeMutex);
+    m_volume = std::move(volume);
+  }
+
+  // Fully reconstructed frames are also added to `view`. Must be called
+  // before `start`.
+  void setLModeView(LModeView *view) { m_lmodeView = view; }
+
+  // Saved images are queued to `writer` (see `ImageWriterPool`). Must be
+  // called before `start`.
+  void setImageWriter(std::shared_ptr<ImageWriterPool> writer) {
+    m_imageWriter = std::move(writer);
+  }
+
   // Set to true during live acquisition, and turn off when not live.
-  void setNoBlockMode(bool noBlock) { noBlockMode = noBlock; }
+  // Wakes the worker so it switches between the playback ring and live ring.
+  void setNoBlockMode(bool noBlock) {
+    noBlockMode = noBlock;
+    m_ringBuffer->interrupt();
+    if (m_liveRing != nullptr) {
+      m_liveRing->interrupt(m_liveConsumer);
+    }
+  }
+
+  // Live frames from the DAQ are displayed as a latest-only consumer of
+  // `ring`. Must be called before `start`.
+  void setLiveRing(std::shared_ptr<BroadcastRing<OCTData<Float>>> ring) {
+    m_liveRing = std::move(ring);
+    m_liveConsumer =
+        m_liveRing->addConsumer("Display", ConsumerPolicy::LatestOnly);
+  }
 
   void start() {
     assert(m_ringBuffer != nullptr);
+    trace::setThreadName("ReconWorker");
 
     const auto consumeFunc = [this](std::shared_ptr<OCTData<Float>> &dat) {
       try {
@@ -69,37 +151,61 @@ public Q_SLOTS:
           return;
         }
 
-        TimeIt timeit;
+        // Producers tag frames with their A-line size, which can change
+        // between sequences (see `SweptSources`)
+        const auto frameALineSize =
+            dat->ALineSize != 0 ? dat->ALineSize : ALineSize;
+        if (m_calib->ALineSize() != frameALineSize) {
+          Q_EMIT statusMessage(QString::fromStdString(fmt::format(
+              "Calibration is for {} samples per A-line but the frame has {}. "
+              "Please load a matching calibration.",
+              m_calib->ALineSize(), frameALineSize)));
+          return;
+        }
+
+        applyEnFaceRequest();
+        if (dat->cached) {
+          showCached(*dat);
+          return;
+        }
+        if (dat->previewLineStep != 0) {
+          preview(*dat, frameALineSize);
+          return;
+        }
+
+        perf::ScopedProbe probeTotal(perf::Stage::Total);
+        // The epoch before recon, so a frame made with params that changed
+        // meanwhile is rejected
+        const auto volume = noBlockMode ? nullptr : volumeStore();
+        const auto volumeEpoch = volume ? volume->epoch() : 0;
         float elapsedRecon{};
         {
           TimeIt timeitRecon;
-          dat->imgRect = reconBscan_splitSpectrum<Float>(*m_calib, dat->fringe,
-                                                         ALineSize, m_params);
+          // Live frame indices restart with every acquisition
+          if (noBlockMode) {
+            m_pipeline.invalidate();
+          }
+          const ReconFrameKey key{dat->i, frameALineSize, m_calib->hash(),
+                                  m_generation};
+          m_pipeline.run(*m_calib, dat->fringe, key, m_params);
+          m_pipeline.rect().copyTo(dat->imgRect);
+          m_pipeline.radial().copyTo(dat->imgRadial);
           elapsedRecon = timeitRecon.get_ms();
         }
-
-        float elapsedRadial{};
-        {
-          TimeIt timeit;
-          makeRadialImage(dat->imgRect, dat->imgRadial, m_params.padTop);
-          elapsedRadial = timeit.get_ms();
-        }
+        m_rerendered.i = dat->i;
+        addToLMode(*dat);
+        m_enFaceMap.setRow(dat->i, m_pipeline.enFaceLine());
+        writeVolume(volume.get(), volumeEpoch, *dat);
 
         if (m_exportSettings.saveImages) {
+          perf::ScopedProbe probe(perf::Stage::Export);
           exportImages(*dat);
         }
 
-        makeCombinedImage(*dat);
-
-        // Update image display
-        const QPixmap combinedPixmap = matToQPixmap(dat->imgCombined);
-        QMetaObject::invokeMethod(m_imageDisplay, &ImageDisplay::imshow,
-                                  combinedPixmap);
-        QMetaObject::invokeMethod(m_imageDisplay->overlay(),
-                                  &ImageOverlay::setProgress, dat->i, -1);
+        display(*dat);
 
         // Status message
-        const auto elapsedTotal = timeit.get_ms();
+        const auto elapsedTotal = probeTotal.get_ms();
         const auto msg =
             fmt::format("Loaded frame {}, recon {:.3f} ms, total {:.3f} ms",
                         dat->i, elapsedRecon, elapsedTotal);
@@ -110,30 +216,61 @@ public Q_SLOTS:
     };
 
     while (!shouldStop) {
-      if (noBlockMode) {
-        m_ringBuffer->consume_head(consumeFunc);
+      if (m_rerenderPending.exchange(false) && !noBlockMode) {
+        rerender();
+      }
+
+      if (noBlockMode && m_liveRing != nullptr) {
+        m_liveRing->consume(m_liveConsumer, consumeFunc);
+      } else if (noBlockMode) {
+        m_ringBuffer->consume_latest(consumeFunc);
       } else {
         m_ringBuffer->consume(consumeFunc);
       }
     }
   }
 
+  // Queue the images of `dat` to the writers. The ring buffer reuses them,
+  // so the writers get copies. Playback waits for room in the queue so
+  // every frame is saved; live drops rather than stall the display.
   void exportImages(const OCTData<Float> &dat) const {
+    if (m_imageWriter == nullptr) {
+      return;
+    }
+    const bool block = !noBlockMode;
+    m_imageWriter->submit(m_exportSettings.path("rect", dat.i),
+                          dat.imgRect.clone(), m_exportSettings, block);
+    m_imageWriter->submit(m_exportSettings.path("radial", dat.i),
+                          dat.imgRadial.clone(), m_exportSettings, block);
+  }
+
+  // Combine, convert and show `dat` in the image display
+  void display(OCTData<Float> &dat) {
     {
-      auto outpath =
-          m_exportSettings.exportDir / fmt::format("rect-{:03}.tiff", dat.i);
-      cv::imwrite(outpath.string(), dat.imgRect);
+      perf::ScopedProbe probe(perf::Stage::Combine);
+      makeCombinedImage(dat, m_enFaceParams ? &m_enFaceMap : nullptr);
     }
+
+    QPixmap combinedPixmap;
     {
-      auto outpath =
-          m_exportSettings.exportDir / fmt::format("radial-{:03}.tiff", dat.i);
-      cv::imwrite(outpath.string(), dat.imgRadial);
+      perf::ScopedProbe probe(perf::Stage::Pixmap);
+      combinedPixmap = matToQPixmap(dat.imgCombined);
     }
+    QMetaObject::invokeMethod(m_imageDisplay,
+                              [imageDisplay = m_imageDisplay, combinedPixmap,
+                               acquiredAt = dat.acquiredAt]() {
+                                imageDisplay->imshow(combinedPixmap,
+                                                     acquiredAt);
+                              });
+    QMetaObject::invokeMethod(m_imageDisplay->overlay(),
+                              &ImageOverlay::setProgress, dat.i, -1);
   }
 
-  static void makeCombinedImage(OCTData<Float> &dat) {
-    dat.imgCombined = cv::Mat_<uint8_t>(dat.imgRadial.rows,
-                                        dat.imgRadial.cols + dat.imgRect.cols);
+  // With `enFace`, the map is drawn below the rect image
+  static void makeCombinedImage(OCTData<Float> &dat,
+                                const EnFaceMap *enFace = nullptr) {
+    dat.imgCombined.create(dat.imgRadial.rows,
+                           dat.imgRadial.cols + dat.imgRect.cols);
 
     // Copy radial to left side
     dat.imgRadial.copyTo(dat.imgCombined(
@@ -143,24 +280,175 @@ public Q_SLOTS:
     dat.imgRect.copyTo(dat.imgCombined(
         cv::Rect(dat.imgRadial.cols, 0, dat.imgRect.cols, dat.imgRect.rows)));
 
-    // Clear bottom right
-    dat.imgCombined(cv::Rect(dat.imgRadial.cols, dat.imgRect.rows,
-                             dat.imgRect.cols,
-                             dat.imgCombined.rows - dat.imgRect.rows))
-        .setTo(0);
+    // En-face map or clear bottom right
+    auto bottomRight = dat.imgCombined(
+        cv::Rect(dat.imgRadial.cols, dat.imgRect.rows, dat.imgRect.cols,
+                 dat.imgCombined.rows - dat.imgRect.rows));
+    if (enFace != nullptr) {
+      enFace->render(bottomRight);
+    } else {
+      bottomRight.setTo(0);
+    }
   }
 
 private:
   std::atomic<bool> shouldStop{false};
   std::atomic<bool> noBlockMode{false};
 
+  std::atomic<bool> m_rerenderPending{false};
+  std::mutex m_rerenderMutex;
+  OCTReconParams<Float> m_rerenderParams;
+  std::chrono::steady_clock::time_point m_rerenderRequestedAt;
+  // Images of the last frame re-rendered. The ring slot of the original may
+  // already be reused by the producer.
+  OCTData<Float> m_rerendered;
+
+  // Scrubbing preview. Separate buffers, so the full recon's stage cache and
+  // alignment state are kept.
+  PreviewParams m_previewParams;
+  ReconBuffers<Float> m_previewBuf;
+
+  void preview(OCTData<Float> &dat, size_t frameALineSize) {
+    TimeIt timeit;
+    const auto nPreview = (dat.linesPerFrame + dat.previewLineStep - 1) /
+                          dat.previewLineStep;
+    const std::span<const uint16_t> fringe{dat.fringe.data(),
+                                           nPreview * frameALineSize};
+    auto previewParams = m_previewParams;
+    previewParams.lineStep = dat.previewLineStep;
+    reconPreview(*m_calib, fringe, frameALineSize, dat.linesPerFrame,
+                 m_params, previewParams, m_previewBuf, dat.imgRect,
+                 dat.imgRadial);
+    const auto elapsedRecon = timeit.get_ms();
+
+    display(dat);
+
+    const auto msg = fmt::format("Preview frame {}, recon {:.3f} ms", dat.i,
+                                 elapsedRecon);
+    Q_EMIT statusMessage(QString::fromStdString(msg));
+  }
+
+  // Pre-reconstructed frames only need the radial image, and the en-face row
+  // from the rect image
+  RadialMap m_cachedRadial;
+  EnFaceAccumulator m_cachedEnFace;
+  cv::Mat_<uint8_t> m_cachedEnFaceLine;
+
+  void showCached(OCTData<Float> &dat) {
+    TimeIt timeit;
+    {
+      perf::ScopedProbe probe(perf::Stage::Radial);
+      makeRadialImage(dat.imgRect, dat.imgRadial, m_params.padTop,
+                      m_cachedRadial);
+    }
+    addToLMode(dat);
+    if (m_enFaceParams) {
+      reduceEnFace(dat.imgRect, *m_enFaceParams, m_cachedEnFace,
+                   m_cachedEnFaceLine);
+      m_enFaceMap.setRow(dat.i, m_cachedEnFaceLine);
+    }
+    if (m_exportSettings.saveImages) {
+      perf::ScopedProbe probe(perf::Stage::Export);
+      exportImages(dat);
+    }
+    display(dat);
+
+    const auto msg = fmt::format("Loaded frame {} from the cache, {:.3f} ms",
+                                 dat.i, timeit.get_ms());
+    Q_EMIT statusMessage(QString::fromStdString(msg));
+  }
+
+  void rerender() {
+    OCTReconParams<Float> params;
+    auto &dat = m_rerendered;
+    {
+      std::unique_lock<std::mutex> lock(m_rerenderMutex);
+      params = m_rerenderParams;
+      dat.acquiredAt = m_rerenderRequestedAt;
+    }
+
+    const auto volume = volumeStore();
+    const auto volumeEpoch = volume ? volume->epoch() : 0;
+    TimeIt timeit;
+    if (!m_pipeline.rerun(params)) {
+      return;
+    }
+    m_pipeline.rect().copyTo(dat.imgRect);
+    m_pipeline.radial().copyTo(dat.imgRadial);
+    addToLMode(dat);
+    writeVolume(volume.get(), volumeEpoch, dat);
+    m_enFaceMap.setRow(dat.i, m_pipeline.enFaceLine());
+    display(dat);
+
+    const auto msg = fmt::format("Re-rendered frame {}, {:.3f} ms", dat.i,
+                                 timeit.get_ms());
+    Q_EMIT statusMessage(QString::fromStdString(msg));
+  }
+
   std::shared_ptr<RingBuffer<OCTData<Float>>> m_ringBuffer;
+  std::shared_ptr<BroadcastRing<OCTData<Float>>> m_liveRing;
+  BroadcastRing<OCTData<Float>>::ConsumerId m_liveConsumer{};
   std::shared_ptr<Calibration<Float>> m_calib;
+  // For frames without an A-line size
   size_t ALineSize;
   OCTReconParams<Float> m_params;
   ExportSettings m_exportSettings;
+  std::shared_ptr<ImageWriterPool> m_imageWriter;
+
+  // Working buffers, alignment state and the stage cache of the last frame
+  ReconPipeline<Float> m_pipeline;
+  std::atomic<uint64_t> m_generation{};
+
+  // En-face map, owned by the worker thread. Requests from the GUI thread
+  // are applied between frames.
+  struct EnFaceRequest {
+    std::optional<EnFaceParams> params{EnFaceParams{}};
+    bool paramsChanged{true};
+    std::optional<size_t> reset;
+  };
+  std::mutex m_enFaceMutex;
+  EnFaceRequest m_enFaceRequest;
+  std::optional<EnFaceParams> m_enFaceParams;
+  EnFaceMap m_enFaceMap;
+
+  void applyEnFaceRequest() {
+    std::unique_lock<std::mutex> lock(m_enFaceMutex);
+    if (m_enFaceRequest.paramsChanged) {
+      m_enFaceParams = m_enFaceRequest.params;
+      m_pipeline.setEnFace(m_enFaceParams);
+      m_enFaceMap.clear();
+      m_enFaceRequest.paramsChanged = false;
+    }
+    if (m_enFaceRequest.reset) {
+      m_enFaceMap.reset(*m_enFaceRequest.reset);
+      m_enFaceRequest.reset.reset();
+    }
+  }
+
+  std::mutex m_volumeMutex;
+  std::shared_ptr<VolumeStore> m_volume;
+
+  std::shared_ptr<VolumeStore> volumeStore() {
+    std::unique_lock<std::mutex> lock(m_volumeMutex);
+    return m_volume;
+  }
+  static void writeVolume(VolumeStore *volume, uint64_t epoch,
+                          const OCTData<Float> &dat) {
+    if (volume != nullptr) {
+      perf::ScopedProbe probe(perf::Stage::Volume);
+      volume->write(epoch, dat.i, dat.imgRect);
+    }
+  }
 
   ImageDisplay *m_imageDisplay;
+  LModeView *m_lmodeView{};
+
+  void addToLMode(const OCTData<Float> &dat) {
+    if (m_lmodeView != nullptr) {
+      perf::ScopedProbe probe(perf::Stage::LMode);
+      m_lmodeView->addFrame(dat.i, dat.imgRect);
+    }
+  }
 };
 
 } // namespace OCT
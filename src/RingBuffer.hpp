@@ -1,30 +1,117 @@
 #pragma once
 
+#include "Trace.hpp"
 #include <QDebug>
-#include <array>
+#include <algorithm>
+#include <atomic>
 #include <condition_variable>
+#include <cstdint>
 #include <fftconv/aligned_vector.hpp>
+#include <memory>
 #include <mutex>
+#include <utility>
+#include <vector>
 
-// NOLINTNEXTLINE(*-numbers)
-template <typename T, size_t Size = 8> class RingBuffer {
+// What `RingBuffer::produce` does when the buffer is full
+enum class OverflowPolicy : uint8_t {
+  Block = 0,  // Wait for the consumer to free a slot
+  DropOldest, // Overwrite the oldest unconsumed frame
+  DropNewest, // Discard the frame being produced
+};
+
+/*
+Number of frames of `frameBytes` each that fit in `budgetBytes`, clamped to
+[MinCapacity, MaxCapacity]. Used to size buffers at runtime for the probe and
+acquisition mode in use instead of a fixed frame count.
+*/
+inline size_t ringCapacityForBudget(size_t budgetBytes, size_t frameBytes) {
+  constexpr size_t MinCapacity = 2;
+  constexpr size_t MaxCapacity = 64;
+  if (frameBytes == 0) {
+    return MinCapacity;
+  }
+  return std::clamp(budgetBytes / frameBytes, MinCapacity, MaxCapacity);
+}
+
+struct RingBufferStats {
+  size_t capacity{};
+  size_t occupancy{};
+  uint64_t produced{};
+  uint64_t consumed{};
+  // Frames overwritten by the producer before they were consumed
+  uint64_t overwritten{};
+  // Frames discarded by the producer because the buffer was full
+  uint64_t rejected{};
+  // Times the producer waited for a free slot
+  uint64_t blocked{};
+  // Frames skipped by `consume_latest` because a newer one was available
+  uint64_t superseded{};
+};
+
+template <typename T> class RingBuffer {
 public:
   using ValueType = std::shared_ptr<T>;
+  static constexpr size_t DefaultCapacity = 8;
 
-  RingBuffer() {
+  explicit RingBuffer(size_t capacity = DefaultCapacity,
+                      OverflowPolicy policy = OverflowPolicy::DropOldest)
+      : buffer(std::max<size_t>(capacity, 1)), policy(policy) {
     for (auto &val : buffer) {
       val = std::make_shared<T>();
     }
+    spare = std::make_shared<T>();
   };
 
+  [[nodiscard]] size_t capacity() const {
+    std::unique_lock<std::mutex> lock(mutex);
+    return buffer.size();
+  }
+
+  /*
+  Change the number of slots. Unconsumed frames are discarded (and counted as
+  overwritten); existing slot storage is kept. Must not be called from inside
+  a produce or consume function.
+  */
+  void resize(size_t capacity) {
+    std::unique_lock<std::mutex> lock(mutex);
+    capacity = std::max<size_t>(capacity, 1);
+    m_overwritten.fetch_add(size(), std::memory_order_relaxed);
+    buffer.resize(capacity);
+    for (auto &val : buffer) {
+      if (val == nullptr) {
+        val = std::make_shared<T>();
+      }
+    }
+    head = 0;
+    tail = 0;
+    full = false;
+    notFull.notify_all();
+  }
+
+  void setOverflowPolicy(OverflowPolicy policy) {
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      this->policy = policy;
+    }
+    notFull.notify_all();
+  }
+  [[nodiscard]] OverflowPolicy overflowPolicy() const {
+    std::unique_lock<std::mutex> lock(mutex);
+    return policy;
+  }
+
+  // Apply `func` to every slot, including the spare held by the consumer
   template <typename Func> void forEach(const Func &func) {
     for (auto &val : buffer) {
       func(val);
     }
+    func(spare);
   }
 
   void quit() {
     std::unique_lock<std::mutex> lock(mutex);
+    quitting = true;
+    notFull.notify_all();
     if (full) {
       tail = (tail + 1) % buffer.size();
     }
@@ -36,12 +123,44 @@ public:
   }
 
   // Add an element to the buffer. The `produceFunc` should take `T&` and write
-  // to it
-  template <typename Func> bool produce(const Func &produceFunc) {
+  // to it. When full, follows the overflow policy, except that Block drops
+  // the frame like DropNewest unless `block` (e.g. on the GUI thread, which
+  // must not wait on the consumer). Returns false if the frame was dropped or
+  // the buffer was quit while blocked.
+  template <typename Func>
+  bool produce(const Func &produceFunc, bool block = true) {
+    OCT::trace::Scope trace("Ring produce");
     std::unique_lock<std::mutex> lock(mutex);
     if (full) {
-      tail = (tail + 1) % buffer.size();
+      switch (policy) {
+      case OverflowPolicy::Block:
+        if (!block) {
+          m_rejected.fetch_add(1, std::memory_order_relaxed);
+          return false;
+        }
+        m_blocked.fetch_add(1, std::memory_order_relaxed);
+        notFull.wait(lock, [this]() {
+          return !full || quitting || policy != OverflowPolicy::Block;
+        });
+        if (quitting) {
+          return false;
+        }
+        if (full) {
+          // Policy changed while blocked
+          tail = (tail + 1) % buffer.size();
+          m_overwritten.fetch_add(1, std::memory_order_relaxed);
+        }
+        break;
+      case OverflowPolicy::DropNewest:
+        m_rejected.fetch_add(1, std::memory_order_relaxed);
+        return false;
+      case OverflowPolicy::DropOldest:
+        tail = (tail + 1) % buffer.size();
+        m_overwritten.fetch_add(1, std::memory_order_relaxed);
+        break;
+      }
     }
+    m_produced.fetch_add(1, std::memory_order_relaxed);
     // qDebug() << "Produce at head" << head;
     produceFunc(buffer[head]);
     head = (head + 1) % buffer.size();
@@ -50,32 +169,34 @@ public:
     return true;
   }
 
-  // Add an element to the buffer. The `produceFunc` should take `T&` and write
-  // to it
-  template <typename Func> bool produce_nolock(const Func &produceFunc) {
-    // std::unique_lock<std::mutex> lock(mutex);
-    if (full) {
-      tail = (tail + 1) % buffer.size();
-    }
-    // qDebug() << "Produce at head" << head;
-    produceFunc(buffer[head]);
-    head = (head + 1) % buffer.size();
-    full = head == tail;
-    notEmpty.notify_one();
-    return true;
-  }
+  /*
+  Consume the oldest frame. Like `consume_latest`, the slot is swapped with
+  the spare so `consumeFunc` runs without the lock, and producers (e.g. the
+  GUI thread) never wait on the consumer's work. Only one thread may consume.
 
-  // `consumeFunc` should take `const T&` and read the value
+  `consumeFunc` should take `T&` and read the value
+  */
   template <typename Func> void consume(const Func &consumeFunc) {
-    std::unique_lock<std::mutex> lock(mutex);
-    notEmpty.wait(lock, [this]() { return !empty(); });
-    if (empty()) {
-      return;
+    ValueType value;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      notEmpty.wait(lock, [this]() { return !empty() || interrupted; });
+      interrupted = false;
+      if (empty()) {
+        return;
+      }
+      if (buffer[tail] != nullptr) {
+        std::swap(buffer[tail], spare);
+        value = spare;
+      } // Else the quit sentinel
+      m_consumed.fetch_add(1, std::memory_order_relaxed);
+      tail = (tail + 1) % buffer.size();
+      full = false;
+      notFull.notify_one();
     }
-    // qDebug() << "Consume at tail" << tail;
-    consumeFunc(buffer[tail]);
-    tail = (tail + 1) % buffer.size();
-    full = false;
+
+    OCT::trace::Scope trace("Ring consume");
+    consumeFunc(value);
   }
 
   // `consumeFunc` should take `const T&` and read the value
@@ -85,10 +206,62 @@ public:
     if (empty()) {
       return;
     }
+    OCT::trace::Scope trace("Ring consume");
     // Consume at head - 1
     const auto prevHead = (head - 1 + buffer.size()) % buffer.size();
     // qDebug() << "Consume at prevHead" << prevHead;
     consumeFunc(buffer[prevHead]);
+    m_consumed.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  /*
+  Latest-value mailbox for live display. Blocks until at least one frame was
+  produced since the last call, then takes the newest one and marks all older
+  unconsumed frames as superseded.
+
+  The newest slot is swapped with a spare so the consumer has exclusive
+  ownership of it: `consumeFunc` runs without the lock and the producer can't
+  overwrite the frame mid-recon. Only one thread may call `consume_latest`.
+
+  `consumeFunc` should take `T&` and read the value
+  */
+  template <typename Func> void consume_latest(const Func &consumeFunc) {
+    ValueType latest;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      notEmpty.wait(lock, [this]() { return !empty() || interrupted; });
+      interrupted = false;
+      if (empty()) {
+        return;
+      }
+
+      const auto prevHead = (head - 1 + buffer.size()) % buffer.size();
+      m_superseded.fetch_add(size() - 1, std::memory_order_relaxed);
+      m_consumed.fetch_add(1, std::memory_order_relaxed);
+      tail = head;
+      full = false;
+      notFull.notify_one();
+
+      if (buffer[prevHead] == nullptr) {
+        // Quit sentinel, leave it in place
+        latest = nullptr;
+      } else {
+        std::swap(buffer[prevHead], spare);
+        latest = spare;
+      }
+    }
+
+    OCT::trace::Scope trace("Ring consume");
+    consumeFunc(latest);
+  }
+
+  // Wake a blocked consumer without consuming (e.g. to switch source)
+  void interrupt() {
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      interrupted = true;
+    }
+    notEmpty.notify_all();
   }
 
   bool empty() const { return (!full && (head == tail)); }
@@ -104,12 +277,37 @@ public:
     return buffer.size() + head - tail;
   }
 
+  RingBufferStats stats() const {
+    std::unique_lock<std::mutex> lock(mutex);
+    return {buffer.size(), size(), m_produced.load(std::memory_order_relaxed),
+            m_consumed.load(std::memory_order_relaxed),
+            m_overwritten.load(std::memory_order_relaxed),
+            m_rejected.load(std::memory_order_relaxed),
+            m_blocked.load(std::memory_order_relaxed),
+            m_superseded.load(std::memory_order_relaxed)};
+  }
+
 private:
-  std::array<ValueType, Size> buffer;
+  std::vector<ValueType> buffer;
   size_t head{0};
   size_t tail{0};
   bool full{false};
+  bool interrupted{false};
+  bool quitting{false};
+  OverflowPolicy policy;
+
+  // Owned by the consumer, swapped into the ring in exchange for the slot
+  // being consumed.
+  ValueType spare;
 
   mutable std::mutex mutex;
   std::condition_variable notEmpty;
+  std::condition_variable notFull;
+
+  std::atomic<uint64_t> m_produced{};
+  std::atomic<uint64_t> m_consumed{};
+  std::atomic<uint64_t> m_overwritten{};
+  std::atomic<uint64_t> m_rejected{};
+  std::atomic<uint64_t> m_blocked{};
+  std::atomic<uint64_t> m_superseded{};
 };
\ No newline at end of file
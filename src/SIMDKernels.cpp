@@ -0,0 +1,235 @@
+#include "SIMDKernels.hpp"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <fmt/format.h>
+#include <random>
+#include <vector>
+
+// OCTGUI_SIMD_X86 and OCTGUI_SIMD_NEON are defined by CMake when the
+// matching SIMDKernels_<isa>.cpp are built
+#if defined(OCTGUI_SIMD_X86) && defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace OCT::simd {
+
+namespace {
+
+const Kernels scalarKernels{
+    ISA::Scalar,
+    scalar::subtractBackground<float>,
+    scalar::interpolate<float>,
+    scalar::window<float>,
+    scalar::power<float>,
+    scalar::enFaceAccumulate,
+};
+
+#ifdef OCTGUI_SIMD_X86
+
+struct CPUFeatures {
+  bool sse42{};
+  bool avx2{};
+  bool avx512{};
+};
+
+CPUFeatures cpuFeatures() {
+  CPUFeatures f;
+#ifdef _MSC_VER
+  // NOLINTBEGIN(*-magic-numbers)
+  std::array<int, 4> regs{};
+  __cpuid(regs.data(), 0);
+  const int maxLeaf = regs[0];
+
+  __cpuid(regs.data(), 1);
+  f.sse42 = (regs[2] & (1 << 20)) != 0;
+  const bool osxsave = (regs[2] & (1 << 27)) != 0;
+  const bool fma = (regs[2] & (1 << 12)) != 0;
+  if (!osxsave || maxLeaf < 7) {
+    return f;
+  }
+
+  // The OS must save the YMM (and for AVX-512, the opmask and ZMM) state
+  const auto xcr0 = _xgetbv(0);
+  const bool ymm = (xcr0 & 0x6) == 0x6;
+  const bool zmm = (xcr0 & 0xE6) == 0xE6;
+
+  __cpuidex(regs.data(), 7, 0);
+  f.avx2 = ymm && fma && (regs[1] & (1 << 5)) != 0;
+  f.avx512 = zmm && (regs[1] & (1 << 16)) != 0;
+  // NOLINTEND(*-magic-numbers)
+#else
+  __builtin_cpu_init();
+  f.sse42 = __builtin_cpu_supports("sse4.2");
+  f.avx2 = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+  f.avx512 = __builtin_cpu_supports("avx512f");
+#endif
+  return f;
+}
+
+#endif
+
+} // namespace
+
+ISA detectISA() {
+#if defined(OCTGUI_SIMD_X86)
+  const auto f = cpuFeatures();
+  if (f.avx512) {
+    return ISA::AVX512;
+  }
+  if (f.avx2) {
+    return ISA::AVX2;
+  }
+  if (f.sse42) {
+    return ISA::SSE42;
+  }
+  return ISA::Scalar;
+#elif defined(OCTGUI_SIMD_NEON)
+  // NEON is baseline on arm64
+  return ISA::NEON;
+#else
+  return ISA::Scalar;
+#endif
+}
+
+const Kernels *kernelsFor(ISA isa) {
+  [[maybe_unused]] const auto best = detectISA();
+  switch (isa) {
+  case ISA::Scalar:
+    return &scalarKernels;
+#if defined(OCTGUI_SIMD_X86)
+  case ISA::SSE42:
+    return best >= ISA::SSE42 ? &sse42Kernels : nullptr;
+  case ISA::AVX2:
+    return best >= ISA::AVX2 ? &avx2Kernels : nullptr;
+  case ISA::AVX512:
+    return best >= ISA::AVX512 ? &avx512Kernels : nullptr;
+#elif defined(OCTGUI_SIMD_NEON)
+  case ISA::NEON:
+    return &neonKernels;
+#endif
+  default:
+    return nullptr;
+  }
+}
+
+const Kernels &kernels() {
+  static const Kernels &selected = *kernelsFor(detectISA());
+  return selected;
+}
+
+std::optional<std::string> checkKernels(ISA isa) {
+  const auto *k = kernelsFor(isa);
+  if (k == nullptr) {
+    return std::nullopt;
+  }
+  const auto &ref = scalarKernels;
+
+  // 0 to 4 AVX-512 vectors of every kernel, then odd sizes with long bodies
+  std::vector<size_t> sizes;
+  for (size_t n = 0; n <= 4 * 64 + 1; ++n) {
+    sizes.push_back(n);
+  }
+  for (const size_t n : {511, 1023, 1025, 3073, 6143}) {
+    sizes.push_back(n);
+  }
+
+  std::mt19937 rng(1); // NOLINT(*-msc51-cpp)
+  constexpr float Range = 1000.0F;
+  std::uniform_real_distribution<float> real(-Range, Range);
+  std::uniform_real_distribution<float> coeff(0.0F, 1.0F);
+  std::uniform_int_distribution<int> u8(0, 255);
+  std::uniform_int_distribution<int> u16(0, 65535);
+
+  // Relative to the result, or to the inputs' `scale` where the result can
+  // cancel (e.g. an FMA rounding once instead of twice)
+  const auto close = [](float a, float b, float scale) {
+    constexpr float RelTol = 1e-5F;
+    return std::abs(a - b) <=
+           RelTol * std::max({std::abs(a), std::abs(b), scale});
+  };
+  const auto compare = [&](const char *name, size_t n, const auto &got,
+                           const auto &want,
+                           float scale = 1.0F) -> std::optional<std::string> {
+    for (size_t i = 0; i < n; ++i) {
+      bool ok = false;
+      if constexpr (std::is_floating_point_v<
+                        typename std::decay_t<decltype(got)>::value_type>) {
+        ok = close(got[i], want[i], scale);
+      } else {
+        ok = got[i] == want[i];
+      }
+      if (!ok) {
+        return fmt::format("{} {}: n = {}, element {} is {}, expected {}",
+                           toString(isa), name, n, i, +got[i], +want[i]);
+      }
+    }
+    return std::nullopt;
+  };
+
+  for (const auto n : sizes) {
+    std::vector<uint16_t> raw(n);
+    std::vector<float> a(n + 1);
+    std::vector<float> b(n);
+    // Calibration like interpolation coefficients
+    std::vector<float> lCoeff(n);
+    std::vector<float> rCoeff(n);
+    std::vector<float> cx(2 * n);
+    std::vector<int32_t> idx(n);
+    std::vector<uint8_t> row(n);
+    for (size_t i = 0; i < n; ++i) {
+      raw[i] = static_cast<uint16_t>(u16(rng));
+      b[i] = real(rng);
+      cx[2 * i] = real(rng);
+      cx[2 * i + 1] = real(rng);
+      idx[i] = static_cast<int32_t>(rng() % n);
+      lCoeff[i] = coeff(rng);
+      rCoeff[i] = 1.0F - lCoeff[i];
+      row[i] = static_cast<uint8_t>(u8(rng));
+    }
+    for (auto &v : a) {
+      v = real(rng);
+    }
+
+    std::vector<float> got(n);
+    std::vector<float> want(n);
+    k->subtractBackground(raw.data(), b.data(), got.data(), n);
+    ref.subtractBackground(raw.data(), b.data(), want.data(), n);
+    if (auto err = compare("subtractBackground", n, got, want)) {
+      return err;
+    }
+    k->interpolate(a.data(), idx.data(), lCoeff.data(), rCoeff.data(),
+                   got.data(), n);
+    ref.interpolate(a.data(), idx.data(), lCoeff.data(), rCoeff.data(),
+                    want.data(), n);
+    if (auto err = compare("interpolate", n, got, want, Range)) {
+      return err;
+    }
+    k->window(a.data(), b.data(), got.data(), n);
+    ref.window(a.data(), b.data(), want.data(), n);
+    if (auto err = compare("window", n, got, want)) {
+      return err;
+    }
+    k->power(cx.data(), got.data(), n);
+    ref.power(cx.data(), want.data(), n);
+    if (auto err = compare("power", n, got, want)) {
+      return err;
+    }
+
+    std::vector<uint32_t> sumGot(n, 1000);
+    std::vector<uint32_t> sumWant(n, 1000);
+    std::vector<uint8_t> maxGot(row.rbegin(), row.rend());
+    std::vector<uint8_t> maxWant(maxGot);
+    k->enFaceAccumulate(row.data(), sumGot.data(), maxGot.data(), n);
+    ref.enFaceAccumulate(row.data(), sumWant.data(), maxWant.data(), n);
+    if (auto err = compare("enFaceAccumulate sum", n, sumGot, sumWant)) {
+      return err;
+    }
+    if (auto err = compare("enFaceAccumulate max", n, maxGot, maxWant)) {
+      return err;
+    }
+  }
+  return std::nullopt;
+}
+
+} // namespace OCT::simd
@@ -0,0 +1,172 @@
+#pragma once
+
+#include "Common.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <type_traits>
+
+/*
+Hand vectorized inner loops of the A-line recon, selected at runtime.
+
+Each instruction set has its own translation unit built with that ISA's
+compiler flags (SIMDKernels_<isa>.cpp). `kernels()` picks the best one the
+CPU supports on first use, so one binary runs on both the acquisition PCs
+and the analysis server. The scalar versions below are the reference
+implementation and the fallback (and the path for `double`).
+*/
+namespace OCT::simd {
+
+enum class ISA : uint8_t { Scalar = 0, SSE42, AVX2, AVX512, NEON };
+
+inline const char *toString(ISA isa) {
+  switch (isa) {
+  case ISA::Scalar:
+    return "Scalar";
+  case ISA::SSE42:
+    return "SSE4.2";
+  case ISA::AVX2:
+    return "AVX2";
+  case ISA::AVX512:
+    return "AVX-512";
+  case ISA::NEON:
+    return "NEON";
+  }
+  return "Unknown";
+}
+
+/*
+Scalar reference kernels, also the vector kernels' tails. They have internal
+linkage: each ISA translation unit compiles its own copy with its ISA flags,
+and a shared (weak) copy from the AVX2 or AVX-512 unit could otherwise be
+picked by the linker for the scalar path and fault on older CPUs.
+*/
+namespace scalar {
+
+// out[i] = in[i] - background[i]
+template <Floating T>
+static void subtractBackground(const uint16_t *in, const T *background,
+                               T *out, size_t n) {
+  for (size_t i = 0; i < n; ++i) {
+    out[i] = static_cast<T>(in[i]) - background[i];
+  }
+}
+
+// out[i] = in[idx[i]] * lCoeff[i] + in[idx[i] + 1] * rCoeff[i]
+template <Floating T>
+static void interpolate(const T *in, const int32_t *idx, const T *lCoeff,
+                        const T *rCoeff, T *out, size_t n) {
+  for (size_t i = 0; i < n; ++i) {
+    out[i] = in[idx[i]] * lCoeff[i] + in[idx[i] + 1] * rCoeff[i];
+  }
+}
+
+// out[i] = in[i] * win[i]
+template <Floating T>
+static void window(const T *in, const T *win, T *out, size_t n) {
+  for (size_t i = 0; i < n; ++i) {
+    out[i] = in[i] * win[i];
+  }
+}
+
+// out[i] = re^2 + im^2 of interleaved complex `cx`
+template <Floating T> static void power(const T *cx, T *out, size_t n) {
+  for (size_t i = 0; i < n; ++i) {
+    const T re = cx[2 * i];
+    const T im = cx[2 * i + 1];
+    out[i] = re * re + im * im;
+  }
+}
+
+// sum[i] += row[i], max[i] = max(max[i], row[i]). See `EnFaceAccumulator`.
+static inline void enFaceAccumulate(const uint8_t *row, uint32_t *sum,
+                                    uint8_t *max, size_t n) {
+  for (size_t i = 0; i < n; ++i) {
+    sum[i] += row[i];
+    max[i] = row[i] > max[i] ? row[i] : max[i];
+  }
+}
+
+} // namespace scalar
+
+// Kernel table for `float`, one per ISA
+struct Kernels {
+  ISA isa;
+  void (*subtractBackground)(const uint16_t *in, const float *background,
+                             float *out, size_t n);
+  void (*interpolate)(const float *in, const int32_t *idx,
+                      const float *lCoeff, const float *rCoeff, float *out,
+                      size_t n);
+  void (*window)(const float *in, const float *win, float *out, size_t n);
+  void (*power)(const float *cx, float *out, size_t n);
+  void (*enFaceAccumulate)(const uint8_t *row, uint32_t *sum, uint8_t *max,
+                           size_t n);
+};
+
+// Best ISA supported by this CPU (and compiled into this binary)
+ISA detectISA();
+
+// Kernels for `isa`, or nullptr if not compiled in or not supported
+const Kernels *kernelsFor(ISA isa);
+
+// Kernels for the detected ISA, selected once
+const Kernels &kernels();
+
+/*
+Check the kernels of `isa` against the scalar reference on random input, for
+every length up to a few vectors and some odd larger ones, so each vector
+body and tail is covered. Results may differ by rounding (e.g. FMA). Returns
+a description of the first mismatch, or nullopt if they match or `isa`
+isn't available.
+*/
+std::optional<std::string> checkKernels(ISA isa);
+
+// Per ISA tables, defined in SIMDKernels_<isa>.cpp
+extern const Kernels sse42Kernels;
+extern const Kernels avx2Kernels;
+extern const Kernels avx512Kernels;
+extern const Kernels neonKernels;
+
+/*
+Typed entry points used by recon. `float` goes through the runtime selected
+kernels, `double` through the scalar reference.
+*/
+template <Floating T>
+void subtractBackground(const uint16_t *in, const T *background, T *out,
+                        size_t n) {
+  if constexpr (std::is_same_v<T, float>) {
+    kernels().subtractBackground(in, background, out, n);
+  } else {
+    scalar::subtractBackground(in, background, out, n);
+  }
+}
+
+template <Floating T>
+void interpolate(const T *in, const int32_t *idx, const T *lCoeff,
+                 const T *rCoeff, T *out, size_t n) {
+  if constexpr (std::is_same_v<T, float>) {
+    kernels().interpolate(in, idx, lCoeff, rCoeff, out, n);
+  } else {
+    scalar::interpolate(in, idx, lCoeff, rCoeff, out, n);
+  }
+}
+
+template <Floating T>
+void window(const T *in, const T *win, T *out, size_t n) {
+  if constexpr (std::is_same_v<T, float>) {
+    kernels().window(in, win, out, n);
+  } else {
+    scalar::window(in, win, out, n);
+  }
+}
+
+template <Floating T> void power(const T *cx, T *out, size_t n) {
+  if constexpr (std::is_same_v<T, float>) {
+    kernels().power(cx, out, n);
+  } else {
+    scalar::power(cx, out, n);
+  }
+}
+
+} // namespace OCT::simd
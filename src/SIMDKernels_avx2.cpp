@@ -0,0 +1,97 @@
+// Built with AVX2 and FMA enabled, see CMakeLists.txt
+#include "SIMDKernels.hpp"
+#include <immintrin.h>
+
+// NOLINTBEGIN(*-pointer-arithmetic, *-reinterpret-cast)
+
+namespace OCT::simd {
+
+namespace {
+
+void subtractBackground(const uint16_t *in, const float *background,
+                        float *out, size_t n) {
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    const __m128i u16 =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i));
+    const __m256 val = _mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(u16));
+    _mm256_storeu_ps(out + i,
+                     _mm256_sub_ps(val, _mm256_loadu_ps(background + i)));
+  }
+  scalar::subtractBackground(in + i, background + i, out + i, n - i);
+}
+
+void interpolate(const float *in, const int32_t *idx, const float *lCoeff,
+                 const float *rCoeff, float *out, size_t n) {
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    const __m256i vidx =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(idx + i));
+    const __m256 l = _mm256_i32gather_ps(in, vidx, 4);
+    const __m256 r = _mm256_i32gather_ps(in + 1, vidx, 4);
+    const __m256 res =
+        _mm256_fmadd_ps(l, _mm256_loadu_ps(lCoeff + i),
+                        _mm256_mul_ps(r, _mm256_loadu_ps(rCoeff + i)));
+    _mm256_storeu_ps(out + i, res);
+  }
+  scalar::interpolate(in, idx + i, lCoeff + i, rCoeff + i, out + i, n - i);
+}
+
+void window(const float *in, const float *win, float *out, size_t n) {
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    _mm256_storeu_ps(out + i, _mm256_mul_ps(_mm256_loadu_ps(in + i),
+                                            _mm256_loadu_ps(win + i)));
+  }
+  scalar::window(in + i, win + i, out + i, n - i);
+}
+
+void power(const float *cx, float *out, size_t n) {
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    const __m256 a = _mm256_loadu_ps(cx + 2 * i);
+    const __m256 b = _mm256_loadu_ps(cx + 2 * i + 8);
+    // hadd works within 128 bit lanes: [a01 a23 b01 b23 | a45 a67 b45 b67]
+    const __m256 sum = _mm256_hadd_ps(_mm256_mul_ps(a, a), _mm256_mul_ps(b, b));
+    const __m256 res = _mm256_castpd_ps(_mm256_permute4x64_pd(
+        _mm256_castps_pd(sum), _MM_SHUFFLE(3, 1, 2, 0)));
+    _mm256_storeu_ps(out + i, res);
+  }
+  scalar::power(cx + 2 * i, out + i, n - i);
+}
+
+void enFaceAccumulate(const uint8_t *row, uint32_t *sum, uint8_t *max,
+                      size_t n) {
+  size_t i = 0;
+  for (; i + 32 <= n; i += 32) {
+    const __m256i v =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(row + i));
+    auto *pmax = reinterpret_cast<__m256i *>(max + i);
+    _mm256_storeu_si256(pmax, _mm256_max_epu8(v, _mm256_loadu_si256(pmax)));
+
+    // Widen 8 u8 at a time to u32 and accumulate
+    const __m128i lo = _mm256_castsi256_si128(v);
+    const __m128i hi = _mm256_extracti128_si256(v, 1);
+    auto *psum = reinterpret_cast<__m256i *>(sum + i);
+    const auto add = [](__m256i *p, __m128i u8) {
+      _mm256_storeu_si256(
+          p, _mm256_add_epi32(_mm256_loadu_si256(p), _mm256_cvtepu8_epi32(u8)));
+    };
+    add(psum, lo);
+    add(psum + 1, _mm_srli_si128(lo, 8));
+    add(psum + 2, hi);
+    add(psum + 3, _mm_srli_si128(hi, 8));
+  }
+  scalar::enFaceAccumulate(row + i, sum + i, max + i, n - i);
+}
+
+} // namespace
+
+const Kernels avx2Kernels{
+    ISA::AVX2, subtractBackground, interpolate, window, power,
+    enFaceAccumulate,
+};
+
+} // namespace OCT::simd
+
+// NOLINTEND(*-pointer-arithmetic, *-reinterpret-cast)
@@ -0,0 +1,93 @@
+// Built with AVX-512F enabled, see CMakeLists.txt
+#include "SIMDKernels.hpp"
+#include <immintrin.h>
+
+// NOLINTBEGIN(*-pointer-arithmetic, *-reinterpret-cast)
+
+namespace OCT::simd {
+
+namespace {
+
+void subtractBackground(const uint16_t *in, const float *background,
+                        float *out, size_t n) {
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    const __m256i u16 =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(in + i));
+    const __m512 val = _mm512_cvtepi32_ps(_mm512_cvtepu16_epi32(u16));
+    _mm512_storeu_ps(out + i,
+                     _mm512_sub_ps(val, _mm512_loadu_ps(background + i)));
+  }
+  scalar::subtractBackground(in + i, background + i, out + i, n - i);
+}
+
+void interpolate(const float *in, const int32_t *idx, const float *lCoeff,
+                 const float *rCoeff, float *out, size_t n) {
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    const __m512i vidx = _mm512_loadu_si512(idx + i);
+    const __m512 l = _mm512_i32gather_ps(vidx, in, 4);
+    const __m512 r = _mm512_i32gather_ps(vidx, in + 1, 4);
+    const __m512 res =
+        _mm512_fmadd_ps(l, _mm512_loadu_ps(lCoeff + i),
+                        _mm512_mul_ps(r, _mm512_loadu_ps(rCoeff + i)));
+    _mm512_storeu_ps(out + i, res);
+  }
+  scalar::interpolate(in, idx + i, lCoeff + i, rCoeff + i, out + i, n - i);
+}
+
+void window(const float *in, const float *win, float *out, size_t n) {
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    _mm512_storeu_ps(out + i, _mm512_mul_ps(_mm512_loadu_ps(in + i),
+                                            _mm512_loadu_ps(win + i)));
+  }
+  scalar::window(in + i, win + i, out + i, n - i);
+}
+
+void power(const float *cx, float *out, size_t n) {
+  // Deinterleave re/im of 16 complex values across two registers
+  // NOLINTBEGIN(*-magic-numbers)
+  const __m512i evens = _mm512_setr_epi32(0, 2, 4, 6, 8, 10, 12, 14, 16, 18,
+                                          20, 22, 24, 26, 28, 30);
+  const __m512i odds = _mm512_setr_epi32(1, 3, 5, 7, 9, 11, 13, 15, 17, 19,
+                                         21, 23, 25, 27, 29, 31);
+  // NOLINTEND(*-magic-numbers)
+
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    const __m512 a = _mm512_loadu_ps(cx + 2 * i);
+    const __m512 b = _mm512_loadu_ps(cx + 2 * i + 16);
+    const __m512 re = _mm512_permutex2var_ps(a, evens, b);
+    const __m512 im = _mm512_permutex2var_ps(a, odds, b);
+    _mm512_storeu_ps(out + i,
+                     _mm512_fmadd_ps(re, re, _mm512_mul_ps(im, im)));
+  }
+  scalar::power(cx + 2 * i, out + i, n - i);
+}
+
+// AVX-512F has no byte max (that's AVX-512BW), so max stays 128 bit
+void enFaceAccumulate(const uint8_t *row, uint32_t *sum, uint8_t *max,
+                      size_t n) {
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    const __m128i v =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(row + i));
+    auto *pmax = reinterpret_cast<__m128i *>(max + i);
+    _mm_storeu_si128(pmax, _mm_max_epu8(v, _mm_loadu_si128(pmax)));
+    _mm512_storeu_si512(sum + i, _mm512_add_epi32(_mm512_loadu_si512(sum + i),
+                                                  _mm512_cvtepu8_epi32(v)));
+  }
+  scalar::enFaceAccumulate(row + i, sum + i, max + i, n - i);
+}
+
+} // namespace
+
+const Kernels avx512Kernels{
+    ISA::AVX512, subtractBackground, interpolate, window, power,
+    enFaceAccumulate,
+};
+
+} // namespace OCT::simd
+
+// NOLINTEND(*-pointer-arithmetic, *-reinterpret-cast)
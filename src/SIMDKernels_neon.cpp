@@ -0,0 +1,88 @@
+// NEON is baseline on arm64, no extra flags needed
+#include "SIMDKernels.hpp"
+#include <arm_neon.h>
+
+// NOLINTBEGIN(*-pointer-arithmetic)
+
+namespace OCT::simd {
+
+namespace {
+
+void subtractBackground(const uint16_t *in, const float *background,
+                        float *out, size_t n) {
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    const uint16x8_t u16 = vld1q_u16(in + i);
+    const float32x4_t lo = vcvtq_f32_u32(vmovl_u16(vget_low_u16(u16)));
+    const float32x4_t hi = vcvtq_f32_u32(vmovl_u16(vget_high_u16(u16)));
+    vst1q_f32(out + i, vsubq_f32(lo, vld1q_f32(background + i)));
+    vst1q_f32(out + i + 4, vsubq_f32(hi, vld1q_f32(background + i + 4)));
+  }
+  scalar::subtractBackground(in + i, background + i, out + i, n - i);
+}
+
+// No gather on NEON, so only the multiply-add is vectorized
+void interpolate(const float *in, const int32_t *idx, const float *lCoeff,
+                 const float *rCoeff, float *out, size_t n) {
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    const float lArr[4] = {in[idx[i]], in[idx[i + 1]], in[idx[i + 2]],
+                           in[idx[i + 3]]};
+    const float rArr[4] = {in[idx[i] + 1], in[idx[i + 1] + 1],
+                           in[idx[i + 2] + 1], in[idx[i + 3] + 1]};
+    const float32x4_t res =
+        vfmaq_f32(vmulq_f32(vld1q_f32(rArr), vld1q_f32(rCoeff + i)),
+                  vld1q_f32(lArr), vld1q_f32(lCoeff + i));
+    vst1q_f32(out + i, res);
+  }
+  scalar::interpolate(in, idx + i, lCoeff + i, rCoeff + i, out + i, n - i);
+}
+
+void window(const float *in, const float *win, float *out, size_t n) {
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    vst1q_f32(out + i, vmulq_f32(vld1q_f32(in + i), vld1q_f32(win + i)));
+  }
+  scalar::window(in + i, win + i, out + i, n - i);
+}
+
+void power(const float *cx, float *out, size_t n) {
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    // Deinterleaving load: val[0] = re, val[1] = im
+    const float32x4x2_t c = vld2q_f32(cx + 2 * i);
+    vst1q_f32(out + i,
+              vfmaq_f32(vmulq_f32(c.val[1], c.val[1]), c.val[0], c.val[0]));
+  }
+  scalar::power(cx + 2 * i, out + i, n - i);
+}
+
+void enFaceAccumulate(const uint8_t *row, uint32_t *sum, uint8_t *max,
+                      size_t n) {
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    const uint8x16_t v = vld1q_u8(row + i);
+    vst1q_u8(max + i, vmaxq_u8(v, vld1q_u8(max + i)));
+
+    // Widen u8 to u16, then add-widen to u32
+    const uint16x8_t lo = vmovl_u8(vget_low_u8(v));
+    const uint16x8_t hi = vmovl_u8(vget_high_u8(v));
+    uint32_t *s = sum + i;
+    vst1q_u32(s, vaddw_u16(vld1q_u32(s), vget_low_u16(lo)));
+    vst1q_u32(s + 4, vaddw_u16(vld1q_u32(s + 4), vget_high_u16(lo)));
+    vst1q_u32(s + 8, vaddw_u16(vld1q_u32(s + 8), vget_low_u16(hi)));
+    vst1q_u32(s + 12, vaddw_u16(vld1q_u32(s + 12), vget_high_u16(hi)));
+  }
+  scalar::enFaceAccumulate(row + i, sum + i, max + i, n - i);
+}
+
+} // namespace
+
+const Kernels neonKernels{
+    ISA::NEON, subtractBackground, interpolate, window, power,
+    enFaceAccumulate,
+};
+
+} // namespace OCT::simd
+
+// NOLINTEND(*-pointer-arithmetic)
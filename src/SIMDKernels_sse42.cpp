@@ -0,0 +1,98 @@
+// Built with SSE4.2 enabled, see CMakeLists.txt
+#include "SIMDKernels.hpp"
+#include <immintrin.h>
+
+// NOLINTBEGIN(*-pointer-arithmetic, *-reinterpret-cast)
+
+namespace OCT::simd {
+
+namespace {
+
+void subtractBackground(const uint16_t *in, const float *background,
+                        float *out, size_t n) {
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    const __m128i u16 =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i));
+    const __m128 lo = _mm_cvtepi32_ps(_mm_cvtepu16_epi32(u16));
+    const __m128 hi =
+        _mm_cvtepi32_ps(_mm_cvtepu16_epi32(_mm_srli_si128(u16, 8)));
+    _mm_storeu_ps(out + i, _mm_sub_ps(lo, _mm_loadu_ps(background + i)));
+    _mm_storeu_ps(out + i + 4,
+                  _mm_sub_ps(hi, _mm_loadu_ps(background + i + 4)));
+  }
+  scalar::subtractBackground(in + i, background + i, out + i, n - i);
+}
+
+// No gather before AVX2, so only the multiply-add is vectorized
+void interpolate(const float *in, const int32_t *idx, const float *lCoeff,
+                 const float *rCoeff, float *out, size_t n) {
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    const __m128 l = _mm_setr_ps(in[idx[i]], in[idx[i + 1]], in[idx[i + 2]],
+                                 in[idx[i + 3]]);
+    const __m128 r = _mm_setr_ps(in[idx[i] + 1], in[idx[i + 1] + 1],
+                                 in[idx[i + 2] + 1], in[idx[i + 3] + 1]);
+    const __m128 res = _mm_add_ps(_mm_mul_ps(l, _mm_loadu_ps(lCoeff + i)),
+                                  _mm_mul_ps(r, _mm_loadu_ps(rCoeff + i)));
+    _mm_storeu_ps(out + i, res);
+  }
+  scalar::interpolate(in, idx + i, lCoeff + i, rCoeff + i, out + i, n - i);
+}
+
+void window(const float *in, const float *win, float *out, size_t n) {
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    _mm_storeu_ps(out + i,
+                  _mm_mul_ps(_mm_loadu_ps(in + i), _mm_loadu_ps(win + i)));
+  }
+  scalar::window(in + i, win + i, out + i, n - i);
+}
+
+void power(const float *cx, float *out, size_t n) {
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    const __m128 a = _mm_loadu_ps(cx + 2 * i);
+    const __m128 b = _mm_loadu_ps(cx + 2 * i + 4);
+    // [re0^2 + im0^2, re1^2 + im1^2, ...]
+    _mm_storeu_ps(out + i, _mm_hadd_ps(_mm_mul_ps(a, a), _mm_mul_ps(b, b)));
+  }
+  scalar::power(cx + 2 * i, out + i, n - i);
+}
+
+void enFaceAccumulate(const uint8_t *row, uint32_t *sum, uint8_t *max,
+                      size_t n) {
+  const __m128i zero = _mm_setzero_si128();
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    const __m128i v =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(row + i));
+    auto *pmax = reinterpret_cast<__m128i *>(max + i);
+    _mm_storeu_si128(pmax, _mm_max_epu8(v, _mm_loadu_si128(pmax)));
+
+    // Widen u8 to u16 to u32 and accumulate
+    const __m128i lo = _mm_unpacklo_epi8(v, zero);
+    const __m128i hi = _mm_unpackhi_epi8(v, zero);
+    auto *psum = reinterpret_cast<__m128i *>(sum + i);
+    _mm_storeu_si128(psum, _mm_add_epi32(_mm_loadu_si128(psum),
+                                         _mm_unpacklo_epi16(lo, zero)));
+    _mm_storeu_si128(psum + 1, _mm_add_epi32(_mm_loadu_si128(psum + 1),
+                                             _mm_unpackhi_epi16(lo, zero)));
+    _mm_storeu_si128(psum + 2, _mm_add_epi32(_mm_loadu_si128(psum + 2),
+                                             _mm_unpacklo_epi16(hi, zero)));
+    _mm_storeu_si128(psum + 3, _mm_add_epi32(_mm_loadu_si128(psum + 3),
+                                             _mm_unpackhi_epi16(hi, zero)));
+  }
+  scalar::enFaceAccumulate(row + i, sum + i, max + i, n - i);
+}
+
+} // namespace
+
+const Kernels sse42Kernels{
+    ISA::SSE42, subtractBackground, interpolate, window, power,
+    enFaceAccumulate,
+};
+
+} // namespace OCT::simd
+
+// NOLINTEND(*-pointer-arithmetic, *-reinterpret-cast)
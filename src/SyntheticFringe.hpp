@@ -0,0 +1,341 @@
+#pragma once
+
+#include "Calibration.hpp"
+#include "Common.hpp"
+#include "FileIO.hpp"
+#include "datetime.hpp"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <fftconv/aligned_vector.hpp>
+#include <filesystem>
+#include <fmt/format.h>
+#include <fstream>
+#include <memory>
+#include <numbers>
+#include <random>
+#include <span>
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+#include <vector>
+
+// NOLINTBEGIN(*-magic-numbers)
+
+namespace OCT {
+
+namespace fs = std::filesystem;
+
+/**
+Parameters of the synthetic catheter/tissue phantom.
+
+Depths are in pixels of the full-spectrum (n_splits = 1) rect image, i.e. a
+reflector at depth `z` produces `z` fringe cycles over one linear-k A-line.
+ */
+struct SyntheticFringeParams {
+  size_t ALineSize = 2048LL * 3;
+  size_t linesPerFrame = 2200;
+
+  // Rotation between consecutive frames in A-lines, to exercise alignment.
+  double rotationPerFrame = 37.0;
+
+  // Strength of the k-space nonlinearity of the synthetic calibration. 0 is
+  // linear in k. Must be in (-1, 1) so the sampling stays monotonic.
+  double kNonlinearity = 0.15;
+
+  // Background (reference arm) level and spectral envelope width
+  double backgroundLevel = 8000.0;
+  double envelopeWidth = 0.35; // Gaussian sigma as a fraction of ALineSize
+
+  // Catheter sheath (two interfaces, constant depth)
+  double sheathDepth = 60.0;
+  double sheathThickness = 12.0;
+  double sheathAmplitude = 300.0;
+
+  // Lumen wall
+  double lumenDepth = 220.0;
+  double lumenEccentricity = 70.0;
+  double lumenAmplitude = 250.0;
+
+  // Layered tissue below the lumen surface (offset from surface, amplitude)
+  std::vector<std::pair<double, double>> layers{
+      {35.0, 120.0}, {80.0, 70.0}, {150.0, 35.0}};
+
+  // Random scatterers in the tissue, attenuated with depth
+  int scatterersPerLine = 12;
+  double scattererAmplitude = 40.0;
+  double attenuationDepth = 180.0; // 1/e depth in pixels
+
+  // Shot noise: sigma = sqrt(signal / gain). 0 disables noise.
+  double shotNoiseGain = 4.0;
+
+  uint64_t seed = 0x0C7;
+};
+
+/**
+Generates physically plausible swept-source fringes for benchmarks and tests.
+
+Each A-line is the sum of cosines from discrete reflectors (sheath, lumen
+wall, tissue layers and scatterers), sampled on the same nonlinear k-grid that
+`reconBscan*` linearizes with the phase calibration, on top of a Gaussian
+swept-source background with shot noise. The output is deterministic for a
+given (seed, frame index) regardless of threading.
+ */
+template <Floating T> class SyntheticFringeGenerator {
+public:
+  using Tout = uint16_t;
+
+  // Generate fringes for a synthetic calibration (see `calibration()`).
+  explicit SyntheticFringeGenerator(SyntheticFringeParams params = {})
+      : m_params(std::move(params)) {
+    m_calib = makeCalibration(m_params);
+    buildKMap();
+  }
+
+  // Generate fringes that match an existing calibration. Falls back to a
+  // synthetic calibration if its size doesn't match `params.ALineSize`.
+  SyntheticFringeGenerator(std::shared_ptr<Calibration<T>> calib,
+                           SyntheticFringeParams params)
+      : m_params(std::move(params)), m_calib(std::move(calib)) {
+    if (m_calib == nullptr ||
+        m_calib->background.size() != m_params.ALineSize ||
+        m_calib->phaseCalib.size() != m_params.ALineSize) {
+      m_calib = makeCalibration(m_params);
+    }
+    buildKMap();
+  }
+
+  [[nodiscard]] const auto &params() const { return m_params; }
+  [[nodiscard]] auto calibration() const { return m_calib; }
+
+  [[nodiscard]] size_t samplesPerFrame() const {
+    return m_params.ALineSize * m_params.linesPerFrame;
+  }
+
+  /**
+  Build a calibration with a smooth k-space nonlinearity.
+
+  `reconBscan*` resamples linear-k sample i as
+    raw[idx] * calib[idx].l_coeff + raw[idx + 1] * calib[idx].r_coeff
+  with idx = calib[i].idx. Using nearest-neighbour coefficients (1, 0) for
+  every entry keeps the table self consistent under that double indexing.
+   */
+  static std::shared_ptr<Calibration<T>>
+  makeCalibration(const SyntheticFringeParams &params) {
+    const auto n = params.ALineSize;
+    const auto nf = static_cast<double>(n - 1);
+
+    fftconv::AlignedVector<phaseCalibUnit<T>> phaseCalib(n);
+    for (size_t i = 0; i < n; ++i) {
+      const double x = static_cast<double>(i) / nf;
+      const double pos = nf * (x + params.kNonlinearity * (x * x - x));
+      const auto idx = std::clamp<size_t>(std::lround(pos), 0, n - 2);
+      phaseCalib[i] = {idx, 1, 0};
+    }
+
+    fftconv::AlignedVector<T> background(n);
+    for (size_t i = 0; i < n; ++i) {
+      background[i] = static_cast<T>(envelope(params, i) *
+                                     params.backgroundLevel);
+    }
+
+    return std::make_shared<Calibration<T>>(std::move(background),
+                                            std::move(phaseCalib));
+  }
+
+  // Generate frame `frameIdx` into `dst`, which must hold `samplesPerFrame()`
+  void generate(size_t frameIdx, std::span<Tout> dst) const {
+    assert(dst.size() >= samplesPerFrame());
+    const auto nLines = m_params.linesPerFrame;
+
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, nLines),
+                      [&](const tbb::blocked_range<size_t> &range) {
+                        std::vector<double> linFringe(m_params.ALineSize);
+                        for (size_t j = range.begin(); j < range.end(); ++j) {
+                          generateALine(frameIdx, j, linFringe,
+                                        dst.subspan(j * m_params.ALineSize,
+                                                    m_params.ALineSize));
+                        }
+                      });
+  }
+
+  [[nodiscard]] fftconv::AlignedVector<Tout> generate(size_t frameIdx) const {
+    fftconv::AlignedVector<Tout> frame(samplesPerFrame());
+    generate(frameIdx, frame);
+    return frame;
+  }
+
+  /**
+  Write `nFrames` frames into a new .bin file in `dir` and return its path.
+  The file name follows the DAQ convention `OCT<datetime>_<linesPerFrame>.bin`
+  (with `_<ALineSize>` for non default sizes) so `DatFileReader::readBinFile`
+  can recover the frame size.
+   */
+  [[nodiscard]] fs::path writeBinFile(const fs::path &dir,
+                                      size_t nFrames) const {
+    fs::create_directories(dir);
+    const auto datetime = datetime::datetimeFormat("%Y%m%d%H%M%S");
+    const auto fname =
+        m_params.ALineSize == DatFileReader::DefaultALineSize
+            ? fmt::format("OCT{}_{}.bin", datetime, m_params.linesPerFrame)
+            : fmt::format("OCT{}_{}_{}.bin", datetime, m_params.linesPerFrame,
+                          m_params.ALineSize);
+    const auto path = dir / fname;
+
+    std::ofstream ofs(path, std::ios::binary);
+    fftconv::AlignedVector<Tout> frame(samplesPerFrame());
+    for (size_t i = 0; i < nFrames && ofs; ++i) {
+      generate(i, frame);
+      // NOLINTNEXTLINE(*-reinterpret-cast)
+      ofs.write(reinterpret_cast<const char *>(frame.data()),
+                static_cast<std::streamsize>(frame.size() * sizeof(Tout)));
+    }
+    return path;
+  }
+
+private:
+  SyntheticFringeParams m_params;
+  std::shared_ptr<Calibration<T>> m_calib;
+
+  // Fractional linear-k index of each raw sample
+  std::vector<double> m_kOfSample;
+
+  static double envelope(const SyntheticFringeParams &params, size_t i) {
+    const double n = static_cast<double>(params.ALineSize);
+    const double x = (static_cast<double>(i) - n / 2) /
+                     (params.envelopeWidth * n);
+    return std::exp(-0.5 * x * x);
+  }
+
+  // SplitMix64, used to derive an independent RNG stream per A-line
+  static uint64_t mix(uint64_t x) {
+    x += 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+  }
+
+  /*
+  Invert the calibration's resampling. Linear-k sample i is read from raw
+  position p_i (see `makeCalibration`), so raw sample s sits at linear-k index
+  k(s) = p^-1(s). Falls back to a linear k-grid if p isn't monotonic.
+  */
+  void buildKMap() {
+    const auto n = m_params.ALineSize;
+    const auto &pc = m_calib->phaseCalib;
+
+    std::vector<double> pos(n - 1);
+    for (size_t i = 0; i < n - 1; ++i) {
+      const auto idx = std::min(pc[i].idx, n - 2);
+      const auto &unit = pc[idx];
+      const double sum = unit.l_coeff + unit.r_coeff;
+      const double frac = sum != 0 ? unit.r_coeff / sum : 0.0;
+      pos[i] = static_cast<double>(idx) + frac;
+    }
+
+    m_kOfSample.resize(n);
+    if (!std::ranges::is_sorted(pos)) {
+      for (size_t s = 0; s < n; ++s) {
+        m_kOfSample[s] = static_cast<double>(s);
+      }
+      return;
+    }
+
+    for (size_t s = 0; s < n; ++s) {
+      const auto sd = static_cast<double>(s);
+      const auto it = std::ranges::lower_bound(pos, sd);
+      if (it == pos.begin()) {
+        m_kOfSample[s] = 0;
+      } else if (it == pos.end()) {
+        m_kOfSample[s] = static_cast<double>(n - 2);
+      } else {
+        const auto i1 = static_cast<size_t>(it - pos.begin());
+        const auto i0 = i1 - 1;
+        const double span = pos[i1] - pos[i0];
+        const double t = span > 0 ? (sd - pos[i0]) / span : 0.0;
+        m_kOfSample[s] = static_cast<double>(i0) + t;
+      }
+    }
+  }
+
+  void generateALine(size_t frameIdx, size_t lineIdx,
+                     std::vector<double> &linFringe,
+                     std::span<Tout> out) const {
+    const auto &p = m_params;
+    const auto n = p.ALineSize;
+    constexpr double twoPi = 2 * std::numbers::pi;
+
+    std::mt19937_64 rng(
+        mix(p.seed ^ mix(frameIdx * p.linesPerFrame + lineIdx)));
+
+    // Angle of this A-line, rotated by `rotationPerFrame` every frame
+    const double theta =
+        twoPi *
+        (static_cast<double>(lineIdx) +
+         p.rotationPerFrame * static_cast<double>(frameIdx)) /
+        static_cast<double>(p.linesPerFrame);
+
+    // Reflectors (depth in pixels, amplitude)
+    std::vector<std::pair<double, double>> reflectors;
+    reflectors.reserve(4 + p.layers.size() + p.scatterersPerLine);
+    reflectors.emplace_back(p.sheathDepth, p.sheathAmplitude);
+    reflectors.emplace_back(p.sheathDepth + p.sheathThickness,
+                            0.6 * p.sheathAmplitude);
+
+    const double surface = p.lumenDepth +
+                           p.lumenEccentricity * std::cos(theta - 0.7) +
+                           0.15 * p.lumenEccentricity * std::sin(3 * theta);
+    reflectors.emplace_back(surface, p.lumenAmplitude);
+    for (const auto &[offset, amp] : p.layers) {
+      reflectors.emplace_back(surface + offset, amp);
+    }
+
+    std::exponential_distribution<double> depthDist(1.0 / p.attenuationDepth);
+    std::uniform_real_distribution<double> ampDist(0.2, 1.0);
+    for (int k = 0; k < p.scatterersPerLine; ++k) {
+      const double d = depthDist(rng);
+      reflectors.emplace_back(surface + d,
+                              p.scattererAmplitude * ampDist(rng) *
+                                  std::exp(-d / p.attenuationDepth));
+    }
+
+    // Fringe on the linear k-grid. Rotate a phasor per reflector instead of
+    // calling cos() for every sample.
+    std::ranges::fill(linFringe, 0.0);
+    std::uniform_real_distribution<double> phaseDist(0, twoPi);
+    for (const auto &[depth, amp] : reflectors) {
+      const double w = twoPi * depth / static_cast<double>(n);
+      const double phi = phaseDist(rng);
+      const double cw = std::cos(w);
+      const double sw = std::sin(w);
+      double c = std::cos(phi);
+      double s = std::sin(phi);
+      for (size_t i = 0; i < n; ++i) {
+        linFringe[i] += amp * c;
+        const double c1 = c * cw - s * sw;
+        s = s * cw + c * sw;
+        c = c1;
+      }
+    }
+
+    // Resample onto the nonlinear raw grid, add background and shot noise
+    std::normal_distribution<double> noise(0.0, 1.0);
+    const auto &bg = m_calib->background;
+    for (size_t s = 0; s < n; ++s) {
+      const double k = m_kOfSample[s];
+      const auto i0 = std::min(static_cast<size_t>(k), n - 2);
+      const double t = k - static_cast<double>(i0);
+      const double f = linFringe[i0] * (1 - t) + linFringe[i0 + 1] * t;
+
+      double val = static_cast<double>(bg[s]) + envelope(p, s) * f;
+      if (p.shotNoiseGain > 0) {
+        val += std::sqrt(std::max(val, 0.0) / p.shotNoiseGain) * noise(rng);
+      }
+      out[s] = static_cast<Tout>(std::clamp(std::round(val), 0.0, 65535.0));
+    }
+  }
+};
+
+} // namespace OCT
+
+// NOLINTEND(*-magic-numbers)
@@ -0,0 +1,269 @@
+#pragma once
+
+#include "Calibration.hpp"
+#include "Common.hpp"
+#include "FileIO.hpp"
+#include "MappedFile.hpp"
+#include "OCTRecon.hpp"
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fftconv/aligned_vector.hpp>
+#include <filesystem>
+#include <fmt/format.h>
+#include <fstream>
+#include <oneapi/tbb/enumerable_thread_specific.h>
+#include <oneapi/tbb/parallel_for.h>
+#include <oneapi/tbb/task_arena.h>
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+/*
+Low resolution radial thumbnails of every frame of a sequence, for the frame
+slider.
+
+Thumbnails are made in parallel over frames from decimated A-lines (see
+`reconPreviewRect`), with the rect image shrunk before the polar transform,
+so a 400 frame pullback takes about as long as reading a fraction of it.
+They're stored next to the sequence in a sidecar file that is reused while
+the sequence, calibration and recon params are unchanged.
+
+Sidecar file (little endian):
+
+  ThumbFileHeader  64 bytes
+  thumbnails       uint8[nFrames][size][size]
+*/
+namespace OCT {
+
+struct ThumbnailParams {
+  // Square thumbnails of size x size pixels. Must be even.
+  int size{96};
+  PreviewParams preview{16, 4};
+};
+
+struct ThumbFileHeader {
+  static constexpr std::array<char, 8> Magic{'O', 'C', 'T', 'T',
+                                             'H', 'U', 'M', 'B'};
+  static constexpr uint32_t Version = 1;
+
+  std::array<char, 8> magic{Magic};
+  uint32_t version{Version};
+  uint32_t size{};
+  uint64_t nFrames{};
+  // Fingerprint of the inputs, see `thumbnailKey`
+  uint64_t key{};
+  // FNV-1a of the thumbnails
+  uint64_t hash{};
+  std::array<uint8_t, 24> reserved{};
+};
+static_assert(sizeof(ThumbFileHeader) == 64);
+
+/**
+Thumbnails of a sequence, stored as one strip of `count()` square images
+stacked vertically.
+ */
+class Thumbnails {
+public:
+  Thumbnails() = default;
+  Thumbnails(size_t nFrames, int size)
+      : m_size(size), m_strip(static_cast<int>(nFrames) * size, size) {}
+
+  [[nodiscard]] bool empty() const { return m_strip.empty(); }
+  [[nodiscard]] size_t count() const {
+    return m_size == 0 ? 0 : static_cast<size_t>(m_strip.rows / m_size);
+  }
+  [[nodiscard]] int size() const { return m_size; }
+
+  // View of thumbnail `i`
+  [[nodiscard]] cv::Mat_<uint8_t> at(size_t i) const {
+    return m_strip(cv::Rect(0, static_cast<int>(i) * m_size, m_size, m_size));
+  }
+
+  [[nodiscard]] const cv::Mat_<uint8_t> &strip() const { return m_strip; }
+  [[nodiscard]] cv::Mat_<uint8_t> &strip() { return m_strip; }
+  [[nodiscard]] std::span<const std::byte> bytes() const {
+    return {reinterpret_cast<const std::byte *>(m_strip.data), // NOLINT
+            m_strip.total()};
+  }
+
+private:
+  int m_size{};
+  cv::Mat_<uint8_t> m_strip;
+};
+
+// Sidecar file of the thumbnails of `reader`'s sequence
+inline fs::path thumbnailPath(const DatFileReader &reader) {
+  auto path = reader.files().front();
+  path += ".thumbs";
+  return path;
+}
+
+/**
+Fingerprint of everything the thumbnails of `reader` depend on: the data
+files (size and modification time), calibration and params.
+ */
+template <Floating T>
+uint64_t thumbnailKey(const DatFileReader &reader, const Calibration<T> &calib,
+                      const OCTReconParams<T> &params,
+                      const ThumbnailParams &thumbParams) {
+  std::vector<uint64_t> fields{
+      calib.hash(),
+      reader.ALineSize(),
+      reader.linesPerFrame(),
+      reader.size(),
+      static_cast<uint64_t>(params.imageDepth),
+      static_cast<uint64_t>(params.n_splits),
+      static_cast<uint64_t>(params.contrast),
+      static_cast<uint64_t>(params.brightness),
+      static_cast<uint64_t>(params.clearTop),
+      static_cast<uint64_t>(params.padTop),
+      static_cast<uint64_t>(thumbParams.size),
+      thumbParams.preview.lineStep,
+      thumbParams.preview.fftDecimation,
+  };
+  for (const auto &file : reader.files()) {
+    std::error_code ec;
+    fields.push_back(fs::file_size(file, ec));
+    fields.push_back(static_cast<uint64_t>(
+        fs::last_write_time(file, ec).time_since_epoch().count()));
+  }
+  return fnv1a(std::as_bytes(std::span(fields)));
+}
+
+// Returns std::nullopt if the file is missing, corrupt or for another key
+inline std::optional<Thumbnails> loadThumbnails(const fs::path &path,
+                                                uint64_t key) {
+  const MappedFile file(path);
+  if (!file.ok() || file.size() < sizeof(ThumbFileHeader)) {
+    return std::nullopt;
+  }
+
+  ThumbFileHeader header;
+  std::memcpy(&header, file.data(), sizeof(header));
+  const auto size = static_cast<size_t>(header.size);
+  if (header.magic != ThumbFileHeader::Magic ||
+      header.version != ThumbFileHeader::Version || header.key != key ||
+      file.size() != sizeof(header) + header.nFrames * size * size) {
+    return std::nullopt;
+  }
+
+  const auto payload = file.bytes().subspan(sizeof(header));
+  if (fnv1a(payload) != header.hash) {
+    return std::nullopt;
+  }
+
+  Thumbnails thumbs(header.nFrames, static_cast<int>(size));
+  std::memcpy(thumbs.strip().data, payload.data(), payload.size());
+  return thumbs;
+}
+
+inline std::optional<std::string> saveThumbnails(const fs::path &path,
+                                                 const Thumbnails &thumbs,
+                                                 uint64_t key) {
+  ThumbFileHeader header;
+  header.size = static_cast<uint32_t>(thumbs.size());
+  header.nFrames = thumbs.count();
+  header.key = key;
+  header.hash = fnv1a(thumbs.bytes());
+
+  auto tmpPath = path;
+  tmpPath += ".tmp";
+  {
+    std::ofstream ofs(tmpPath, std::ios::binary | std::ios::trunc);
+    // NOLINTBEGIN(*-reinterpret-cast)
+    ofs.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    ofs.write(reinterpret_cast<const char *>(thumbs.bytes().data()),
+              static_cast<std::streamsize>(thumbs.bytes().size()));
+    // NOLINTEND(*-reinterpret-cast)
+    if (!ofs) {
+      return fmt::format("Failed to write {}", tmpPath.string());
+    }
+  }
+
+  std::error_code ec;
+  fs::rename(tmpPath, path, ec);
+  if (ec) {
+    fs::remove(tmpPath, ec);
+    return fmt::format("Failed to rename {} to {}", tmpPath.string(),
+                       path.string());
+  }
+  return std::nullopt;
+}
+
+/**
+Make the thumbnails of every frame of `reader` into `thumbs`, in parallel
+over frames. Returns an error message on failure, or if `cancel` was set.
+ */
+template <Floating T>
+[[nodiscard]] std::optional<std::string>
+makeThumbnails(const DatFileReader &reader, const Calibration<T> &calib,
+               const OCTReconParams<T> &params,
+               const ThumbnailParams &thumbParams, Thumbnails &thumbs,
+               const std::atomic<bool> &cancel) {
+  const auto ALineSize = reader.ALineSize();
+  if (calib.ALineSize() != ALineSize) {
+    return "Calibration doesn't match the sequence's A-line size.";
+  }
+
+  const int size = thumbParams.size;
+  const auto lineStep = thumbParams.preview.lineStep;
+  thumbs = Thumbnails(reader.size(), size);
+
+  // The rect image is shrunk to (size, size / 2) so the radial image is
+  // size x size, with the top padding scaled to match
+  const cv::Size smallRect(size, size / 2);
+  const int padTop = params.padTop * smallRect.height / params.imageDepth;
+
+  struct Local {
+    ReconBuffers<T> buf;
+    fftconv::AlignedVector<uint16_t> fringe;
+    cv::Mat_<uint8_t> rect;
+    cv::Mat_<uint8_t> shrunk;
+    cv::Mat_<uint8_t> radial;
+  };
+  tbb::enumerable_thread_specific<Local> locals;
+  std::atomic<bool> failed{false};
+  std::string error;
+
+  const auto makeThumbnail = [&](size_t i) {
+    auto &local = locals.local();
+    local.fringe.resize(reader.decimatedLines(lineStep) * ALineSize);
+    if (auto err = reader.readDecimated(i, lineStep, local.fringe)) {
+      if (!failed.exchange(true)) {
+        error = *err;
+      }
+      return;
+    }
+
+    reconPreviewRect(calib, local.fringe, ALineSize, reader.linesPerFrame(),
+                     params, thumbParams.preview, local.buf, local.rect);
+    cv::resize(local.rect, local.shrunk, smallRect, 0, 0, cv::INTER_AREA);
+    makeRadialImage(local.shrunk, local.radial, padTop, local.buf.radial);
+    local.radial.copyTo(thumbs.at(i));
+  };
+
+  tbb::parallel_for(size_t{0}, reader.size(), [&](size_t i) {
+    if (cancel || failed) {
+      return;
+    }
+    // The recon's nested parallel loops must not steal another frame onto
+    // this thread while it's using its locals
+    tbb::this_task_arena::isolate([&] { makeThumbnail(i); });
+  });
+
+  if (failed) {
+    return error;
+  }
+  if (cancel) {
+    return "Cancelled";
+  }
+  return std::nullopt;
+}
+
+} // namespace OCT
@@ -0,0 +1,336 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <fmt/format.h>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+/*
+Opt-in timeline tracing of pipeline events, exported as Chrome Trace Event
+JSON (open in chrome://tracing or https://ui.perfetto.dev).
+
+Each thread appends to its own fixed-capacity buffer, so recording is a
+relaxed atomic load when disabled and a few stores when enabled. Buffers are
+owned by the Tracer and outlive their threads (TBB workers come and go). A
+thread gets one on its first event while tracing, never when only named,
+and the buffer of an exited thread is reused by a new one once its events
+have been written or dropped by the next `start`.
+*/
+namespace OCT::trace {
+
+namespace fs = std::filesystem;
+using Clock = std::chrono::steady_clock;
+
+struct Event {
+  const char *name;  // Must be a string literal (or otherwise outlive tracing)
+  int64_t ts;        // ns since trace start
+  int64_t dur;       // ns, for complete ('X') events
+  char phase;        // 'X' complete, 'i' instant
+};
+
+class ThreadBuffer {
+public:
+  static constexpr size_t Capacity = size_t{1} << 16;
+
+  explicit ThreadBuffer(uint32_t tid) : m_tid(tid), m_events(Capacity) {}
+
+  void push(const Event &event) noexcept {
+    const auto n = m_size.load(std::memory_order_relaxed);
+    if (n < Capacity) {
+      m_events[n] = event;
+      m_size.store(n + 1, std::memory_order_release);
+    } else {
+      m_dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+
+  void clear() noexcept {
+    m_size.store(0, std::memory_order_relaxed);
+    m_dropped.store(0, std::memory_order_relaxed);
+  }
+
+  [[nodiscard]] uint32_t tid() const { return m_tid; }
+  [[nodiscard]] size_t size() const {
+    return m_size.load(std::memory_order_acquire);
+  }
+  [[nodiscard]] uint64_t dropped() const {
+    return m_dropped.load(std::memory_order_relaxed);
+  }
+  [[nodiscard]] const Event &operator[](size_t i) const { return m_events[i]; }
+
+  // Set by the owning thread, read after tracing stops
+  std::string name;
+
+private:
+  uint32_t m_tid;
+  std::vector<Event> m_events;
+  std::atomic<size_t> m_size{};
+  std::atomic<uint64_t> m_dropped{};
+};
+
+class Tracer {
+public:
+  static Tracer &get() {
+    static Tracer tracer;
+    return tracer;
+  }
+
+  [[nodiscard]] bool enabled() const noexcept {
+    return m_enabled.load(std::memory_order_relaxed);
+  }
+
+  void start() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    recycle();
+    for (auto &buf : m_buffers) {
+      buf->clear();
+    }
+    m_epoch.store(toNs(Clock::now()), std::memory_order_relaxed);
+    m_enabled.store(true, std::memory_order_release);
+  }
+
+  // Stop tracing and write all events to `path`. Returns false if the file
+  // couldn't be written.
+  bool stop(const fs::path &path) {
+    m_enabled.store(false, std::memory_order_release);
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    std::ofstream ofs(path);
+    if (!ofs.is_open()) {
+      return false;
+    }
+
+    ofs << R"({"displayTimeUnit":"ms","traceEvents":[)";
+    bool first = true;
+    const auto sep = [&]() -> const char * {
+      const char *s = first ? "\n" : ",\n";
+      first = false;
+      return s;
+    };
+
+    for (const auto &buf : m_buffers) {
+      if (buf->size() == 0 && buf->dropped() == 0) {
+        continue; // Free, or a thread with nothing to show
+      }
+      const auto name = buf->name.empty()
+                            ? fmt::format("Thread {}", buf->tid())
+                            : buf->name;
+      ofs << sep()
+          << fmt::format(R"({{"ph":"M","pid":1,"tid":{},"name":"thread_name",)"
+                         R"("args":{{"name":"{}"}}}})",
+                         buf->tid(), escape(name));
+      if (buf->dropped() > 0) {
+        ofs << sep()
+            << fmt::format(R"({{"ph":"i","s":"t","pid":1,"tid":{},"ts":0,)"
+                           R"("name":"{} events dropped, buffer full"}})",
+                           buf->tid(), buf->dropped());
+      }
+
+      const auto n = buf->size();
+      for (size_t i = 0; i < n; ++i) {
+        const auto &e = (*buf)[i];
+        // NOLINTBEGIN(*-magic-numbers)
+        if (e.phase == 'X') {
+          ofs << sep()
+              << fmt::format(R"({{"ph":"X","pid":1,"tid":{},"ts":{:.3f},)"
+                             R"("dur":{:.3f},"name":"{}"}})",
+                             buf->tid(), e.ts * 1e-3, e.dur * 1e-3,
+                             escape(e.name));
+        } else {
+          ofs << sep()
+              << fmt::format(R"({{"ph":"i","s":"t","pid":1,"tid":{},)"
+                             R"("ts":{:.3f},"name":"{}"}})",
+                             buf->tid(), e.ts * 1e-3, escape(e.name));
+        }
+        // NOLINTEND(*-magic-numbers)
+      }
+    }
+    ofs << "\n]}\n";
+    recycle();
+    return !ofs.fail();
+  }
+
+  // Buffer of the calling thread, created or recycled on first use. nullptr
+  // if it couldn't be allocated.
+  ThreadBuffer *threadBuffer() noexcept {
+    auto &slot = threadSlot();
+    if (slot.buf == nullptr) {
+      try {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (m_free.empty()) {
+          m_buffers.push_back(std::make_unique<ThreadBuffer>(
+              static_cast<uint32_t>(m_buffers.size() + 1)));
+          m_retired.reserve(m_buffers.size());
+          m_free.reserve(m_buffers.size());
+          slot.buf = m_buffers.back().get();
+        } else {
+          slot.buf = m_free.back();
+          m_free.pop_back();
+        }
+        slot.buf->name = slot.name;
+      } catch (...) {
+        return nullptr;
+      }
+    }
+    return slot.buf;
+  }
+
+  // Name the calling thread, applied to its buffer when it gets one
+  void setThreadName(std::string name) {
+    auto &slot = threadSlot();
+    slot.name = std::move(name);
+    if (slot.buf != nullptr) {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      slot.buf->name = slot.name;
+    }
+  }
+
+  [[nodiscard]] int64_t sinceEpoch(Clock::time_point t) const noexcept {
+    return toNs(t) - m_epoch.load(std::memory_order_relaxed);
+  }
+
+private:
+  Tracer() = default;
+
+  std::atomic<bool> m_enabled{false};
+  std::atomic<int64_t> m_epoch{toNs(Clock::now())};
+
+  std::mutex m_mutex;
+  std::vector<std::unique_ptr<ThreadBuffer>> m_buffers;
+  // Buffers of exited threads, reserved to hold every buffer so retiring
+  // never allocates. Retired ones may still hold events to write.
+  std::vector<ThreadBuffer *> m_retired;
+  std::vector<ThreadBuffer *> m_free;
+
+  // The calling thread's name and buffer, retired when the thread exits
+  struct ThreadSlot {
+    std::string name;
+    ThreadBuffer *buf{};
+
+    ThreadSlot() = default;
+    ThreadSlot(const ThreadSlot &) = delete;
+    ThreadSlot(ThreadSlot &&) = delete;
+    ThreadSlot &operator=(const ThreadSlot &) = delete;
+    ThreadSlot &operator=(ThreadSlot &&) = delete;
+    ~ThreadSlot() {
+      if (buf != nullptr) {
+        Tracer::get().retire(buf);
+      }
+    }
+  };
+  static ThreadSlot &threadSlot() noexcept {
+    thread_local ThreadSlot slot;
+    return slot;
+  }
+
+  void retire(ThreadBuffer *buf) noexcept {
+    try {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_retired.push_back(buf);
+    } catch (...) {
+      // Leaked to the trace, not reused
+    }
+  }
+
+  // Free the retired buffers, their events written or no longer wanted.
+  // Holds m_mutex.
+  void recycle() {
+    for (auto *buf : m_retired) {
+      buf->clear();
+      buf->name.clear();
+      m_free.push_back(buf);
+    }
+    m_retired.clear();
+  }
+
+  static int64_t toNs(Clock::time_point t) noexcept {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               t.time_since_epoch())
+        .count();
+  }
+
+  static std::string escape(const std::string &str) {
+    std::string out;
+    out.reserve(str.size());
+    for (const char c : str) {
+      if (c == '"' || c == '\\') {
+        out.push_back('\\');
+      }
+      out.push_back(c);
+    }
+    return out;
+  }
+};
+
+[[nodiscard]] inline bool enabled() noexcept {
+  return Tracer::get().enabled();
+}
+
+// Record a complete event spanning [start, end]
+inline void complete(const char *name, Clock::time_point start,
+                     Clock::time_point end) noexcept {
+  auto &tracer = Tracer::get();
+  if (tracer.enabled()) {
+    if (auto *buf = tracer.threadBuffer()) {
+      const auto ts = tracer.sinceEpoch(start);
+      buf->push({name, ts, tracer.sinceEpoch(end) - ts, 'X'});
+    }
+  }
+}
+
+// Record an instant event
+inline void instant(const char *name) noexcept {
+  auto &tracer = Tracer::get();
+  if (tracer.enabled()) {
+    if (auto *buf = tracer.threadBuffer()) {
+      buf->push({name, tracer.sinceEpoch(Clock::now()), 0, 'i'});
+    }
+  }
+}
+
+// Name the calling thread in the trace. Cheap, doesn't allocate a buffer.
+inline void setThreadName(std::string name) {
+  Tracer::get().setThreadName(std::move(name));
+}
+
+/**
+RAII complete event. Costs one relaxed load when tracing is disabled.
+Example:
+{
+  trace::Scope scope("Ring produce");
+  ...
+}
+ */
+class Scope {
+public:
+  explicit Scope(const char *name) noexcept
+      : m_name(enabled() ? name : nullptr) {
+    if (m_name != nullptr) {
+      m_start = Clock::now();
+    }
+  }
+
+  Scope(const Scope &) = delete;
+  Scope(Scope &&) = delete;
+  Scope &operator=(const Scope &) = delete;
+  Scope &operator=(Scope &&) = delete;
+
+  ~Scope() {
+    if (m_name != nullptr) {
+      complete(m_name, m_start, Clock::now());
+    }
+  }
+
+private:
+  const char *m_name;
+  Clock::time_point m_start;
+};
+
+} // namespace OCT::trace
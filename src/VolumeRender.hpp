@@ -0,0 +1,441 @@
+#pragma once
+
+#include "VolumeStore.hpp"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <numbers>
+#include <oneapi/tbb/parallel_for.h>
+#include <opencv2/core.hpp>
+#include <utility>
+#include <vector>
+
+/*
+CPU ray-cast rendering of a pullback volume (see `VolumeStore`), for
+machines without a GPU, e.g. analysis servers used over remote desktop.
+
+The volume is cylindrical: frame z, A-line (angle) and depth (radius, after
+`padTop`). Rays are cast in cartesian space through the cylinder's bounding
+box and sample the cylindrical grid directly, so there's no resampled copy
+of the volume.
+
+  - `VolumeHierarchy` keeps the full resolution level zero-copy in the
+    store's map, plus max-pooled levels at 1/2 and 1/4 resolution. Coarse
+    levels render while the camera moves, and the coarsest level also
+    serves as the occupancy for empty space skipping: a ray steps over a
+    coarse cell whose max can't change the result.
+  - `renderVolume` splits the image into tiles rendered in parallel with
+    TBB, and stops each ray once it's opaque (alpha) or saturated (MIP).
+*/
+namespace OCT {
+
+enum class VolumeRenderMode : uint8_t { MIP = 0, Alpha };
+
+struct VolumeRenderParams {
+  VolumeRenderMode mode{VolumeRenderMode::MIP};
+  // Values at or below are transparent (alpha) or ignored (MIP)
+  int threshold{60};
+  // Opacity per voxel of a 255 sample, alpha mode
+  float opacity{0.1F};
+  // Pullback pitch: length of one frame in depth pixels
+  float zScale{4.0F};
+  // Radius of the top of the rect image, see `OCTReconParams::padTop`
+  int padTop{0};
+};
+
+// Orbit camera around the center of the volume
+struct VolumeCamera {
+  float azimuth{30.0F};   // Degrees around the pullback axis
+  float elevation{20.0F}; // Degrees above the cross-section plane
+  float zoom{1.0F};
+
+  bool operator==(const VolumeCamera &) const = default;
+};
+
+/**
+A level of the hierarchy: voxel (frame z, depth d, A-line l) at
+`data[z * frameStride + d * nLines + l]`.
+ */
+struct VolumeGrid {
+  const uint8_t *data{};
+  int frames{};
+  int depth{};
+  int nLines{};
+  size_t frameStride{};
+  // Level 0 voxels per voxel along each axis
+  int scale{1};
+  // Level 0: frames are read only while the store has them, so frames of
+  // old recon params left in the file after a `VolumeStore::reset` are empty
+  const VolumeStore *store{};
+  // Coarse levels: per frame, nonzero if every level 0 frame under it was
+  // valid when the level was built. Frames written since aren't in `data`,
+  // so their occupancy is unknown.
+  const uint8_t *known{};
+
+  [[nodiscard]] uint8_t at(int z, int d, int l) const {
+    return data[static_cast<size_t>(z) * frameStride + // NOLINT
+                static_cast<size_t>(d) * nLines + l];
+  }
+  [[nodiscard]] bool valid(int z) const {
+    return store == nullptr || store->has(static_cast<size_t>(z));
+  }
+  [[nodiscard]] bool isKnown(int z) const {
+    return known == nullptr || known[z] != 0; // NOLINT
+  }
+};
+
+class VolumeHierarchy {
+public:
+  static constexpr int Levels = 3;
+
+  /*
+  Build the coarse levels of `store` (in parallel over frames) from the
+  frames it has now; the others are empty and marked unknown. Returns
+  nullptr if cancelled or the store is empty.
+  */
+  static std::shared_ptr<const VolumeHierarchy>
+  build(std::shared_ptr<const VolumeStore> store,
+        const std::atomic<bool> &cancel) {
+    const auto &g = store->geometry();
+    if (!store->ok() || g.nFrames == 0 || g.depth == 0 || g.nLines == 0) {
+      return nullptr;
+    }
+    auto h = std::make_shared<VolumeHierarchy>();
+    h->m_levels[0] = {store->frame(0).data,
+                      static_cast<int>(g.nFrames),
+                      static_cast<int>(g.depth),
+                      static_cast<int>(g.nLines),
+                      store->frameStride(),
+                      1,
+                      store.get()};
+    auto &valid = h->m_known[0];
+    valid.resize(g.nFrames);
+    for (size_t z = 0; z < g.nFrames; ++z) {
+      valid[z] = store->has(z) ? 1 : 0;
+    }
+    h->m_builtFrames = static_cast<size_t>(std::count(valid.begin(),
+                                                      valid.end(), 1));
+    for (int k = 1; k < Levels; ++k) {
+      h->downsample(k, cancel);
+      if (cancel) {
+        return nullptr;
+      }
+    }
+    h->m_store = std::move(store);
+    return h;
+  }
+
+  [[nodiscard]] const VolumeGrid &level(int k) const { return m_levels[k]; }
+  [[nodiscard]] const VolumeGrid &coarsest() const {
+    return m_levels[Levels - 1];
+  }
+  [[nodiscard]] const VolumeStore &store() const { return *m_store; }
+  // Frames the store had when the coarse levels were built
+  [[nodiscard]] size_t builtFrames() const { return m_builtFrames; }
+
+private:
+  // Keeps level 0 mapped
+  std::shared_ptr<const VolumeStore> m_store;
+  std::array<VolumeGrid, Levels> m_levels;
+  std::array<std::vector<uint8_t>, Levels> m_storage;
+  // Per level and frame, see `VolumeGrid::known`. Level 0 is the frames
+  // that were valid at build time.
+  std::array<std::vector<uint8_t>, Levels> m_known;
+  size_t m_builtFrames{};
+
+  // Level k from level k - 1, max over 2x2x2 voxels
+  void downsample(int k, const std::atomic<bool> &cancel) {
+    const auto &src = m_levels[k - 1];
+    VolumeGrid dst;
+    dst.frames = (src.frames + 1) / 2;
+    dst.depth = (src.depth + 1) / 2;
+    dst.nLines = (src.nLines + 1) / 2;
+    dst.frameStride = static_cast<size_t>(dst.depth) * dst.nLines;
+    dst.scale = src.scale * 2;
+    auto &storage = m_storage[k];
+    storage.resize(dst.frameStride * dst.frames);
+    const auto &srcKnown = m_known[k - 1];
+    auto &known = m_known[k];
+    known.resize(static_cast<size_t>(dst.frames));
+
+    tbb::parallel_for(0, dst.frames, [&](int z) {
+      if (cancel) {
+        return;
+      }
+      int z0 = 2 * z;
+      int z1 = std::min(z0 + 1, src.frames - 1);
+      known[z] = srcKnown[z0] != 0 && srcKnown[z1] != 0 ? 1 : 0;
+      uint8_t *out = storage.data() + dst.frameStride * z; // NOLINT
+      // Level 0 frames not valid at build time are left out (empty). The
+      // coarser levels are built from already masked levels.
+      if (k == 1) {
+        if (srcKnown[z0] == 0) {
+          z0 = z1;
+        }
+        if (srcKnown[z1] == 0) {
+          z1 = z0;
+        }
+        if (srcKnown[z0] == 0) {
+          std::fill_n(out, dst.frameStride, uint8_t{0});
+          return;
+        }
+      }
+      for (int d = 0; d < dst.depth; ++d) {
+        const int d0 = 2 * d;
+        const int d1 = std::min(d0 + 1, src.depth - 1);
+        for (int l = 0; l < dst.nLines; ++l) {
+          const int l0 = 2 * l;
+          const int l1 = std::min(l0 + 1, src.nLines - 1);
+          out[d * dst.nLines + l] = std::max( // NOLINT
+              {src.at(z0, d0, l0), src.at(z0, d0, l1), src.at(z0, d1, l0),
+               src.at(z0, d1, l1), src.at(z1, d0, l0), src.at(z1, d0, l1),
+               src.at(z1, d1, l0), src.at(z1, d1, l1)});
+        }
+      }
+    });
+    dst.data = storage.data();
+    dst.known = known.data();
+    m_levels[k] = dst;
+  }
+};
+
+namespace detail {
+
+struct Vec3 {
+  float x{}, y{}, z{};
+
+  Vec3 operator+(Vec3 o) const { return {x + o.x, y + o.y, z + o.z}; }
+  Vec3 operator-(Vec3 o) const { return {x - o.x, y - o.y, z - o.z}; }
+  Vec3 operator*(float s) const { return {x * s, y * s, z * s}; }
+  [[nodiscard]] float dot(Vec3 o) const { return x * o.x + y * o.y + z * o.z; }
+  [[nodiscard]] Vec3 cross(Vec3 o) const {
+    return {y * o.z - z * o.y, z * o.x - x * o.z, x * o.y - y * o.x};
+  }
+  [[nodiscard]] Vec3 normalized() const {
+    return *this * (1.0F / std::sqrt(dot(*this)));
+  }
+};
+
+// Cylindrical sampling of one level in level 0 units
+struct Sampler {
+  const VolumeGrid &grid;
+  float padTop;
+  float zScale;
+  float linesPerRad;
+
+  /*
+  Voxel containing cartesian point p, or -1 outside the volume. Frames that
+  aren't valid are empty. As `occupancy`, frames of unknown content are 255
+  so they're never skipped.
+  */
+  [[nodiscard]] int sample(Vec3 p, float &radius,
+                           bool occupancy = false) const {
+    radius = std::sqrt(p.x * p.x + p.y * p.y);
+    const auto d = static_cast<int>((radius - padTop) / grid.scale);
+    const auto z = static_cast<int>(p.z / zScale / grid.scale);
+    if (radius < padTop || d >= grid.depth || p.z < 0 || z >= grid.frames) {
+      return -1;
+    }
+    if (occupancy && !grid.isKnown(z)) {
+      return 255; // NOLINT(*-magic-numbers)
+    }
+    if (!grid.valid(z)) {
+      return 0;
+    }
+    float angle = std::atan2(p.y, p.x);
+    if (angle < 0) {
+      angle += 2 * std::numbers::pi_v<float>;
+    }
+    const int l =
+        std::min(static_cast<int>(angle * linesPerRad / grid.scale),
+                 grid.nLines - 1);
+    return grid.at(z, d, l);
+  }
+
+  // Smallest extent of a voxel at `radius` (radial, arc, pullback), at least
+  // a quarter voxel so rays near the axis still advance
+  [[nodiscard]] float cellSize(float radius) const {
+    const float arc = radius / linesPerRad;
+    return static_cast<float>(grid.scale) *
+           std::max(0.25F, std::min({1.0F, arc, zScale}));
+  }
+};
+
+} // namespace detail
+
+/*
+Render `hierarchy` at `level` into `image` (its size is the resolution).
+Returns false if `cancel` was set, in which case some tiles are missing.
+*/
+inline bool renderVolume(const VolumeHierarchy &hierarchy, int level,
+                         const VolumeCamera &camera,
+                         const VolumeRenderParams &params,
+                         cv::Mat_<uint8_t> &image,
+                         const std::atomic<bool> &cancel) {
+  using detail::Vec3;
+  constexpr float pi = std::numbers::pi_v<float>;
+  constexpr int Tile = 32;
+  constexpr float FovDeg = 40.0F;
+  constexpr float Opaque = 0.97F;
+  // Samples per voxel of the level rendered
+  constexpr float StepFraction = 0.5F;
+
+  const auto &grid = hierarchy.level(level);
+  const auto &level0 = hierarchy.level(0);
+  const float linesPerRad = static_cast<float>(level0.nLines) / (2 * pi);
+  const detail::Sampler fine{grid, static_cast<float>(params.padTop),
+                             params.zScale, linesPerRad};
+  const detail::Sampler coarse{hierarchy.coarsest(),
+                               static_cast<float>(params.padTop),
+                               params.zScale, linesPerRad};
+
+  // Bounding box of the cylinder
+  const float radius = static_cast<float>(params.padTop + level0.depth);
+  const float length = params.zScale * static_cast<float>(level0.frames);
+  const Vec3 boxMin{-radius, -radius, 0};
+  const Vec3 boxMax{radius, radius, length};
+  const Vec3 center{0, 0, length / 2};
+
+  // Orbit camera looking at the center, z up
+  const float az = camera.azimuth * pi / 180;
+  const float el = std::clamp(camera.elevation, -89.0F, 89.0F) * pi / 180;
+  const float distance =
+      2.5F * std::max(radius, length / 2) / std::max(camera.zoom, 0.01F);
+  const Vec3 eye = center + Vec3{std::cos(el) * std::cos(az),
+                                 std::cos(el) * std::sin(az), std::sin(el)} *
+                                distance;
+  const Vec3 forward = (center - eye).normalized();
+  const Vec3 right = forward.cross({0, 0, 1}).normalized();
+  const Vec3 up = right.cross(forward);
+  const float tanHalf = std::tan(FovDeg / 2 * pi / 180);
+  const float aspect =
+      static_cast<float>(image.cols) / static_cast<float>(image.rows);
+
+  const auto threshold = static_cast<uint8_t>(std::clamp(params.threshold, 0,
+                                                         255)); // NOLINT
+  const bool alpha = params.mode == VolumeRenderMode::Alpha;
+
+  const auto castRay = [&](Vec3 dir) -> uint8_t {
+    // Slab intersection with the bounding box
+    float tNear = 0;
+    float tFar = std::numeric_limits<float>::max();
+    const std::array<std::array<float, 3>, 3> axes{
+        {{eye.x, dir.x, 0}, {eye.y, dir.y, 1}, {eye.z, dir.z, 2}}};
+    const std::array<float, 3> lo{boxMin.x, boxMin.y, boxMin.z};
+    const std::array<float, 3> hi{boxMax.x, boxMax.y, boxMax.z};
+    for (const auto &[o, dv, axis] : axes) {
+      const auto a = static_cast<size_t>(axis);
+      if (std::abs(dv) < 1e-8F) {
+        if (o < lo[a] || o > hi[a]) {
+          return 0;
+        }
+        continue;
+      }
+      float t0 = (lo[a] - o) / dv;
+      float t1 = (hi[a] - o) / dv;
+      if (t0 > t1) {
+        std::swap(t0, t1);
+      }
+      tNear = std::max(tNear, t0);
+      tFar = std::min(tFar, t1);
+    }
+    if (tNear >= tFar) {
+      return 0;
+    }
+
+    float maxValue = 0;
+    float color = 0;
+    float opacity = 0;
+    // Last skip taken, and the end of the span stepped finely after a skip
+    // landed in an occupied cell
+    float skipped = 0;
+    float fineUntil = tNear;
+    for (float t = tNear; t < tFar;) {
+      const Vec3 p = eye + dir * t;
+      float r{};
+
+      // Skip coarse cells that can't change the result. A skip may overshoot
+      // the start of an occupied cell, so on landing in one, back up and
+      // step finely to where it landed.
+      if (t >= fineUntil) {
+        const int occupancy = coarse.sample(p, r, true);
+        const int skipBelow =
+            alpha ? threshold
+                  : std::max(static_cast<int>(maxValue), int{threshold});
+        if (occupancy <= skipBelow) {
+          skipped = coarse.cellSize(r);
+          if (r < params.padTop) {
+            // In the lumen, the cylinder is at least this far
+            skipped = std::max(skipped, static_cast<float>(params.padTop) - r);
+          }
+          t += skipped;
+          continue;
+        }
+        if (skipped > 0) {
+          fineUntil = t;
+          t -= skipped;
+          skipped = 0;
+          continue;
+        }
+      }
+
+      const int v = fine.sample(p, r);
+      const float step = fine.cellSize(r) * StepFraction;
+      t += step;
+      if (v <= threshold) {
+        continue;
+      }
+      if (alpha) {
+        const float ramp = static_cast<float>(v - threshold) /
+                           static_cast<float>(255 - threshold); // NOLINT
+        const float a =
+            std::min(1.0F, params.opacity * ramp * step / grid.scale);
+        color += (1 - opacity) * a * static_cast<float>(v);
+        opacity += (1 - opacity) * a;
+        if (opacity >= Opaque) {
+          break;
+        }
+      } else {
+        maxValue = std::max(maxValue, static_cast<float>(v));
+        if (v == 255) { // NOLINT(*-magic-numbers)
+          break;
+        }
+      }
+    }
+    return static_cast<uint8_t>(alpha ? color : maxValue);
+  };
+
+  const int tilesX = (image.cols + Tile - 1) / Tile;
+  const int tilesY = (image.rows + Tile - 1) / Tile;
+  tbb::parallel_for(0, tilesX * tilesY, [&](int tile) {
+    if (cancel) {
+      return;
+    }
+    const int x0 = (tile % tilesX) * Tile;
+    const int y0 = (tile / tilesX) * Tile;
+    const int x1 = std::min(x0 + Tile, image.cols);
+    const int y1 = std::min(y0 + Tile, image.rows);
+    for (int y = y0; y < y1; ++y) {
+      const float ny = 1 - 2 * (static_cast<float>(y) + 0.5F) /
+                               static_cast<float>(image.rows);
+      auto *row = image[y];
+      for (int x = x0; x < x1; ++x) {
+        const float nx = 2 * (static_cast<float>(x) + 0.5F) /
+                             static_cast<float>(image.cols) -
+                         1;
+        const Vec3 dir = (forward + right * (nx * tanHalf * aspect) +
+                          up * (ny * tanHalf))
+                             .normalized();
+        row[x] = castRay(dir); // NOLINT(*-pointer-arithmetic)
+      }
+    }
+  });
+  return !cancel;
+}
+
+} // namespace OCT
@@ -0,0 +1,341 @@
+#pragma once
+
+#include "VolumeRender.hpp"
+#include "VolumeStore.hpp"
+#include "timeit.hpp"
+#include <QComboBox>
+#include <QDoubleSpinBox>
+#include <QEvent>
+#include <QHBoxLayout>
+#include <QImage>
+#include <QLabel>
+#include <QMetaObject>
+#include <QMouseEvent>
+#include <QPainter>
+#include <QPointF>
+#include <QPushButton>
+#include <QShowEvent>
+#include <QSlider>
+#include <QString>
+#include <QThreadPool>
+#include <QTimer>
+#include <QVBoxLayout>
+#include <QWheelEvent>
+#include <QWidget>
+#include <Qt>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <fmt/format.h>
+#include <memory>
+#include <opencv2/core.hpp>
+
+namespace OCT {
+
+/**
+3D view of the loaded sequence's volume store, ray cast on the CPU (see
+`renderVolume`). Drag to orbit, wheel to zoom.
+
+While the camera moves, frames render from the coarsest level at 1/4 of the
+view's resolution. Once it rests for `RefineMs`, they're refined to 1/2 and
+then full resolution. Each render cancels the one before it, so a slow
+full resolution pass never holds up interaction.
+
+The brick hierarchy is a snapshot of the store's coarse levels, rebuilt when
+the store changes, on "Rebuild", and at most every `RebuildMs` while frames
+are being added (see `storeUpdated`). Level 0 is the store's map itself, so
+frames written since the last build show up at full resolution right away:
+their coarse cells are unknown rather than empty, so rays don't skip them.
+ */
+class VolumeRenderView : public QWidget {
+  Q_OBJECT
+public:
+  static constexpr int RefineMs = 200;
+  static constexpr int RebuildMs = 2000;
+
+  VolumeRenderView()
+      : m_canvas(new QWidget), m_mode(new QComboBox), m_threshold(new QSlider),
+        m_zScale(new QDoubleSpinBox), m_btnRebuild(new QPushButton("Rebuild")),
+        m_status(new QLabel), m_refineTimer(new QTimer(this)),
+        m_rebuildTimer(new QTimer(this)) {
+    m_canvas->setMinimumSize(200, 200);
+    m_canvas->setCursor(Qt::OpenHandCursor);
+    m_canvas->installEventFilter(this);
+
+    m_mode->addItem("MIP");
+    m_mode->addItem("Alpha");
+    m_threshold->setOrientation(Qt::Horizontal);
+    m_threshold->setRange(0, 254);
+    m_threshold->setValue(m_params.threshold);
+    m_threshold->setToolTip("Values at or below are transparent");
+    m_zScale->setRange(0.1, 100.0);
+    m_zScale->setSingleStep(0.5);
+    m_zScale->setValue(m_params.zScale);
+    m_zScale->setToolTip("Pullback pitch, frame spacing in depth pixels");
+
+    // GUI
+    // ---
+    auto *layout = new QVBoxLayout;
+    setLayout(layout);
+    layout->addWidget(m_canvas, 1);
+    {
+      auto *hlayout = new QHBoxLayout;
+      layout->addLayout(hlayout);
+      hlayout->addWidget(m_mode);
+      hlayout->addWidget(new QLabel("Threshold"));
+      hlayout->addWidget(m_threshold);
+      hlayout->addWidget(new QLabel("Frame spacing"));
+      hlayout->addWidget(m_zScale);
+      hlayout->addWidget(m_btnRebuild);
+    }
+    layout->addWidget(m_status);
+
+    // Bind
+    connect(m_mode, &QComboBox::currentIndexChanged, this, [this](int i) {
+      m_params.mode = static_cast<VolumeRenderMode>(i);
+      interact();
+    });
+    connect(m_threshold, &QSlider::valueChanged, this, [this](int v) {
+      m_params.threshold = v;
+      interact();
+    });
+    connect(m_zScale, &QDoubleSpinBox::valueChanged, this, [this](double v) {
+      m_params.zScale = static_cast<float>(v);
+      interact();
+    });
+    connect(m_btnRebuild, &QPushButton::clicked, this,
+            &VolumeRenderView::rebuild);
+    m_refineTimer->setSingleShot(true);
+    m_refineTimer->setInterval(RefineMs);
+    connect(m_refineTimer, &QTimer::timeout, this, [this]() { render(1); });
+    m_rebuildTimer->setSingleShot(true);
+    m_rebuildTimer->setInterval(RebuildMs);
+    connect(m_rebuildTimer, &QTimer::timeout, this,
+            &VolumeRenderView::rebuild);
+  }
+
+  // Cancel the build and render in flight, e.g. before waiting on the pool
+  void cancel() {
+    if (m_buildCancel != nullptr) {
+      *m_buildCancel = true;
+    }
+    if (m_renderCancel != nullptr) {
+      *m_renderCancel = true;
+    }
+  }
+
+public Q_SLOTS:
+  // View `store` (nullptr for none), its rect images' top at radius `padTop`
+  void setVolume(std::shared_ptr<const VolumeStore> store, int padTop) {
+    cancel();
+    m_store = std::move(store);
+    m_params.padTop = padTop;
+    m_hierarchy.reset();
+    m_image = {};
+    m_canvas->update();
+    rebuild();
+  }
+
+  // Rebuild the coarse levels from the frames in the store now. Deferred
+  // until shown.
+  void rebuild() {
+    cancel();
+    m_stale = true;
+    if (m_store == nullptr || !isVisible()) {
+      return;
+    }
+    m_stale = false;
+    m_rebuildTimer->stop();
+
+    auto cancel = std::make_shared<std::atomic<bool>>(false);
+    m_buildCancel = cancel;
+    m_status->setText("Building...");
+    QThreadPool::globalInstance()->start([this, store = m_store, cancel]() {
+      TimeIt timeit;
+      auto hierarchy = VolumeHierarchy::build(store, *cancel);
+      if (hierarchy == nullptr) {
+        return;
+      }
+      const auto msg = QString::fromStdString(
+          fmt::format("Built in {:.0f} ms", timeit.get_ms()));
+      QMetaObject::invokeMethod(this, [this, hierarchy = std::move(hierarchy),
+                                       cancel, msg]() mutable {
+        if (*cancel) {
+          return;
+        }
+        m_hierarchy = std::move(hierarchy);
+        m_status->setText(msg);
+        interact();
+      });
+    });
+  }
+
+  // Frames were written to the store, e.g. on pre-recon progress. Folds
+  // them into the coarse levels, throttled to a rebuild every `RebuildMs`.
+  void storeUpdated() {
+    if (m_store == nullptr || m_rebuildTimer->isActive()) {
+      return;
+    }
+    if (m_hierarchy == nullptr ||
+        m_store->count() != m_hierarchy->builtFrames()) {
+      m_rebuildTimer->start();
+    }
+  }
+
+protected:
+  void showEvent(QShowEvent *event) override {
+    QWidget::showEvent(event);
+    if (m_stale) {
+      rebuild();
+    }
+  }
+
+  bool eventFilter(QObject *obj, QEvent *event) override {
+    if (obj != m_canvas) {
+      return QWidget::eventFilter(obj, event);
+    }
+    switch (event->type()) {
+    case QEvent::Paint:
+      paintCanvas();
+      return true;
+    case QEvent::Resize:
+      interact();
+      break;
+    case QEvent::MouseButtonPress:
+      m_lastPos = static_cast<QMouseEvent *>(event)->position();
+      m_canvas->setCursor(Qt::ClosedHandCursor);
+      return true;
+    case QEvent::MouseButtonRelease:
+      m_canvas->setCursor(Qt::OpenHandCursor);
+      return true;
+    case QEvent::MouseMove: {
+      const auto *mouse = static_cast<QMouseEvent *>(event);
+      if ((mouse->buttons() & Qt::LeftButton) == 0) {
+        break;
+      }
+      constexpr float DegPerPixel = 0.5F;
+      const auto delta = mouse->position() - m_lastPos;
+      m_lastPos = mouse->position();
+      m_camera.azimuth -= static_cast<float>(delta.x()) * DegPerPixel;
+      m_camera.elevation =
+          std::clamp(m_camera.elevation +
+                         static_cast<float>(delta.y()) * DegPerPixel,
+                     -89.0F, 89.0F);
+      interact();
+      return true;
+    }
+    case QEvent::Wheel: {
+      const auto *wheel = static_cast<QWheelEvent *>(event);
+      const auto steps = static_cast<float>(wheel->angleDelta().y()) / 120;
+      m_camera.zoom =
+          std::clamp(m_camera.zoom * std::pow(1.1F, steps), 0.2F, 20.0F);
+      interact();
+      return true;
+    }
+    default:
+      break;
+    }
+    return QWidget::eventFilter(obj, event);
+  }
+
+private:
+  QWidget *m_canvas;
+  QComboBox *m_mode;
+  QSlider *m_threshold;
+  QDoubleSpinBox *m_zScale;
+  QPushButton *m_btnRebuild;
+  QLabel *m_status;
+  QTimer *m_refineTimer;
+  QTimer *m_rebuildTimer;
+
+  std::shared_ptr<const VolumeStore> m_store;
+  std::shared_ptr<const VolumeHierarchy> m_hierarchy;
+  // The store changed while hidden
+  bool m_stale{false};
+  std::shared_ptr<std::atomic<bool>> m_buildCancel;
+  std::shared_ptr<std::atomic<bool>> m_renderCancel;
+
+  VolumeCamera m_camera;
+  VolumeRenderParams m_params;
+  QPointF m_lastPos;
+  QImage m_image;
+
+  // Progressive passes: hierarchy level and image downscale
+  struct Pass {
+    int level;
+    int downscale;
+  };
+  static constexpr std::array<Pass, 3> Passes{{{2, 4}, {1, 2}, {0, 1}}};
+
+  // Camera or params changed: coarse pass now, refine once it rests
+  void interact() {
+    render(0);
+    m_refineTimer->start();
+  }
+
+  // Render pass `pass` in the background, then the next finer one unless
+  // it's the interactive pass
+  void render(size_t pass) {
+    if (m_hierarchy == nullptr || !isVisible()) {
+      return;
+    }
+    if (m_renderCancel != nullptr) {
+      *m_renderCancel = true;
+    }
+    auto cancel = std::make_shared<std::atomic<bool>>(false);
+    m_renderCancel = cancel;
+
+    const int level = Passes.at(pass).level;
+    const int downscale = Passes.at(pass).downscale;
+    const int width = std::max(1, m_canvas->width() / downscale);
+    const int height = std::max(1, m_canvas->height() / downscale);
+    QThreadPool::globalInstance()->start([this, hierarchy = m_hierarchy,
+                                          camera = m_camera, params = m_params,
+                                          level, width, height, pass,
+                                          cancel]() {
+      TimeIt timeit;
+      cv::Mat_<uint8_t> mat(height, width);
+      if (!renderVolume(*hierarchy, level, camera, params, mat, *cancel)) {
+        return;
+      }
+      auto img = QImage(mat.data, mat.cols, mat.rows,
+                        static_cast<qsizetype>(mat.step),
+                        QImage::Format_Grayscale8)
+                     .copy();
+      const auto msg = QString::fromStdString(
+          fmt::format("Level {}, {}x{} in {:.0f} ms", level, width, height,
+                      timeit.get_ms()));
+
+      QMetaObject::invokeMethod(this, [this, img = std::move(img), msg,
+                                       pass, cancel]() mutable {
+        if (*cancel) {
+          return;
+        }
+        m_image = std::move(img);
+        m_status->setText(msg);
+        m_canvas->update();
+        if (pass > 0 && pass + 1 < Passes.size()) {
+          render(pass + 1);
+        }
+      });
+    });
+  }
+
+  void paintCanvas() {
+    QPainter painter(m_canvas);
+    painter.fillRect(m_canvas->rect(), Qt::black);
+    if (m_image.isNull()) {
+      painter.setPen(Qt::gray);
+      painter.drawText(m_canvas->rect(), Qt::AlignCenter,
+                       m_store == nullptr ? "No volume" : "Building...");
+      return;
+    }
+    painter.setRenderHint(QPainter::SmoothPixmapTransform);
+    painter.drawImage(m_canvas->rect(), m_image);
+  }
+};
+
+} // namespace OCT
@@ -0,0 +1,383 @@
+#pragma once
+
+#include "Calibration.hpp"
+#include "Common.hpp"
+#include "FileIO.hpp"
+#include "MappedFile.hpp"
+#include "OCTRecon.hpp"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fmt/format.h>
+#include <fstream>
+#include <mutex>
+#include <opencv2/core.hpp>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <span>
+#include <system_error>
+#include <vector>
+
+/*
+Memory mapped store of the reconstructed rect images of a sequence, for
+volume level views and exports of pullbacks larger than RAM.
+
+Frames are written as they're reconstructed (by the recon worker and the
+pre-recon) and read through zero-copy cv::Mat views into the map, so only
+the pages touched are ever in memory. The file is reused on the next load
+while the recon params it was made with (`VolumeFileHeader::key`) match.
+
+Store files live in a cache directory (see `pathFor`), which `prune` keeps
+to one file per sequence and under a size budget. A file's space is
+allocated when it's opened, so a full disk fails `open` instead of a write.
+
+File (little endian):
+
+  VolumeFileHeader  64 bytes
+  written           uint8[ceil(nFrames / 8)], bit i set if frame i is valid
+  (zero padding to `dataOffset`, a multiple of `Alignment`)
+  frames            uint8[nFrames][frameStride], each a depth x nLines rect
+                    image followed by zero padding to `Alignment`
+
+So every frame starts on a page, a frame is contiguous, an A-line is
+strided by nLines and a depth slice (all frames at one depth) is strided by
+frameStride.
+*/
+namespace OCT {
+
+struct VolumeGeometry {
+  size_t depth{};
+  size_t nLines{};
+  size_t nFrames{};
+
+  bool operator==(const VolumeGeometry &) const = default;
+};
+
+struct VolumeFileHeader {
+  static constexpr std::array<char, 8> Magic{'O', 'C', 'T', 'V',
+                                             'O', 'L', 'U', 'M'};
+  static constexpr uint32_t Version = 1;
+
+  std::array<char, 8> magic{Magic};
+  uint32_t version{Version};
+  uint32_t reserved{};
+  uint64_t depth{};
+  uint64_t nLines{};
+  uint64_t nFrames{};
+  uint64_t frameStride{};
+  uint64_t dataOffset{};
+  // Fingerprint of the recon inputs the frames were made with
+  uint64_t key{};
+};
+static_assert(sizeof(VolumeFileHeader) == 64);
+
+/**
+Fingerprint of everything the rect images of `reader` depend on: the data
+files (size and modification time), calibration and the params that change
+the rect image, including the rotation in `params.additionalOffset`.
+ */
+template <Floating T>
+uint64_t volumeKey(const DatFileReader &reader, const Calibration<T> &calib,
+                   const OCTReconParams<T> &params) {
+  std::vector<uint64_t> fields{
+      calib.hash(),
+      reader.ALineSize(),
+      reader.linesPerFrame(),
+      reader.size(),
+      static_cast<uint64_t>(params.imageDepth),
+      static_cast<uint64_t>(params.n_splits),
+      static_cast<uint64_t>(params.contrast),
+      static_cast<uint64_t>(params.brightness),
+      static_cast<uint64_t>(params.clearTop),
+      static_cast<uint64_t>(params.additionalOffset),
+  };
+  for (const auto &file : reader.files()) {
+    std::error_code ec;
+    fields.push_back(fs::file_size(file, ec));
+    fields.push_back(static_cast<uint64_t>(
+        fs::last_write_time(file, ec).time_since_epoch().count()));
+  }
+  return fnv1a(std::as_bytes(std::span(fields)));
+}
+
+class VolumeStore {
+public:
+  // Frame and data alignment, the page size
+  static constexpr size_t Alignment = 4096;
+
+  VolumeStore() = default;
+  VolumeStore(const VolumeStore &) = delete;
+  VolumeStore &operator=(const VolumeStore &) = delete;
+  VolumeStore(VolumeStore &&) = delete;
+  VolumeStore &operator=(VolumeStore &&) = delete;
+  ~VolumeStore() = default;
+
+  // Default size budget of the cache directory, see `prune`
+  static constexpr uintmax_t CacheBytes = uintmax_t{32} << 30;
+
+  // Store file in the cache directory `dir` for a sequence's first data
+  // file. The geometry is part of the name, so a file is never resized while
+  // another store may map it.
+  static fs::path pathFor(const fs::path &dir, const fs::path &seqFile,
+                          const VolumeGeometry &g) {
+    return dir / fmt::format("{}{}x{}x{}.volume", filePrefix(seqFile),
+                             g.depth, g.nLines, g.nFrames);
+  }
+
+  /*
+  Delete the store files in `dir` other than `keep`: those of `seqFile` for
+  superseded geometries, then the least recently used until the rest fit in
+  `maxBytes`. On Windows a file still mapped by a store can't be deleted and
+  is left for the next prune.
+  */
+  static void prune(const fs::path &dir, const fs::path &seqFile,
+                    const fs::path &keep, uintmax_t maxBytes = CacheBytes) {
+    struct Entry {
+      fs::path path;
+      uintmax_t size;
+      fs::file_time_type time;
+    };
+    std::vector<Entry> entries;
+    uintmax_t total = 0;
+    const auto prefix = filePrefix(seqFile);
+    std::error_code ec;
+    for (const auto &entry : fs::directory_iterator(dir, ec)) {
+      const auto &path = entry.path();
+      if (path.extension() != ".volume" || path == keep) {
+        continue;
+      }
+      if (path.filename().string().starts_with(prefix)) {
+        fs::remove(path, ec);
+        continue;
+      }
+      const auto size = entry.file_size(ec);
+      const auto time = entry.last_write_time(ec);
+      if (!ec) {
+        entries.push_back({path, size, time});
+        total += size;
+      }
+    }
+
+    std::ranges::sort(entries, {}, &Entry::time);
+    for (const auto &entry : entries) {
+      if (total <= maxBytes) {
+        break;
+      }
+      if (fs::remove(entry.path, ec)) {
+        total -= entry.size;
+      }
+    }
+  }
+
+  /*
+  Map the store at `path` for `geometry`, creating (or recreating) the file
+  if it's missing or for another geometry and allocating its space. Frames
+  already in the file are kept if it was made with `key`. Call once, before
+  any writes; a store for another geometry is a new VolumeStore. Returns an
+  error message on failure, e.g. if the disk is too full for the file.
+  */
+  std::optional<std::string> open(const fs::path &path,
+                                  const VolumeGeometry &geometry,
+                                  uint64_t key) {
+    std::unique_lock<std::shared_mutex> lock(m_mutex);
+    m_path = path;
+    m_geometry = geometry;
+    m_frameStride = alignUp(geometry.depth * geometry.nLines);
+    m_dataOffset =
+        alignUp(sizeof(VolumeFileHeader) + bitmapBytes(geometry.nFrames));
+    const auto fileSize = m_dataOffset + geometry.nFrames * m_frameStride;
+
+    std::error_code ec;
+    if (fs::file_size(path, ec) != fileSize || ec) {
+      std::ofstream(path, std::ios::binary | std::ios::trunc);
+    }
+    // Also allocates files left sparse by an earlier version
+    if (const auto err = allocateFile(path, fileSize)) {
+      fs::remove(path, ec);
+      return fmt::format("Failed to allocate {} MB for {}: {}",
+                         fileSize >> 20, path.string(), err.message());
+    }
+    // Most recently used, for `prune`
+    fs::last_write_time(path, fs::file_time_type::clock::now(), ec);
+
+    m_file = MappedFile(path, MappedFile::Access::ReadWrite);
+    if (m_file.writableData() == nullptr || m_file.size() != fileSize) {
+      m_file = {};
+      return fmt::format("Failed to map {}", path.string());
+    }
+
+    VolumeFileHeader header;
+    std::memcpy(&header, m_file.data(), sizeof(header));
+    const bool valid = header.magic == VolumeFileHeader::Magic &&
+                       header.version == VolumeFileHeader::Version &&
+                       header.depth == geometry.depth &&
+                       header.nLines == geometry.nLines &&
+                       header.nFrames == geometry.nFrames &&
+                       header.frameStride == m_frameStride &&
+                       header.dataOffset == m_dataOffset;
+    if (!valid || header.key != key) {
+      writeHeader(key);
+    }
+    ++m_epoch;
+    return std::nullopt;
+  }
+
+  /*
+  Start over for new recon params: frames made with another `key` are
+  dropped and writes for older epochs are rejected. Waits for writes in
+  progress, so none marks its frame valid after the reset. Returns the new
+  epoch.
+  */
+  uint64_t reset(uint64_t key) {
+    std::unique_lock<std::shared_mutex> lock(m_mutex);
+    if (ok() && header().key != key) {
+      writeHeader(key);
+    }
+    return ++m_epoch;
+  }
+
+  // Current epoch to pass to `write`
+  [[nodiscard]] uint64_t epoch() const {
+    return m_epoch.load(std::memory_order_acquire);
+  }
+
+  /*
+  Write frame `i` (a depth x nLines rect image). Returns false if `epoch` is
+  stale or `rect` doesn't match the geometry. Frames written concurrently
+  with the same index are both valid recons; the last one wins.
+  */
+  bool write(uint64_t epoch, size_t i, const cv::Mat_<uint8_t> &rect) {
+    // Shared with other writes, a reset can't clear the bitmap between the
+    // epoch check and the mark
+    std::shared_lock<std::shared_mutex> lock(m_mutex);
+    if (!ok() || epoch != this->epoch() || i >= m_geometry.nFrames ||
+        static_cast<size_t>(rect.rows) != m_geometry.depth ||
+        static_cast<size_t>(rect.cols) != m_geometry.nLines) {
+      return false;
+    }
+    auto *dst = frameData(i);
+    if (rect.isContinuous()) {
+      std::memcpy(dst, rect.data, m_geometry.depth * m_geometry.nLines);
+    } else {
+      for (int r = 0; r < rect.rows; ++r) {
+        std::memcpy(dst + r * m_geometry.nLines, rect[r], m_geometry.nLines);
+      }
+    }
+    std::atomic_ref<uint8_t>(bitmap()[i / 8])
+        .fetch_or(static_cast<uint8_t>(1U << (i % 8)),
+                  std::memory_order_release);
+    return true;
+  }
+
+  [[nodiscard]] bool ok() const { return m_file.writableData() != nullptr; }
+  [[nodiscard]] const fs::path &path() const { return m_path; }
+  [[nodiscard]] const VolumeGeometry &geometry() const { return m_geometry; }
+  // Bytes from one frame to the next
+  [[nodiscard]] size_t frameStride() const { return m_frameStride; }
+
+  // Frame `i` has been written since the last key change
+  [[nodiscard]] bool has(size_t i) const {
+    return ok() && i < m_geometry.nFrames &&
+           (std::atomic_ref<uint8_t>(bitmap()[i / 8])
+                .load(std::memory_order_acquire) &
+            (1U << (i % 8))) != 0;
+  }
+  [[nodiscard]] size_t count() const {
+    size_t n = 0;
+    for (size_t i = 0; i < m_geometry.nFrames; ++i) {
+      n += has(i) ? 1 : 0;
+    }
+    return n;
+  }
+  [[nodiscard]] bool complete() const { return count() == m_geometry.nFrames; }
+
+  /*
+  Zero-copy views into the map, valid while this store is alive. Writes
+  through them go to the file. Check `has` before relying on the content.
+  */
+
+  // depth x nLines rect image of frame `i`
+  [[nodiscard]] cv::Mat_<uint8_t> frame(size_t i) const {
+    return cv::Mat_<uint8_t>(static_cast<int>(m_geometry.depth),
+                             static_cast<int>(m_geometry.nLines),
+                             frameData(i), m_geometry.nLines);
+  }
+  // depth x 1 A-line `line` of frame `i`
+  [[nodiscard]] cv::Mat_<uint8_t> aline(size_t i, size_t line) const {
+    return cv::Mat_<uint8_t>(static_cast<int>(m_geometry.depth), 1,
+                             frameData(i) + line, m_geometry.nLines);
+  }
+  // nFrames x nLines slice of every frame at depth `d`
+  [[nodiscard]] cv::Mat_<uint8_t> depthSlice(size_t d) const {
+    return cv::Mat_<uint8_t>(static_cast<int>(m_geometry.nFrames),
+                             static_cast<int>(m_geometry.nLines),
+                             frameData(0) + d * m_geometry.nLines,
+                             m_frameStride);
+  }
+
+  // Write dirty pages back to the file now instead of eventually
+  void flush() const { m_file.flush(); }
+
+private:
+  // Held exclusively by open and reset, shared by writes
+  std::shared_mutex m_mutex;
+  MappedFile m_file;
+  fs::path m_path;
+  VolumeGeometry m_geometry;
+  size_t m_frameStride{};
+  size_t m_dataOffset{};
+  std::atomic<uint64_t> m_epoch{};
+
+  static size_t alignUp(size_t n) {
+    return (n + Alignment - 1) / Alignment * Alignment;
+  }
+  static size_t bitmapBytes(size_t nFrames) { return (nFrames + 7) / 8; }
+
+  // Name prefix of every store file of `seqFile`: its stem and a hash of
+  // its full path, as files of different directories share the cache
+  static std::string filePrefix(const fs::path &seqFile) {
+    std::error_code ec;
+    const auto full = fs::absolute(seqFile, ec).generic_string();
+    return fmt::format("{}-{:016x}.", seqFile.stem().string(),
+                       fnv1a(std::as_bytes(std::span(full))));
+  }
+
+  [[nodiscard]] VolumeFileHeader header() const {
+    VolumeFileHeader header;
+    std::memcpy(&header, m_file.data(), sizeof(header));
+    return header;
+  }
+
+  // Write the header for the current geometry and `key`, with no frames
+  void writeHeader(uint64_t key) {
+    VolumeFileHeader header;
+    header.depth = m_geometry.depth;
+    header.nLines = m_geometry.nLines;
+    header.nFrames = m_geometry.nFrames;
+    header.frameStride = m_frameStride;
+    header.dataOffset = m_dataOffset;
+    header.key = key;
+    std::memcpy(m_file.writableData(), &header, sizeof(header));
+    for (size_t i = 0; i < bitmapBytes(m_geometry.nFrames); ++i) {
+      std::atomic_ref<uint8_t>(bitmap()[i]).store(0, std::memory_order_release);
+    }
+  }
+
+  [[nodiscard]] uint8_t *bitmap() const {
+    // NOLINTNEXTLINE(*-reinterpret-cast)
+    return reinterpret_cast<uint8_t *>(m_file.writableData() +
+                                       sizeof(VolumeFileHeader));
+  }
+  [[nodiscard]] uint8_t *frameData(size_t i) const {
+    // NOLINTNEXTLINE(*-reinterpret-cast)
+    return reinterpret_cast<uint8_t *>(m_file.writableData() + m_dataOffset +
+                                       i * m_frameStride);
+  }
+};
+
+} // namespace OCT
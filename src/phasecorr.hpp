@@ -39,6 +39,7 @@
  *  POSSIBILITY OF SUCH DAMAGE.
  *********************************************************************/
 
+#include <array>
 #include <cassert>
 #include <opencv2/opencv.hpp>
 #include <vector>
@@ -352,13 +353,24 @@ inline void divSpectrums(const Mat &srcA, const Mat &srcB, Mat &dst, int flags,
   }
 }
 
-inline void fftShift(Mat &out) {
+/*
+Buffers reused across phaseCorrelate calls of the same size, so repeated
+correlation (alignment, distortion correction) doesn't allocate per frame.
+*/
+struct PhaseCorrWorkspace {
+  Mat padded1, padded2, paddedWin;
+  Mat FFT1, FFT2, P, Pm, C;
+  std::vector<Mat> planes;
+  std::array<Mat, 4> tmp;
+};
+
+inline void fftShift(Mat &out, std::vector<Mat> &planes,
+                     std::array<Mat, 4> &tmps) {
   if (out.rows == 1 && out.cols == 1) {
     // trivially shifted.
     return;
   }
 
-  std::vector<Mat> planes;
   split(out, planes);
 
   int xMid = out.cols >> 1;
@@ -372,7 +384,7 @@ inline void fftShift(Mat &out) {
     xMid = xMid + yMid;
 
     for (size_t i = 0; i < planes.size(); i++) {
-      Mat tmp;
+      Mat &tmp = tmps[0];
       Mat half0(planes[i], Rect(0, 0, xMid + is_odd, 1));
       Mat half1(planes[i], Rect(xMid + is_odd, 0, xMid, 1));
 
@@ -391,7 +403,7 @@ inline void fftShift(Mat &out) {
       Mat q3(planes[i], Rect(xMid + isXodd, yMid + isYodd, xMid, yMid));
 
       if (!(isXodd || isYodd)) {
-        Mat tmp;
+        Mat &tmp = tmps[0];
         q0.copyTo(tmp);
         q3.copyTo(q0);
         tmp.copyTo(q3);
@@ -400,7 +412,7 @@ inline void fftShift(Mat &out) {
         q2.copyTo(q1);
         tmp.copyTo(q2);
       } else {
-        Mat tmp0, tmp1, tmp2, tmp3;
+        auto &[tmp0, tmp1, tmp2, tmp3] = tmps;
         q0.copyTo(tmp0);
         q1.copyTo(tmp1);
         q2.copyTo(tmp2);
@@ -418,6 +430,12 @@ inline void fftShift(Mat &out) {
   merge(planes, out);
 }
 
+inline void fftShift(Mat &out) {
+  std::vector<Mat> planes;
+  std::array<Mat, 4> tmps;
+  fftShift(out, planes, tmps);
+}
+
 inline Point2d weightedCentroid(const Mat &src, cv::Point peakLocation,
                                 cv::Size weightBoxSize, double *response) {
   int type = src.type();
@@ -486,6 +504,7 @@ inline Point2d weightedCentroid(const Mat &src, cv::Point peakLocation,
 }
 
 inline cv::Point2d phaseCorrelate(const Mat &src1, const Mat &src2,
+                                  PhaseCorrWorkspace &ws,
                                   const Mat &window = {},
                                   double *response = 0) {
 
@@ -501,7 +520,9 @@ inline cv::Point2d phaseCorrelate(const Mat &src1, const Mat &src2,
   int M = cv::getOptimalDFTSize(src1.rows);
   int N = cv::getOptimalDFTSize(src1.cols);
 
-  Mat padded1, padded2, paddedWin;
+  Mat &padded1 = ws.padded1;
+  Mat &padded2 = ws.padded2;
+  Mat &paddedWin = ws.paddedWin;
 
   if (M != src1.rows || N != src1.cols) {
     cv::copyMakeBorder(src1, padded1, 0, M - src1.rows, 0, N - src1.cols,
@@ -519,7 +540,11 @@ inline cv::Point2d phaseCorrelate(const Mat &src1, const Mat &src2,
     paddedWin = window;
   }
 
-  Mat FFT1, FFT2, P, Pm, C;
+  Mat &FFT1 = ws.FFT1;
+  Mat &FFT2 = ws.FFT2;
+  Mat &P = ws.P;
+  Mat &Pm = ws.Pm;
+  Mat &C = ws.C;
 
   // perform window multiplication if available
   if (!paddedWin.empty()) {
@@ -542,7 +567,8 @@ inline cv::Point2d phaseCorrelate(const Mat &src1, const Mat &src2,
 
   idft(C, C); // gives us the nice peak shift location...
 
-  fftShift(C); // shift the energy to the center of the frame.
+  // shift the energy to the center of the frame.
+  fftShift(C, ws.planes, ws.tmp);
 
   // locate the highest peak
   Point peakLoc;
@@ -564,6 +590,13 @@ inline cv::Point2d phaseCorrelate(const Mat &src1, const Mat &src2,
   return (center - t);
 }
 
+inline cv::Point2d phaseCorrelate(const Mat &src1, const Mat &src2,
+                                  const Mat &window = {},
+                                  double *response = 0) {
+  PhaseCorrWorkspace ws;
+  return phaseCorrelate(src1, src2, ws, window, response);
+}
+
 inline void createHanningWindow(Mat &dst, cv::Size winSize, int type) {
   CV_Assert(type == CV_32FC1 || type == CV_64FC1);
   CV_Assert(winSize.width > 1 && winSize.height > 1);